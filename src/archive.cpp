@@ -0,0 +1,554 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <array>
+#include <cctype>
+
+#include "archive.h"
+#include "log.h"
+
+
+RomIndex rom_index;
+
+static std::array<uint32_t, 256> MakeCrcTable() {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+        table[i] = c;
+    }
+    return table;
+}
+
+uint32_t Crc32(uint32_t crc, const uint8_t* data, size_t size) {
+    static const std::array<uint32_t, 256> table = MakeCrcTable();
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static inline uint16_t GetLE16(const uint8_t* ptr) {
+    return ptr[0] | (ptr[1] << 8);
+}
+
+static inline uint32_t GetLE32(const uint8_t* ptr) {
+    return ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | (static_cast<uint32_t>(ptr[3]) << 24);
+}
+
+static std::string GetExtension(const std::string& path) {
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos) return "";
+    std::string ext = path.substr(dot);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return static_cast<char>(tolower(c)); });
+    return ext;
+}
+
+bool Archive::IsArchive(const std::string& path) {
+    std::string ext = GetExtension(path);
+    return ext == ".zip" || ext == ".gz" || ext == ".7z";
+}
+
+bool Archive::IsNesFile(const std::string& name) {
+    return GetExtension(name) == ".nes";
+}
+
+bool Archive::ListEntries(const std::string& path, std::vector<ArchiveEntry>& entries) {
+    entries.clear();
+    std::string ext = GetExtension(path);
+    if (ext == ".7z") {
+        log_helper.AddLog("7z archives are not supported, please repack the ROM as zip or gz!\n", LogCategory::io, LogLevel::error);
+        return true;
+    }
+
+    FILE* file = nullptr;
+    if (fopen_s(&file, path.c_str(), "rb")) {
+        log_helper.AddLog("Error while opening archive!\n", LogCategory::io, LogLevel::error);
+        return true;
+    }
+
+    bool error = (ext == ".zip") ? ListZip(file, entries) : ListGzip(file, path, entries);
+    fclose(file);
+    return error;
+}
+
+bool Archive::ListZip(FILE* file, std::vector<ArchiveEntry>& entries) {
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    if (file_size < 22) return true;
+
+    // The end of central directory record sits behind an optional comment of up to 64 KB
+    long tail_size = std::min(file_size, 0xFFFFL + 22);
+    std::vector<uint8_t> tail(tail_size);
+    fseek(file, file_size - tail_size, SEEK_SET);
+    if (fread(&tail[0], 1, tail_size, file) != static_cast<size_t>(tail_size)) return true;
+
+    long eocd = -1;
+    for (long i = tail_size - 22; i >= 0; --i) {
+        if (GetLE32(&tail[i]) == 0x06054B50) {
+            eocd = i;
+            break;
+        }
+    }
+    if (eocd < 0) {
+        log_helper.AddLog("Invalid zip file!\n", LogCategory::io, LogLevel::error);
+        return true;
+    }
+
+    uint16_t entry_count = GetLE16(&tail[eocd + 10]);
+    uint32_t dir_size = GetLE32(&tail[eocd + 12]);
+    uint32_t dir_offset = GetLE32(&tail[eocd + 16]);
+    if (static_cast<uint64_t>(dir_offset) + dir_size > static_cast<uint64_t>(file_size)) return true;
+
+    std::vector<uint8_t> dir(dir_size + 1);
+    fseek(file, dir_offset, SEEK_SET);
+    if (fread(&dir[0], 1, dir_size, file) != dir_size) return true;
+
+    uint32_t pos = 0;
+    for (uint16_t i = 0; i < entry_count; ++i) {
+        if (pos + 46 > dir_size || GetLE32(&dir[pos]) != 0x02014B50) return true;
+        uint16_t name_len = GetLE16(&dir[pos + 28]);
+        uint16_t extra_len = GetLE16(&dir[pos + 30]);
+        uint16_t comment_len = GetLE16(&dir[pos + 32]);
+        if (pos + 46 + name_len > dir_size) return true;
+
+        ArchiveEntry entry;
+        entry.method = GetLE16(&dir[pos + 10]);
+        entry.crc = GetLE32(&dir[pos + 16]);
+        entry.compressed_size = GetLE32(&dir[pos + 20]);
+        entry.size = GetLE32(&dir[pos + 24]);
+        entry.offset = GetLE32(&dir[pos + 42]);
+        entry.name.assign(reinterpret_cast<const char*>(&dir[pos + 46]), name_len);
+
+        if (!entry.name.empty() && entry.name.back() != '/') entries.push_back(entry);  // Skip directories
+        pos += 46 + name_len + extra_len + comment_len;
+    }
+
+    return false;
+}
+
+bool Archive::ListGzip(FILE* file, const std::string& path, std::vector<ArchiveEntry>& entries) {
+    uint8_t header[10]{};
+    if (fread(&header[0], 1, 10, file) != 10 || header[0] != 0x1F || header[1] != 0x8B || header[2] != 8) {
+        log_helper.AddLog("Invalid gzip file!\n", LogCategory::io, LogLevel::error);
+        return true;
+    }
+
+    ArchiveEntry entry;
+    uint8_t flags = header[3];
+    if (flags & 0x04) {  // FEXTRA
+        uint8_t extra_len[2]{};
+        if (fread(&extra_len[0], 1, 2, file) != 2) return true;
+        fseek(file, GetLE16(&extra_len[0]), SEEK_CUR);
+    }
+    if (flags & 0x08) {  // FNAME
+        int c;
+        while ((c = fgetc(file)) > 0) entry.name += static_cast<char>(c);
+        if (c < 0) return true;
+    }
+    if (flags & 0x10) {  // FCOMMENT
+        int c;
+        while ((c = fgetc(file)) > 0);
+        if (c < 0) return true;
+    }
+    if (flags & 0x02) fseek(file, 2, SEEK_CUR);  // FHCRC
+
+    long data_start = ftell(file);
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    if (file_size - data_start < 8) return true;
+
+    uint8_t trailer[8]{};
+    fseek(file, file_size - 8, SEEK_SET);
+    if (fread(&trailer[0], 1, 8, file) != 8) return true;
+
+    if (entry.name.empty()) {  // Fall back to the archive name without the .gz
+        size_t slash = path.find_last_of("/\\");
+        entry.name = path.substr((slash == std::string::npos) ? 0 : slash + 1);
+        entry.name.resize(entry.name.size() - 3);
+    }
+    entry.method = 8;
+    entry.offset = static_cast<uint32_t>(data_start);
+    entry.compressed_size = static_cast<uint32_t>(file_size - data_start - 8);
+    entry.crc = GetLE32(&trailer[0]);
+    entry.size = GetLE32(&trailer[4]);
+    entries.push_back(entry);
+
+    return false;
+}
+
+bool Archive::Extract(const std::string& path, const ArchiveEntry& entry, const Sink& sink) {
+    FILE* file = nullptr;
+    if (fopen_s(&file, path.c_str(), "rb")) {
+        log_helper.AddLog("Error while opening archive!\n", LogCategory::io, LogLevel::error);
+        return true;
+    }
+
+    uint32_t data_start = entry.offset;
+    if (GetExtension(path) == ".zip") {
+        uint8_t local[30]{};
+        fseek(file, entry.offset, SEEK_SET);
+        if (fread(&local[0], 1, 30, file) != 30 || GetLE32(&local[0]) != 0x04034B50) {
+            fclose(file);
+            return true;
+        }
+        data_start += 30 + GetLE16(&local[26]) + GetLE16(&local[28]);
+    }
+    fseek(file, data_start, SEEK_SET);
+
+    bool error = false;
+    uint32_t crc = 0, total = 0;
+    if (entry.method == 0) {  // Stored
+        uint8_t buff[0x4000];
+        uint32_t left = entry.compressed_size;
+        while (left > 0 && !error) {
+            size_t chunk = fread(&buff[0], 1, std::min<uint32_t>(left, sizeof(buff)), file);
+            if (chunk == 0) break;
+            crc = Crc32(crc, &buff[0], chunk);
+            total += static_cast<uint32_t>(chunk);
+            left -= static_cast<uint32_t>(chunk);
+            error = sink(&buff[0], chunk);
+        }
+    }
+    else if (entry.method == 8) {  // Deflate
+        Inflater inflater(file, entry.compressed_size, sink);
+        error = inflater.Run();
+        crc = inflater.GetCrc();
+        total = inflater.GetTotalOut();
+    }
+    else {
+        log_helper.AddLog("Unsupported compression method!\n", LogCategory::io, LogLevel::error);
+        error = true;
+    }
+    fclose(file);
+
+    if (!error && (crc != entry.crc || total != entry.size)) {
+        log_helper.AddLog("Archive member is corrupted (CRC mismatch)!\n", LogCategory::io, LogLevel::error);
+        error = true;
+    }
+    return error;
+}
+
+Inflater::Inflater(FILE* input, uint32_t input_size, const Archive::Sink& sink) : input(input), input_left(input_size), sink(sink) {}
+
+int Inflater::GetBits(int count) {
+    uint32_t val = bit_buff;
+    while (bit_count < count) {
+        if (in_pos == in_len) {
+            in_len = (input_left > 0) ? fread(&in_buff[0], 1, std::min<uint32_t>(input_left, sizeof(in_buff)), input) : 0;
+            in_pos = 0;
+            if (in_len == 0) {  // Ran out of input
+                error = true;
+                return 0;
+            }
+            input_left -= static_cast<uint32_t>(in_len);
+        }
+        val |= static_cast<uint32_t>(in_buff[in_pos++]) << bit_count;
+        bit_count += 8;
+    }
+    bit_buff = val >> count;
+    bit_count -= count;
+    return val & ((1 << count) - 1);
+}
+
+int Inflater::GetBit() {
+    return GetBits(1);
+}
+
+// Canonical Huffman decoding one bit at a time, ROMs are small enough that table lookups are not worth it
+int Inflater::Decode(const Huffman& table) {
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len < 16; ++len) {
+        code |= GetBit();
+        if (error) return -1;
+        int count = table.counts[len];
+        if (code - count < first) return table.symbols[index + (code - first)];
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+bool Inflater::BuildTable(Huffman& table, const uint8_t* lengths, int count) {
+    uint16_t offsets[16]{};
+    for (int len = 0; len < 16; ++len) table.counts[len] = 0;
+    for (int sym = 0; sym < count; ++sym) ++table.counts[lengths[sym]];
+
+    int left = 1;
+    for (int len = 1; len < 16; ++len) {
+        left <<= 1;
+        left -= table.counts[len];
+        if (left < 0) return true;  // Over-subscribed
+    }
+
+    for (int len = 1; len < 15; ++len) offsets[len + 1] = offsets[len] + table.counts[len];
+    for (int sym = 0; sym < count; ++sym) {
+        if (lengths[sym] != 0) table.symbols[offsets[lengths[sym]]++] = static_cast<uint16_t>(sym);
+    }
+    return false;
+}
+
+void Inflater::Put(uint8_t byte) {
+    window[window_pos++] = byte;
+    ++total_out;
+    if (window_pos == sizeof(window)) {
+        if (Flush()) error = true;
+        window_pos = 0;
+    }
+}
+
+bool Inflater::Flush() {
+    if (window_pos == 0) return false;
+    crc = Crc32(crc, &window[0], window_pos);
+    return sink(&window[0], window_pos);
+}
+
+bool Inflater::Stored() {
+    bit_buff = 0;  // Stored blocks start on a byte boundary
+    bit_count = 0;
+    uint16_t len = static_cast<uint16_t>(GetBits(16));
+    uint16_t nlen = static_cast<uint16_t>(GetBits(16));
+    if (error || len != static_cast<uint16_t>(~nlen)) return true;
+
+    while (len-- > 0 && !error) Put(static_cast<uint8_t>(GetBits(8)));
+    return error;
+}
+
+bool Inflater::Codes(const Huffman& lencode, const Huffman& distcode) {
+    static const uint16_t len_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                          35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const uint8_t len_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                          3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const uint16_t dist_base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                           257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    static const uint8_t dist_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                           7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+    int symbol;
+    do {
+        symbol = Decode(lencode);
+        if (symbol < 0) return true;
+
+        if (symbol < 256) Put(static_cast<uint8_t>(symbol));
+        else if (symbol > 256) {
+            symbol -= 257;
+            if (symbol >= 29) return true;
+            int len = len_base[symbol] + GetBits(len_extra[symbol]);
+
+            int dist_symbol = Decode(distcode);
+            if (dist_symbol < 0 || dist_symbol >= 30) return true;
+            uint32_t dist = dist_base[dist_symbol] + GetBits(dist_extra[dist_symbol]);
+            if (dist > total_out) return true;
+
+            while (len-- > 0) Put(window[(window_pos - dist) & (sizeof(window) - 1)]);
+        }
+        if (error) return true;
+    } while (symbol != 256);
+
+    return false;
+}
+
+bool Inflater::Fixed() {
+    struct FixedTables {
+        Huffman lencode, distcode;
+    };
+    static const FixedTables tables = [] {
+        FixedTables fixed;
+        uint8_t lengths[288];
+        int sym = 0;
+        for (; sym < 144; ++sym) lengths[sym] = 8;
+        for (; sym < 256; ++sym) lengths[sym] = 9;
+        for (; sym < 280; ++sym) lengths[sym] = 7;
+        for (; sym < 288; ++sym) lengths[sym] = 8;
+        BuildTable(fixed.lencode, &lengths[0], 288);
+
+        for (sym = 0; sym < 30; ++sym) lengths[sym] = 5;
+        BuildTable(fixed.distcode, &lengths[0], 30);
+        return fixed;
+    }();
+    return Codes(tables.lencode, tables.distcode);
+}
+
+bool Inflater::Dynamic() {
+    static const uint8_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    uint8_t lengths[320]{};
+
+    int nlen = GetBits(5) + 257;
+    int ndist = GetBits(5) + 1;
+    int ncode = GetBits(4) + 4;
+    if (error || nlen > 286 || ndist > 30) return true;
+
+    for (int i = 0; i < ncode; ++i) lengths[order[i]] = static_cast<uint8_t>(GetBits(3));
+    Huffman lencode, distcode;
+    if (BuildTable(lencode, &lengths[0], 19)) return true;
+
+    int index = 0;
+    while (index < nlen + ndist) {
+        int symbol = Decode(lencode);
+        if (symbol < 0) return true;
+        if (symbol < 16) {
+            lengths[index++] = static_cast<uint8_t>(symbol);
+            continue;
+        }
+
+        uint8_t len = 0;
+        int repeat;
+        if (symbol == 16) {
+            if (index == 0) return true;
+            len = lengths[index - 1];
+            repeat = 3 + GetBits(2);
+        }
+        else if (symbol == 17) repeat = 3 + GetBits(3);
+        else repeat = 11 + GetBits(7);
+
+        if (index + repeat > nlen + ndist) return true;
+        while (repeat-- > 0) lengths[index++] = len;
+    }
+    if (lengths[256] == 0) return true;  // No end of block code
+
+    if (BuildTable(lencode, &lengths[0], nlen)) return true;
+    if (BuildTable(distcode, &lengths[nlen], ndist)) return true;
+    return Codes(lencode, distcode);
+}
+
+bool Inflater::Run() {
+    int last;
+    do {
+        last = GetBit();
+        int type = GetBits(2);
+        if (error) return true;
+
+        switch (type) {
+        case 0:
+            error = Stored();
+            break;
+        case 1:
+            error = Fixed();
+            break;
+        case 2:
+            error = Dynamic();
+            break;
+        default:
+            error = true;
+        }
+    } while (!last && !error);
+
+    if (!error) error = Flush();
+    return error;
+}
+
+// Whole field or nothing, so a damaged index is noticed instead of half read
+static bool ParseField(const std::string& text, int base, uint64_t max, uint64_t& value) {
+    if (text.empty() || text[0] == '-' || text[0] == '+' || isspace(static_cast<unsigned char>(text[0]))) return true;
+    char* end = nullptr;
+    errno = 0;
+    value = strtoull(text.c_str(), &end, base);
+    return errno != 0 || *end != '\0' || value > max;
+}
+
+bool RomIndex::Load(const std::string& location) {
+    index_path = location;
+    archives.clear();
+
+    FILE* file = nullptr;
+    if (fopen_s(&file, location.c_str(), "r")) return true;  // No index yet
+
+    char line[0x400];
+    IndexedArchive* current = nullptr;
+    bool error = false;
+    while (!error && fgets(&line[0], sizeof(line), file)) {
+        std::string text(&line[0]);
+        while (!text.empty() && (text.back() == '\n' || text.back() == '\r')) text.pop_back();
+        if (text.empty()) continue;
+
+        // Every field but the last one is numeric, so names and paths can contain anything but tabs
+        std::vector<std::string> fields;
+        size_t start = 0, tab;
+        int numeric_fields = (text[0] == 'A') ? 3 : 6;
+        while (static_cast<int>(fields.size()) < numeric_fields && (tab = text.find('\t', start)) != std::string::npos) {
+            fields.push_back(text.substr(start, tab - start));
+            start = tab + 1;
+        }
+        fields.push_back(text.substr(start));
+
+        uint64_t values[5]{};
+        if (fields[0] == "A" && fields.size() == 4) {
+            error = ParseField(fields[1], 10, INT64_MAX, values[0]) || ParseField(fields[2], 10, INT64_MAX, values[1]);
+            if (error) break;
+            IndexedArchive& archive = archives[fields[3]];
+            archive.file_size = static_cast<int64_t>(values[0]);
+            archive.mod_time = static_cast<int64_t>(values[1]);
+            archive.entries.clear();
+            current = &archive;
+        }
+        else if (fields[0] == "E" && fields.size() == 7 && current) {
+            error = ParseField(fields[1], 10, UINT32_MAX, values[0]) || ParseField(fields[2], 16, UINT32_MAX, values[1]) ||
+                    ParseField(fields[3], 10, UINT32_MAX, values[2]) || ParseField(fields[4], 10, UINT32_MAX, values[3]) ||
+                    ParseField(fields[5], 10, UINT16_MAX, values[4]);
+            if (error) break;
+            ArchiveEntry entry;
+            entry.size = static_cast<uint32_t>(values[0]);
+            entry.crc = static_cast<uint32_t>(values[1]);
+            entry.compressed_size = static_cast<uint32_t>(values[2]);
+            entry.offset = static_cast<uint32_t>(values[3]);
+            entry.method = static_cast<uint16_t>(values[4]);
+            entry.name = fields[6];
+            current->entries.push_back(entry);
+        }
+    }
+
+    fclose(file);
+    dirty = false;
+    if (error) {  // Every archive gets scanned again and the index is rewritten on the next Save
+        archives.clear();
+        dirty = true;
+        log_helper.AddLog("Damaged ROM index " + location + ", discarding it\n", LogCategory::io, LogLevel::warning);
+        return true;
+    }
+    return false;
+}
+
+bool RomIndex::Save() {
+    if (!dirty || index_path.empty()) return false;
+
+    FILE* file = nullptr;
+    if (fopen_s(&file, index_path.c_str(), "w")) return true;
+
+    for (const auto& archive : archives) {
+        fprintf(file, "A\t%lld\t%lld\t%s\n", static_cast<long long>(archive.second.file_size),
+                static_cast<long long>(archive.second.mod_time), archive.first.c_str());
+        for (const ArchiveEntry& entry : archive.second.entries) {
+            fprintf(file, "E\t%u\t%08X\t%u\t%u\t%u\t%s\n", entry.size, entry.crc, entry.compressed_size,
+                    entry.offset, entry.method, entry.name.c_str());
+        }
+    }
+
+    fclose(file);
+    dirty = false;
+    return false;
+}
+
+const std::vector<ArchiveEntry>* RomIndex::GetEntries(const std::string& archive_path) {
+    struct stat info;
+    if (stat(archive_path.c_str(), &info) != 0) return nullptr;
+
+    auto it = archives.find(archive_path);
+    if (it != archives.end() && it->second.file_size == info.st_size && it->second.mod_time == info.st_mtime) {
+        return &it->second.entries;
+    }
+
+    IndexedArchive archive;
+    archive.file_size = info.st_size;
+    archive.mod_time = info.st_mtime;
+    if (Archive::ListEntries(archive_path, archive.entries)) return nullptr;
+
+    dirty = true;
+    IndexedArchive& stored = archives[archive_path];
+    stored = archive;
+    return &stored.entries;
+}
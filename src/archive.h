@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+
+uint32_t Crc32(uint32_t crc, const uint8_t* data, size_t size);
+
+struct ArchiveEntry {
+    std::string name{};
+    uint32_t size{};             // Uncompressed
+    uint32_t compressed_size{};
+    uint32_t crc{};
+    uint32_t offset{};           // Zip: local header offset, gzip: start of the deflate stream
+    uint16_t method{};           // 0 = stored, 8 = deflate
+};
+
+class Archive {
+public:
+    // Returns true for every chunk that could not be consumed, which aborts the extraction
+    typedef std::function<bool(const uint8_t* data, size_t size)> Sink;
+
+    static bool IsArchive(const std::string& path);
+    static bool IsNesFile(const std::string& name);
+    static bool ListEntries(const std::string& path, std::vector<ArchiveEntry>& entries);
+    static bool Extract(const std::string& path, const ArchiveEntry& entry, const Sink& sink);
+
+private:
+    static bool ListZip(FILE* file, std::vector<ArchiveEntry>& entries);
+    static bool ListGzip(FILE* file, const std::string& path, std::vector<ArchiveEntry>& entries);
+};
+
+// Streaming DEFLATE decoder, the output goes through a 32 KB window straight into the sink
+class Inflater {
+public:
+    Inflater(FILE* input, uint32_t input_size, const Archive::Sink& sink);
+    bool Run();
+    uint32_t GetCrc() { return crc; }
+    uint32_t GetTotalOut() { return total_out; }
+
+private:
+    struct Huffman {
+        uint16_t counts[16]{};
+        uint16_t symbols[288]{};
+    };
+
+    int GetBit();
+    int GetBits(int count);
+    int Decode(const Huffman& table);
+    static bool BuildTable(Huffman& table, const uint8_t* lengths, int count);
+    bool Stored();
+    bool Codes(const Huffman& lencode, const Huffman& distcode);
+    bool Fixed();
+    bool Dynamic();
+    void Put(uint8_t byte);
+    bool Flush();
+
+    FILE* input = nullptr;
+    uint32_t input_left{};
+    uint8_t in_buff[0x4000]{};
+    size_t in_pos{}, in_len{};
+    uint32_t bit_buff{};
+    int bit_count{};
+    bool error = false;
+
+    Archive::Sink sink;
+    uint8_t window[0x8000]{};
+    uint32_t window_pos{}, total_out{}, crc{};
+};
+
+// Remembers the contents of every archive it has seen so a large ROM set is only scanned once
+class RomIndex {
+public:
+    bool Load(const std::string& location);
+    bool Save();
+    const std::vector<ArchiveEntry>* GetEntries(const std::string& archive_path);
+
+private:
+    struct IndexedArchive {
+        int64_t file_size{};
+        int64_t mod_time{};
+        std::vector<ArchiveEntry> entries{};
+    };
+
+    std::string index_path = "";
+    std::map<std::string, IndexedArchive> archives{};
+    bool dirty = false;
+};
+
+extern RomIndex rom_index;
@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include <chrono>
+
+#include "archive.h"
+#include "batch_runner.h"
+#include "console.h"
+#include "table.h"
+#include "video_capture.h"
+#include "work_pool.h"
+
+
+bool BatchRunner::AddJobs(const std::string& location) {
+    std::vector<std::vector<std::string>> rows;
+    if (ReadTable(location, rows)) return true;
+
+    for (const std::vector<std::string>& fields : rows) {
+        Job job;
+        job.rom = ResolvePath(location, fields[0]);
+        if (fields.size() > 1) job.frames = strtoul(fields[1].c_str(), nullptr, 10);
+        if (fields.size() > 2 && fields[2] != "-") job.movie = ResolvePath(location, fields[2]);
+        if (fields.size() > 3 && fields[3] != "-") job.screenshot = ResolvePath(location, fields[3]);
+        if (fields.size() > 4 && fields[4] != "-") job.video = ResolvePath(location, fields[4]);
+        AddJob(job);
+    }
+    return false;
+}
+
+void BatchRunner::AddJob(const Job& job) {
+    jobs.push_back(job);
+    if (!job.movie.empty() && !movies.count(job.movie)) movies[job.movie].reset(nullptr);
+}
+
+void BatchRunner::Run(uint32_t threads) {
+    for (auto& movie : movies) {  // Before starting, so the workers only ever read them
+        if (movie.second) continue;
+        movie.second.reset(new Movie);
+        if (movie.second->Load(movie.first)) movie.second.reset();
+    }
+
+    results.assign(jobs.size(), Result());
+    ScreenshotWriter dumps(threads, true);
+    WorkPool pool(threads);
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        pool.Submit([this, i, &dumps]() {
+            const Movie* movie = jobs[i].movie.empty() ? nullptr : movies.at(jobs[i].movie).get();
+            results[i] = RunJob(jobs[i], movie, dumps);
+        });
+    }
+    pool.Wait();
+    dumps.Wait();
+    dump_errors = dumps.GetErrorCount();
+}
+
+BatchRunner::Result BatchRunner::RunJob(const Job& job, const Movie* movie, ScreenshotWriter& dumps) const {
+    Result result;
+    const auto start = std::chrono::steady_clock::now();
+
+    if (!job.movie.empty() && !movie) {
+        result.message = "Could not read the movie";
+        return result;
+    }
+    std::unique_ptr<Console> console(new Console);
+    console->memory.use_save_file = false;
+    if (console->LoadROM(job.rom, nullptr)) {
+        result.message = "Could not load the ROM";
+        return result;
+    }
+    console->cpu.block_cache_enabled = fast_paths;
+    console->cpu.dynarec_enabled = fast_paths;
+    console->cpu.idle_skip_enabled = fast_paths;
+    VideoCapture capture;
+    if (!job.video.empty() && capture.Start(job.video, console->ppu, true)) {
+        result.message = "Could not start the video";
+        return result;
+    }
+
+    for (; result.frames < job.frames; ++result.frames) {
+        if (movie && result.frames < movie->GetFrameCount()) {
+            const Movie::Frame& input = movie->GetFrame(result.frames);
+            if (input.power) console->Power();
+            else if (input.reset) console->Reset();
+            console->memory.controller[0] = input.controller[0];
+            console->memory.controller[1] = input.controller[1];
+        }
+        console->RunFrame();
+        capture.Push(console->ppu);
+        if (dump_interval && !job.screenshot.empty() && (result.frames + 1) % dump_interval == 0) {
+            dumps.Save(console->ppu, ScreenshotWriter::GetDumpName(job.screenshot, result.frames + 1));
+        }
+    }
+
+    result.error = false;
+    result.counters = console->memory.counters;
+    result.state_hash = console->GetStateHash();
+    result.frame_crc = Crc32(0, reinterpret_cast<const uint8_t*>(console->ppu.image_data->data()), sizeof(*console->ppu.image_data));
+    if (!job.screenshot.empty() && console->ppu.WriteScreenshot(job.screenshot)) {
+        result.error = true;
+        result.message = "Could not write the screenshot";
+    }
+    if (capture.Stop()) {
+        result.error = true;
+        result.message = "Could not write the video";
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+bool BatchRunner::WriteResults(FILE* file) const {
+    fprintf(file, "rom\tmovie\tframes\tstate\tframe_crc\tseconds\tscreenshot\tvideo\terror\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Job& job = jobs[i];
+        const Result& result = results[i];
+        fprintf(file, "%s\t%s\t%u\t%08X\t%08X\t%.3f\t%s\t%s\t%s\n", job.rom.c_str(), job.movie.empty() ? "-" : job.movie.c_str(), result.frames,
+                result.state_hash, result.frame_crc, result.seconds, job.screenshot.empty() ? "-" : job.screenshot.c_str(),
+                job.video.empty() ? "-" : job.video.c_str(), result.message.c_str());
+    }
+    return ferror(file) != 0;
+}
+
+bool BatchRunner::WriteCounters(FILE* file) const {
+    fprintf(file, "rom\tmovie");
+    for (int field = 0; field < Counters::FIELD_COUNT; ++field) fprintf(file, "\t%s", Counters::GetName(field));
+    fprintf(file, "\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        fprintf(file, "%s\t%s", jobs[i].rom.c_str(), jobs[i].movie.empty() ? "-" : jobs[i].movie.c_str());
+        for (uint64_t value : results[i].counters.values) fprintf(file, "\t%llu", static_cast<unsigned long long>(value));
+        fprintf(file, "\n");
+    }
+    return ferror(file) != 0;
+}
+
+uint32_t BatchRunner::GetErrorCount() const {
+    uint32_t errors = static_cast<uint32_t>(dump_errors);
+    for (const Result& result : results) errors += result.error;
+    return errors;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "counters.h"
+#include "movie.h"
+#include "screenshot_writer.h"
+
+
+// Runs many short headless jobs, each a ROM played from power-on for a number of frames with an optional
+// input movie. Every job gets its own Console, the jobs are spread over a work stealing pool.
+class BatchRunner {
+public:
+    struct Job {
+        std::string rom = "";
+        uint32_t frames{};
+        std::string movie = "";  // Empty for no input
+        std::string screenshot = "";  // PNG of the last frame, PPM for .ppm, empty for none
+        std::string video = "";  // Recording of the whole run, empty for none
+    };
+
+    struct Result {
+        bool error = true;
+        std::string message = "";
+        uint32_t frames{};
+        uint32_t state_hash{};
+        uint32_t frame_crc{};
+        double seconds{};
+        Counters counters{};  // Zero unless built with EZNES_COUNTERS
+    };
+
+    bool fast_paths = false;  // Run with the block cache, the recompiler and idle loop skipping
+    uint32_t dump_interval{};  // Jobs with a screenshot also save every interval-th frame next to it, 0 for none
+
+    bool AddJobs(const std::string& location);  // Tab separated: ROM, frames, movie, screenshot, video, the last three optional or -
+    void AddJob(const Job& job);
+    void Run(uint32_t threads);  // 0 uses every core
+    bool WriteResults(FILE* file) const;  // Tab separated table
+    bool WriteCounters(FILE* file) const;  // Tab separated, one row per job and a column per counter
+    uint32_t GetErrorCount() const;  // Failed jobs and dumped frames that could not be written
+    inline const std::vector<Result>& GetResults() const { return results; }  // In job order
+
+private:
+    Result RunJob(const Job& job, const Movie* movie, ScreenshotWriter& dumps) const;
+
+    std::vector<Job> jobs{};
+    std::vector<Result> results{};
+    uint64_t dump_errors{};
+    std::map<std::string, std::unique_ptr<Movie>> movies{};  // Loaded once and shared by every job playing them
+};
@@ -0,0 +1,99 @@
+#include <string.h>
+#include <algorithm>
+
+#include "block_cache.h"
+#include "trace.h"
+
+
+// Anything that can change the pc ends the block
+static bool EndsBlock(const uint8_t opcode) {
+    if (Disassembler::IsBranch(opcode)) return true;
+    switch (opcode) {
+    case 0x00: case 0x20: case 0x40: case 0x4C: case 0x60: case 0x6C:  // BRK, JSR, RTI, JMP, RTS, JMP (ind)
+        return true;
+    }
+    return !strcmp(Disassembler::GetMnemonic(opcode), "*JAM");
+}
+
+const BlockCache::Block* BlockCache::Find(Memory& memory, const uint16_t pc) {
+    const uint32_t phys = memory.GetPhysicalAddress(pc);
+    if (phys >= Memory::PHYS_SIZE || !memory.read_pages[pc >> 8]) return nullptr;  // I/O is never cached
+    if (block_index.empty()) {  // Only allocated once the cache is used
+        block_index.assign(Memory::PHYS_SIZE, -1);
+        blocks.reserve(MAX_BLOCKS);
+    }
+    if (block_index[phys] >= 0) return &blocks[block_index[phys]];
+
+    if (blocks.size() >= MAX_BLOCKS) Flush();
+    Block block;
+    block.phys = phys;
+
+    uint16_t addr = pc;
+    while (block.count < MAX_BLOCK_OPS) {
+        Op& op = block.ops[block.count];
+        op.opcode = memory.Peek(addr);
+        op.length = Disassembler::GetLength(op.opcode);
+        if ((addr & 0xFF) + op.length > 0x100) break;  // Crosses into the next page, that one is fetched normally
+        op.op_lo = memory.Peek(addr + 1);
+        op.op_hi = memory.Peek(addr + 2);
+        op.last_byte = op.length == 1 ? op.opcode : (op.length == 2 ? op.op_lo : op.op_hi);
+        ++block.count;
+        addr += op.length;
+
+        if (EndsBlock(op.opcode) || (addr & 0xFF) == 0) break;
+    }
+    if (block.count == 0) return nullptr;
+
+    memory.ProtectCodePage(phys >> 8);
+    block_index[phys] = static_cast<int32_t>(blocks.size());
+    blocks.push_back(block);
+    return &blocks.back();
+}
+
+void BlockCache::Sync(Memory& memory) {
+    if (map_generation != memory.map_generation) Flush();
+    else if (!block_index.empty()) {
+        for (uint32_t page = 0; page < memory.dirty_code_pages.size(); ++page) {
+            if (!memory.dirty_code_pages[page]) continue;
+            std::fill(block_index.begin() + (page << 8), block_index.begin() + ((page + 1) << 8), -1);
+        }
+    }
+    memory.dirty_code_pages.reset();
+    generation = memory.code_generation;
+    map_generation = memory.map_generation;
+}
+
+void BlockCache::Flush() {
+    std::fill(block_index.begin(), block_index.end(), -1);
+    blocks.clear();
+}
+
+DecodedRom::DecodedRom(const Memory& memory) : ops(Memory::PHYS_SIZE) {
+    std::vector<uint32_t> rom_pages;  // Physical pages decoded so far, mirrors are only done once
+    memcpy(&page_phys[0], &memory.page_phys[0x80], sizeof(page_phys));
+    for (uint32_t page = 0x80; page < 0x100; ++page) {
+        if (!memory.read_pages[page] || memory.write_pages[page]) continue;
+        const uint32_t phys_page = memory.page_phys[page] >> 8;
+        if (phys_page >= Memory::PHYS_SIZE >> 8 || std::count(rom_pages.begin(), rom_pages.end(), phys_page)) continue;
+        rom_pages.push_back(phys_page);
+        const bool next_is_rom = page < 0xFF && memory.read_pages[page + 1] && !memory.write_pages[page + 1];
+
+        for (uint32_t offset = 0; offset < 0x100; ++offset) {
+            const uint16_t addr = static_cast<uint16_t>((page << 8) | offset);
+            BlockCache::Op& op = ops[(phys_page << 8) | offset];
+            op.opcode = memory.Peek(addr);
+            op.length = Disassembler::GetLength(op.opcode);
+            if (offset + op.length > 0x100 && !next_is_rom) {  // Operands from RAM or I/O have to be read when executed
+                op = BlockCache::Op{};
+                continue;
+            }
+            op.op_lo = memory.Peek(addr + 1);
+            op.op_hi = memory.Peek(addr + 2);
+            op.last_byte = op.length == 1 ? op.opcode : (op.length == 2 ? op.op_lo : op.op_hi);
+        }
+    }
+}
+
+bool DecodedRom::Matches(const Memory& memory) const {
+    return !memcmp(&page_phys[0], &memory.page_phys[0x80], sizeof(page_phys));
+}
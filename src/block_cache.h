@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "memory.h"
+
+
+// Pre-decoded straight-line runs of instructions, keyed by the physical address of their first instruction.
+// A block never leaves its 256 byte page, so invalidating a page drops exactly the blocks decoded from it.
+class BlockCache {
+public:
+    static constexpr uint32_t MAX_BLOCK_OPS = 32;
+    static constexpr uint32_t MAX_BLOCKS = 0x2000;  // Everything is flushed once this many have been decoded
+
+    struct Op {
+        uint8_t opcode{}, op_lo{}, op_hi{};
+        uint8_t length{};
+        uint8_t last_byte{};  // Left on the data bus by the fetch
+    };
+
+    struct Block {
+        uint32_t phys{};
+        uint8_t count{};
+        Op ops[MAX_BLOCK_OPS];
+    };
+
+    const Block* Find(Memory& memory, uint16_t pc);  // Decodes on a miss, null when the code can not be cached
+    inline bool IsStale(const Memory& memory) const { return generation != memory.code_generation; }
+    void Sync(Memory& memory);  // Drops the blocks Memory reported as modified or unmapped
+    void Flush();
+
+private:
+    std::vector<int32_t> block_index{};  // Physical address to index in blocks, -1 when not decoded
+    std::vector<Block> blocks{};
+    uint32_t generation{}, map_generation{};
+};
+
+// Every possible instruction of the cartridge ROM decoded up front, by physical address. It is read only once
+// built, so consoles running the same game can all share one. Instructions running into the next page took their
+// operands from whatever was mapped there, so it only holds while the ROM is mapped the way it was decoded.
+class DecodedRom {
+public:
+    explicit DecodedRom(const Memory& memory);
+    inline const BlockCache::Op& Get(uint32_t phys) const { return ops[phys]; }  // Length 0 when not ROM
+    bool Matches(const Memory& memory) const;  // Whether $8000-$FFFF is mapped as when it was decoded
+
+private:
+    std::vector<BlockCache::Op> ops{};
+    uint32_t page_phys[0x80]{};  // Of $8000-$FFFF when it was decoded
+};
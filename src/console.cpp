@@ -0,0 +1,176 @@
+#include "console.h"
+
+
+Console::Console() {
+    cpu.memory = &memory;
+    ppu.memory = &memory;
+    memory.ppu = &ppu;
+}
+
+bool Console::LoadROM(const std::string& location, const ArchiveEntry* entry) {
+    memory.rom_path = location;
+    bool error = entry ? memory.LoadROM(location, *entry) : memory.LoadROM(location);
+    if (!error && !memory.SetupMapper()) {
+        Power();
+        return false;
+    }
+    log_helper.AddLog(error ? "Invalid ROM file!\n" : "Unsupported mapper!\n", LogCategory::memory, LogLevel::error);
+    memory.rom_path = "";
+    return true;
+}
+
+bool Console::LoadROM(const Console& other) {
+    memory.rom_path = other.memory.rom_path;
+    if (memory.LoadROM(other.memory) || memory.SetupMapper()) {
+        log_helper.AddLog("No ROM to share!\n", LogCategory::memory, LogLevel::error);
+        memory.rom_path = "";
+        return true;
+    }
+    Power();
+    return false;
+}
+
+void Console::Power() {
+    cpu.Power();  // The CPU does some weird stuff on reset, so I just set it to power-on instead
+    ppu.Reset();
+    clock_count = 0;
+}
+
+void Console::Reset() {
+    cpu.Reset();
+    clock_count = 0;
+}
+
+void Console::Clock() {
+    ppu.Run();
+    if (clock_count == 2) {  // TODO: Maybe i have to use the returned cpu cycles
+        if (cpu.dynarec_enabled) RunCompiled();
+        else cpu.Run();
+        clock_count = -1;
+        if (cpu.idle_ready) SkipIdleLoop();
+    }
+    if (ppu.nmi) {
+        ppu.nmi = false;
+        cpu.NMI();
+    }
+
+    ++clock_count;
+}
+
+void Console::Step() {
+    const uint64_t start = cpu.instruction_count;
+    while (cpu.instruction_count == start) Clock();
+}
+
+void Console::RunFrame() {
+    EZNES_TIME(memory.counters, Counters::frame_time);
+    while (!ppu.frame_done) Clock();
+    ppu.frame_done = false;
+    memory.EndFrame();
+}
+
+void Console::SaveState(std::vector<uint8_t>& data) const {
+    StateWriter state(data);
+    SaveState(state);
+}
+
+void Console::SaveState(uint8_t* data, size_t size) const {
+    StateWriter state(data, size);
+    SaveState(state);
+}
+
+void Console::SaveState(StateWriter& state) const {
+    const uint32_t header[2] = {STATE_MAGIC, STATE_VERSION};
+    state.Write(header);
+    state.Write(clock_count);
+    cpu.SaveState(state);
+    ppu.SaveState(state);
+    memory.SaveState(state);
+}
+
+bool Console::LoadState(const uint8_t* data, size_t size) {
+    EZNES_TIME(memory.counters, Counters::load_state_time);
+    StateReader state(data, size);
+    uint32_t magic{}, version{};
+    if (size != GetStateSize() || state.Read(magic) || state.Read(version) || magic != STATE_MAGIC || version != STATE_VERSION) {
+        log_helper.AddLog("Not a save state of this version!\n", LogCategory::general, LogLevel::error);
+        return true;
+    }
+    // The size matched, so the only thing left that can fail is a damaged value. Those are all looked at
+    // before anything is loaded, a rejected state leaves the console as it was.
+    StateReader check = state;
+    if (check.Skip(sizeof(clock_count)) || cpu.CheckState(check) || ppu.CheckState(check) || memory.CheckState(check) || !check.AtEnd()) {
+        log_helper.AddLog("Save state is damaged!\n", LogCategory::general, LogLevel::error);
+        return true;
+    }
+    state.Read(clock_count);
+    cpu.LoadState(state);
+    ppu.LoadState(state);
+    memory.LoadState(state);
+    return false;
+}
+
+// Every field has a fixed size whatever the ROM, so one measurement holds for all consoles
+size_t Console::GetStateSize() const {
+    static const size_t size = [this]() {
+        std::vector<uint8_t> data;
+        SaveState(data);
+        return data.size();
+    }();
+    return size;
+}
+
+uint32_t Console::GetStateHash() {
+    const uint8_t registers[] = {cpu.A, cpu.X, cpu.Y, static_cast<uint8_t>(cpu.flags.to_ulong()), cpu.sp,
+                                 static_cast<uint8_t>(cpu.pc), static_cast<uint8_t>(cpu.pc >> 8)};
+    const uint64_t counters[] = {cpu.cycles, static_cast<uint64_t>(ppu.GetScanline()), static_cast<uint64_t>(ppu.GetCycle())};
+    uint32_t crc = Crc32(0, &registers[0], sizeof(registers));
+    crc = Crc32(crc, reinterpret_cast<const uint8_t*>(&counters[0]), sizeof(counters));
+    crc = Crc32(crc, memory.GetRam(), Memory::RAM_SIZE);
+    crc = Crc32(crc, memory.GetPrgRam(), Memory::PRG_RAM_SIZE);
+    return Crc32(crc, ppu.ppu_memory.data(), ppu.ppu_memory.size());
+}
+
+// A compiled block runs all of its instructions at once, the PPU catches up with the ticks they would have taken afterwards.
+// The block can not touch I/O, so this is only visible through the NMI and the other PPU events, which it never runs into.
+void Console::RunCompiled() {
+    constexpr uint32_t margin = 4;  // Same as for idle loop skipping
+    const uint32_t ticks_left = ppu.TicksUntilEvent();
+    const uint32_t limit = (ppu.nmi || ticks_left < margin) ? 1 : (ticks_left - margin) / 3;
+    const uint32_t executed = cpu.RunCompiled(limit);
+    for (uint32_t tick = 3; tick < executed * 3; ++tick) ppu.Run();
+}
+
+// Fast-forwards whole iterations of the polling loop the CPU just went around, stopping short of the next PPU event.
+// The PPU still runs every tick, only the CPU work is skipped.
+void Console::SkipIdleLoop() {
+    constexpr uint32_t margin = 4;  // The dot skipped at the start of a frame makes the event estimate one tick late
+    cpu.idle_ready = false;
+    const uint32_t iteration_ticks = cpu.idle_instructions * 3;  // Clock runs an instruction every third tick
+    const uint32_t ticks_left = ppu.TicksUntilEvent();
+    if (iteration_ticks == 0 || ticks_left < iteration_ticks + margin) return;
+    if (ppu.nmi || ppu.TicksSinceEvent() < 2 * iteration_ticks) return;  // Both compared iterations must have seen the same PPU state
+    const uint32_t iterations = (ticks_left - margin) / iteration_ticks;
+    const uint32_t ticks = iterations * iteration_ticks;
+
+    if (cpu.idle_skip_verify) {  // Take the accurate path and check that it ends up where the skip would have
+        const uint16_t pc = cpu.pc;
+        const uint8_t A = cpu.A, X = cpu.X, Y = cpu.Y, sp = cpu.sp;
+        const unsigned long P = cpu.flags.to_ulong();
+        const uint64_t cycles = cpu.cycles + static_cast<uint64_t>(cpu.idle_cycles) * iterations;
+
+        for (uint32_t tick = 0; tick < ticks; ++tick) {
+            ppu.Run();
+            if (tick % 3 == 2) cpu.Run();
+        }
+        cpu.idle_ready = false;
+
+        if (cpu.pc != pc || cpu.A != A || cpu.X != X || cpu.Y != Y || cpu.sp != sp || cpu.flags.to_ulong() != P || cpu.cycles != cycles) {
+            log_helper.Log(LogCategory::cpu, LogLevel::warning, "\nIdle loop skip mismatch at 0x%04X after %u iterations", pc, iterations);
+        }
+        return;
+    }
+
+    for (uint32_t tick = 0; tick < ticks; ++tick) ppu.Run();
+    cpu.SkipIdleIterations(iterations);
+}
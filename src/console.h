@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "archive.h"
+#include "cpu.h"
+#include "memory.h"
+#include "ppu.h"
+
+
+// One NES: the components wired to each other and the scheduler that interleaves them.
+// Everything is per instance, so more than one can run in the same process.
+class Console {
+public:
+    static constexpr uint32_t STATE_MAGIC = 0x5453455A;  // "EZST"
+    static constexpr uint32_t STATE_VERSION = 2;
+
+    Memory memory{};
+    Ppu ppu{};
+    Cpu cpu{};
+
+    Console();
+    Console(const Console&) = delete;
+    Console& operator=(const Console&) = delete;
+
+    bool LoadROM(const std::string& location, const ArchiveEntry* entry);  // Also powers the console on
+    bool LoadROM(const Console& other);  // Shares the ROM another console has loaded instead of reading it again
+    void Power();
+    void Reset();  // The reset button
+    void Clock();
+    void Step();  // Clocks until the CPU has run at least one more instruction
+    void RunFrame();
+    uint32_t GetStateHash();  // CRC32 of the CPU registers, RAM, PRG-RAM, PPU memory and the PPU position
+    void SaveState(std::vector<uint8_t>& data) const;  // Appends to data
+    void SaveState(uint8_t* data, size_t size) const;  // Straight into a buffer of at least GetStateSize bytes
+    bool LoadState(const uint8_t* data, size_t size);  // Only states of the same ROM, a wrong size or version is rejected before anything changes
+    size_t GetStateSize() const;  // The same for every console and ROM
+
+private:
+    void SaveState(StateWriter& state) const;
+    void RunCompiled();
+    void SkipIdleLoop();
+
+    int8_t clock_count{};
+};
@@ -0,0 +1,53 @@
+#include <algorithm>
+
+#include "console_batch.h"
+
+
+ConsoleBatch::ConsoleBatch(uint32_t threads) : pool(threads) {}
+
+// The first console reads the ROM, the others share it and everything decoded from it
+bool ConsoleBatch::Load(const std::string& location, const ArchiveEntry* entry, uint32_t count) {
+    consoles.clear();
+    decoded_rom.reset();
+    power_state.clear();
+    for (uint32_t i = 0; i < count; ++i) {
+        std::unique_ptr<Console> console(new Console);
+        console->memory.use_save_file = false;  // They would all share one battery
+        if (i == 0 ? console->LoadROM(location, entry) : console->LoadROM(*consoles[0])) {
+            consoles.clear();
+            return true;
+        }
+        if (i == 0) {
+            decoded_rom.reset(new DecodedRom(console->memory));
+            console->SaveState(power_state);
+        }
+        console->cpu.SetDecodedRom(decoded_rom.get());
+        consoles.push_back(std::move(console));
+    }
+    return false;
+}
+
+void ConsoleBatch::Step(const uint8_t* actions) {
+    for (uint32_t first = 0; first < GetCount(); first += CHUNK_SIZE) {
+        const uint32_t last = std::min(first + CHUNK_SIZE, GetCount());
+        pool.Submit([this, first, last, actions]() { RunFrames(first, last, actions); });
+    }
+    pool.Wait();
+}
+
+void ConsoleBatch::RunFrames(uint32_t first, uint32_t last, const uint8_t* actions) {
+    for (uint32_t i = first; i < last; ++i) {
+        Console& console = *consoles[i];
+        console.memory.controller[0] = actions[i];
+        console.RunFrame();
+    }
+}
+
+// Loading the power-on state keeps the ROM and everything decoded from it, only what the game can write is replaced
+bool ConsoleBatch::Reset(uint32_t index) {
+    if (index >= GetCount()) {
+        log_helper.AddLog("Console index out of range\n", LogCategory::general, LogLevel::error);
+        return true;
+    }
+    return consoles[index]->LoadState(power_state.data(), power_state.size());
+}
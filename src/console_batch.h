@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "archive.h"
+#include "block_cache.h"
+#include "console.h"
+#include "work_pool.h"
+
+
+// Many consoles running the same game in step, for feeding agents or searching over inputs. The ROM is read
+// and pre-decoded once and shared, each Step runs one frame on every console, spread over a work pool.
+class ConsoleBatch {
+public:
+    static constexpr uint32_t CHUNK_SIZE = 4;  // Consoles per task, enough to keep the pool overhead small
+
+    explicit ConsoleBatch(uint32_t threads);  // 0 uses every core
+
+    bool Load(const std::string& location, const ArchiveEntry* entry, uint32_t count);
+    void Step(const uint8_t* actions);  // One controller byte per console, in the bit order of Memory::controller
+    bool Reset(uint32_t index);  // Starts one console over from power-on, e.g. when its episode is over
+    inline uint32_t GetCount() const { return static_cast<uint32_t>(consoles.size()); }
+    inline Console& GetConsole(uint32_t index) { return *consoles[index]; }
+    inline const uint32_t* GetFrame(uint32_t index) const { return &(*consoles[index]->ppu.image_data)[0][0]; }  // 256x240 RGBA
+
+private:
+    void RunFrames(uint32_t first, uint32_t last, const uint8_t* actions);
+
+    WorkPool pool;
+    std::unique_ptr<DecodedRom> decoded_rom{};
+    std::vector<uint8_t> power_state{};  // Taken right after loading, Reset goes back to it
+    std::vector<std::unique_ptr<Console>> consoles{};
+};
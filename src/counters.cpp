@@ -0,0 +1,14 @@
+#include "counters.h"
+
+
+const char* Counters::GetName(int field) {
+    static const char* const names[FIELD_COUNT] = {
+        "cpu_read_ram", "cpu_read_ppu_registers", "cpu_read_io", "cpu_read_expansion", "cpu_read_prg_ram", "cpu_read_prg_rom",
+        "cpu_write_ram", "cpu_write_ppu_registers", "cpu_write_io", "cpu_write_expansion", "cpu_write_prg_ram", "cpu_write_prg_rom",
+        "ppu_read_pattern", "ppu_read_nametable", "ppu_read_palette",
+        "ppu_write_pattern", "ppu_write_nametable", "ppu_write_palette",
+        "ppuctrl_writes", "ppumask_writes", "ppustatus_writes", "oamaddr_writes", "oamdata_writes", "ppuscroll_writes", "ppuaddr_writes", "ppudata_writes",
+        "nmi", "irq", "remap", "frame_ns", "load_state_ns", "viewer_ns"
+    };
+    return field >= 0 && field < FIELD_COUNT ? names[field] : "unknown";
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+
+
+// Event counts from the hot paths of one console. They are only taken in builds with EZNES_COUNTERS defined,
+// the Debug configurations do. Without it EZNES_COUNT expands to nothing, so release builds pay nothing and
+// the values stay at zero. Accesses the block cache and the recompiler make without Memory::Read and
+// Memory::Write are not counted, and neither are the debug viewers' reads of PPU memory. The renderer's
+// nametable fetches are, through Memory::NametableRead.
+// EZNES_TIME adds the nanoseconds until the end of the enclosing scope to a field, one per scope. A clock read
+// costs about as much as a few instructions, so it only goes around whole calls and never single accesses.
+#ifdef EZNES_COUNTERS
+#define EZNES_COUNT(counters, field) (++(counters).values[field])
+#define EZNES_TIME(counters, field) Counters::ScopedTimer scoped_timer((counters).values[field])
+#else
+#define EZNES_COUNT(counters, field) ((void)0)
+#define EZNES_TIME(counters, field) ((void)0)
+#endif
+
+struct Counters {
+#ifdef EZNES_COUNTERS
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+
+    // CPU accesses come in six regions and PPU accesses in three, the fields of a group follow each other
+    enum Field {
+        cpu_read = 0,
+        cpu_write = cpu_read + 6,
+        ppu_read = cpu_write + 6,
+        ppu_write = ppu_read + 3,
+        register_write = ppu_write + 3,  // $2000-$2007, one each
+        nmi = register_write + 8,
+        irq,  // Only the ones taken
+        remap,  // Page table rebuilds, where bank switches and mirroring changes end up
+        frame_time,  // Nanoseconds in Console::RunFrame
+        load_state_time,  // Nanoseconds in Console::LoadState
+        viewer_time,  // Nanoseconds redrawing the pattern table and nametable viewers
+        FIELD_COUNT
+    };
+
+    uint64_t values[FIELD_COUNT]{};
+
+    inline void Reset() { memset(&values[0], 0, sizeof(values)); }
+    // RAM, PPU registers, APU and I/O, expansion, PRG-RAM, PRG-ROM
+    static inline int GetCpuRegion(uint16_t addr) {
+        return addr < 0x2000 ? 0 : addr < 0x4000 ? 1 : addr < 0x4020 ? 2 : addr < 0x6000 ? 3 : addr < 0x8000 ? 4 : 5;
+    }
+    static inline int GetPpuRegion(uint16_t addr) {  // Pattern tables, nametables, palette
+        addr &= 0x3FFF;
+        return addr < 0x2000 ? 0 : addr < 0x3F00 ? 1 : 2;
+    }
+    static const char* GetName(int field);
+
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(uint64_t& total) : total(total), start(std::chrono::steady_clock::now()) {}
+        ~ScopedTimer() { total += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(); }
+
+    private:
+        uint64_t& total;
+        std::chrono::steady_clock::time_point start;
+    };
+};
@@ -1,12 +1,240 @@
+#include <string.h>
+
 #include "cpu.h"
+#include "ppu.h"
 
 
 void Cpu::Run() {
-    instr = memory->Read(pc);
-    Interpreter(instr);
+    const uint16_t instr_pc = pc;
+    Fetch();
+    if (trace_enabled) Trace();
+    if (profiler) {
+        const uint32_t phys = memory->GetPhysicalAddress(pc);
+        const uint64_t start_cycles = cycles;
+        Interpreter(instr);
+        profiler->Record(instr_pc, phys, instr, static_cast<uint32_t>(cycles - start_cycles));
+    }
+    else Interpreter(instr);
+    ++instruction_count;
+
+    if (idle_skip_enabled) {
+        idle_ready = false;
+        if (pc < instr_pc) CheckIdleLoop(instr_pc);
+    }
     // flags[Flags::unused] = true;
 }
 
+// Runs the compiled block at pc if it is no longer than max_instructions, otherwise a single instruction.
+// Returns how many instructions were executed.
+uint32_t Cpu::RunCompiled(const uint32_t max_instructions) {
+    const Dynarec::Block* block = nullptr;
+    if (!trace_enabled && !profiler && max_instructions > 1) block = dynarec.Find(*memory, pc, cycle_lut);
+    if (!block || !block->code || block->instructions > max_instructions) {
+        Run();
+        return 1;
+    }
+
+    uint8_t ram_before[Memory::RAM_SIZE];
+    if (dynarec_verify) memcpy(&ram_before[0], memory->GetRam(), Memory::RAM_SIZE);
+
+    DynState state{};
+    state.A = A;
+    state.X = X;
+    state.Y = Y;
+    state.P = static_cast<uint8_t>(flags.to_ulong());
+    state.sp = sp;
+    state.pc = pc;
+    state.cycles = cycles;
+    block->code(&state);
+    if (state.instructions == 0) {  // Left right away, the first instruction needs the slow path
+        Run();
+        return 1;
+    }
+
+    if (dynarec_verify) {
+        VerifyCompiled(state, &ram_before[0]);
+        return state.instructions;
+    }
+
+    A = state.A;
+    X = state.X;
+    Y = state.Y;
+    flags = state.P;
+    sp = state.sp;
+    pc = state.pc;
+    cycles = state.cycles;
+    instruction_count += state.instructions;
+    idle_ready = false;
+    return state.instructions;
+}
+
+// Rewinds RAM to before the block and interprets the same instructions, the interpreter's result is kept
+void Cpu::VerifyCompiled(const DynState& state, const uint8_t* ram_before) {
+    uint8_t ram_after[Memory::RAM_SIZE];
+    uint8_t* ram = memory->GetRam();
+    memcpy(&ram_after[0], ram, Memory::RAM_SIZE);
+    memcpy(ram, ram_before, Memory::RAM_SIZE);
+    const uint8_t bus_after = memory->open_bus;
+
+    const uint16_t start_pc = pc;
+    for (uint32_t i = 0; i < state.instructions; ++i) Run();
+
+    if (A != state.A || X != state.X || Y != state.Y || flags.to_ulong() != state.P || sp != state.sp || pc != state.pc ||
+        cycles != state.cycles || memory->open_bus != bus_after || memcmp(&ram_after[0], ram, Memory::RAM_SIZE)) {
+        log_helper.Log(LogCategory::cpu, LogLevel::warning, "\nRecompiled block at 0x%04X differs from the interpreter after %u instructions",
+                       start_pc, state.instructions);
+    }
+}
+
+// Loads instr and its operands, straight out of a decoded block when the cache is on
+inline void Cpu::Fetch() {
+    if (block_cache_enabled) {
+        if (block_cache.IsStale(*memory)) {
+            block_cache.Sync(*memory);
+            current_block = nullptr;
+        }
+        if (!current_block || block_pos >= current_block->count || pc != block_next_pc) {
+            current_block = block_cache.Find(*memory, pc);
+            block_pos = 0;
+        }
+        if (current_block) {
+            const BlockCache::Op& op = current_block->ops[block_pos++];
+            instr = op.opcode;
+            op_lo = op.op_lo;
+            op_hi = op.op_hi;
+            block_next_pc = pc + op.length;
+            memory->open_bus = op.last_byte;
+            return;
+        }
+    }
+
+    else if (decoded_rom && DecodedRomMatches()) {
+        const BlockCache::Op& op = decoded_rom->Get(memory->GetPhysicalAddress(pc));
+        if (op.length) {
+            instr = op.opcode;
+            op_lo = op.op_lo;
+            op_hi = op.op_hi;
+            memory->open_bus = op.last_byte;
+            return;
+        }
+    }
+
+    instr = memory->Read(pc);
+    const uint8_t length = Disassembler::GetLength(instr);
+    if (length > 1) op_lo = memory->Read(pc + 1);
+    if (length > 2) op_hi = memory->Read(pc + 2);
+}
+
+void Cpu::SetDecodedRom(const DecodedRom* rom) {
+    decoded_rom = rom;
+    if (rom) decoded_rom_matches = rom->Matches(*memory);
+    decoded_rom_generation = memory->map_generation;
+}
+
+// Only looked at again when the page table was rebuilt, e.g. after a bank switch
+inline bool Cpu::DecodedRomMatches() {
+    if (memory->map_generation != decoded_rom_generation) {
+        decoded_rom_matches = decoded_rom->Matches(*memory);
+        decoded_rom_generation = memory->map_generation;
+    }
+    return decoded_rom_matches;
+}
+
+inline void Cpu::Trace() {
+    TraceEntry& entry = trace.Next();
+    entry.cycle = cycles;
+    entry.pc = pc;
+    entry.opcode = instr;
+    entry.operand_lo = op_lo;
+    entry.operand_hi = op_hi;
+    entry.A = A;
+    entry.X = X;
+    entry.Y = Y;
+    entry.P = static_cast<uint8_t>(flags.to_ulong());
+    entry.sp = sp;
+    entry.scanline = memory->ppu->GetScanline();
+    entry.dot = memory->ppu->GetCycle();
+}
+
+// Called when the pc went backwards. A loop is idle once two passes through its branch see the same
+// registers with no interrupt in between: its body neither writes memory nor reads anything that can
+// change before the next PPU event, so every further iteration would be exactly the same.
+void Cpu::CheckIdleLoop(const uint16_t branch_pc) {
+    if (!(Disassembler::IsBranch(instr) || instr == 0x4C) || branch_pc - pc > 0x20) {
+        idle_loop.branch_pc = -1;
+        return;
+    }
+
+    const uint8_t P = static_cast<uint8_t>(flags.to_ulong());
+    if (idle_loop.branch_pc != branch_pc) {
+        idle_loop.branch_pc = branch_pc;
+        idle_loop.valid = AnalyzeIdleLoop(pc, branch_pc);
+    }
+    else if (idle_loop.valid && idle_loop.interrupt_count == interrupt_count && idle_loop.A == A && idle_loop.X == X &&
+             idle_loop.Y == Y && idle_loop.P == P && idle_loop.sp == sp) {
+        idle_instructions = static_cast<uint32_t>(instruction_count - idle_loop.instruction_count);
+        idle_cycles = static_cast<uint32_t>(cycles - idle_loop.cycles);
+        idle_ready = true;
+    }
+
+    idle_loop.A = A;
+    idle_loop.X = X;
+    idle_loop.Y = Y;
+    idle_loop.P = P;
+    idle_loop.sp = sp;
+    idle_loop.interrupt_count = interrupt_count;
+    idle_loop.instruction_count = instruction_count;
+    idle_loop.cycles = cycles;
+}
+
+// Only reads of RAM, cartridge memory and PPUSTATUS are allowed. Reading PPUSTATUS again has no
+// further effect until vblank changes, which the scheduler never skips past.
+bool Cpu::AnalyzeIdleLoop(const uint16_t start, const uint16_t end) {
+    typedef Disassembler::Mode Mode;
+    auto safe_read = [](uint16_t addr) { return addr < 0x2000 || (addr & 0xE007) == 0x2002 || addr >= 0x6000; };
+
+    for (uint16_t addr = start; addr <= end; addr += Disassembler::GetLength(memory->Peek(addr))) {
+        const uint8_t opcode = memory->Peek(addr);
+        const uint16_t operand = (memory->Peek(addr + 2) << 8) | memory->Peek(addr + 1);
+        if (Disassembler::WritesMemory(opcode)) return false;
+
+        switch (Disassembler::GetMode(opcode)) {
+        case Mode::implied:
+            switch (opcode) {
+            case 0x28: case 0x40: case 0x60: case 0x68:  // PLP, RTI, RTS, PLA
+                return false;
+            }
+            if (cycle_lut[opcode] == 0) return false;  // JAM
+            break;
+        case Mode::accumulator:
+        case Mode::immediate:
+        case Mode::relative:
+        case Mode::zero_page:
+        case Mode::zero_page_x:
+        case Mode::zero_page_y:
+            break;
+        case Mode::absolute:
+            if (opcode == 0x4C && addr != end) return false;  // Only the closing jump
+            if (opcode != 0x4C && !safe_read(operand)) return false;
+            break;
+        case Mode::absolute_x:
+        case Mode::absolute_y:
+            if (!((operand < 0x2000 && operand + 0xFF < 0x2000) || operand >= 0x6000)) return false;
+            break;
+        default:  // Pointers could lead anywhere
+            return false;
+        }
+    }
+    return true;
+}
+
+void Cpu::SkipIdleIterations(const uint32_t iterations) {
+    cycles += static_cast<uint64_t>(idle_cycles) * iterations;
+    instruction_count += static_cast<uint64_t>(idle_instructions) * iterations;
+    idle_loop.cycles = cycles;
+    idle_loop.instruction_count = instruction_count;
+}
+
 void Cpu::Power() {
     pc = (memory->Read(0xFFFD) << 8) | memory->Read(0xFFFC);
     A = X = Y = 0;
@@ -14,6 +242,46 @@ void Cpu::Power() {
     flags = 0b00110100;
     cycles = 0;
     cycles += 7;
+    instruction_count = 0;
+    current_block = nullptr;
+    idle_loop = IdleLoop{};
+    idle_ready = false;
+}
+
+void Cpu::SaveState(StateWriter& state) const {
+    state.Write(A);
+    state.Write(X);
+    state.Write(Y);
+    state.Write(sp);
+    state.Write(pc);
+    state.Write(static_cast<uint8_t>(flags.to_ulong()));
+    state.Write(cycles);
+    state.Write(instruction_count);
+    state.Write(interrupt_count);
+}
+
+bool Cpu::LoadState(StateReader& state) {
+    uint8_t P{};
+    state.Read(A);
+    state.Read(X);
+    state.Read(Y);
+    state.Read(sp);
+    state.Read(pc);
+    state.Read(P);
+    state.Read(cycles);
+    state.Read(instruction_count);
+    state.Read(interrupt_count);
+    flags = P;
+    current_block = nullptr;
+    idle_loop = IdleLoop{};
+    idle_ready = false;
+    return state.HasError();
+}
+
+bool Cpu::CheckState(StateReader& state) const {
+    state.Skip(sizeof(A) + sizeof(X) + sizeof(Y) + sizeof(sp) + sizeof(pc) + sizeof(uint8_t) + sizeof(cycles) +
+               sizeof(instruction_count) + sizeof(interrupt_count));
+    return state.HasError();
 }
 
 void Cpu::Reset() {
@@ -30,11 +298,16 @@ void Cpu::Reset() {
 
     cycles = 0;
     cycles += 7;
+    current_block = nullptr;
+    idle_loop = IdleLoop{};
+    idle_ready = false;
 }
 
 void Cpu::IRQ() {
     if (!flags[Flags::interrupt]) {
         // log_helper.AddLog("IRQ\n");
+        ++interrupt_count;
+        EZNES_COUNT(memory->counters, Counters::irq);
         memory->Write(sp + 0x100, pc >> 8);
         --sp;
         memory->Write(sp + 0x100, pc & 0xFF);
@@ -53,6 +326,8 @@ void Cpu::IRQ() {
 
 void Cpu::NMI() {
     // log_helper.AddLog("NMI\n");
+    ++interrupt_count;
+    EZNES_COUNT(memory->counters, Counters::nmi);
     memory->Write(sp + 0x100, pc >> 8);
     --sp;
     memory->Write(sp + 0x100, pc & 0xFF);
@@ -69,7 +344,33 @@ void Cpu::NMI() {
 }
 
 inline uint16_t Cpu::GetImmediateAddress() {
-    return (memory->Read(pc + 2) << 8) | memory->Read(pc + 1);
+    return (op_hi << 8) | op_lo;
+}
+
+inline uint16_t Cpu::GetZeroPageIndexedAddress(const uint8_t index) {
+    return (op_lo + index) % 256;
+}
+
+inline uint16_t Cpu::GetAbsoluteIndexedAddress(const uint8_t index, const bool page_penalty) {
+    uint16_t abs = GetImmediateAddress();
+    uint16_t abs_index = abs + index;
+    if (page_penalty) cycles += ((abs & 0xFF00) != (abs_index & 0xFF00));
+    return abs_index;
+}
+
+inline uint16_t Cpu::GetIndexedIndirectAddress() {  // (zpg,X)
+    uint8_t zpg_addr = op_lo + X;
+    uint8_t low = memory->Read(zpg_addr);
+    return (memory->Read((zpg_addr + 1) % 256) << 8) | low;
+}
+
+inline uint16_t Cpu::GetIndirectIndexedAddress(const bool page_penalty) {  // (zpg),Y
+    uint8_t zpg_addr = op_lo;
+    uint8_t low = memory->Read(zpg_addr);
+    uint16_t base = (memory->Read((zpg_addr + 1) % 256) << 8) | low;
+    uint16_t addr = base + Y;
+    if (page_penalty) cycles += ((base & 0xFF00) != (addr & 0xFF00));
+    return addr;
 }
 
 inline void Cpu::Push(const uint8_t byte) {
@@ -128,45 +429,110 @@ void Cpu::RotateRightWithFlags(const uint16_t addr) {
     pc += 1;
 }
 
-void Cpu::AddMemToAccWithCarry(const uint16_t addr) {
-    uint8_t val = memory->Read(addr);
+void Cpu::AddToAccWithCarry(const uint8_t val) {
     uint16_t result = A + val + flags[Flags::carry];
     flags[Flags::overflow] = (((A ^ result) & (val ^ result)) & 0x80);
     A = static_cast<uint8_t>(result);
     flags[Flags::negative] = (A >> 7);
     flags[Flags::zero] = (A == 0);
     flags[Flags::carry] = (result >> 8);
+}
+
+void Cpu::AddMemToAccWithCarry(const uint16_t addr) {
+    AddToAccWithCarry(memory->Read(addr));
     pc += 1;
 }
 
 void Cpu::SubMemFromAccWithBorrow(const uint16_t addr) {
-    uint8_t val = ~(memory->Read(addr));
-    uint16_t result = A + val + flags[Flags::carry];
-    flags[Flags::overflow] = (((A ^ result) & (val ^ result)) & 0x80);
-    A = static_cast<uint8_t>(result);
-    flags[Flags::negative] = (A >> 7);
-    flags[Flags::zero] = (A == 0);
-    flags[Flags::carry] = (result >> 8);
+    AddToAccWithCarry(~(memory->Read(addr)));  // Subtraction is addition of the one's complement
     pc += 1;
 }
 
-void Cpu::CompareWithMemory(const uint8_t byte, const uint16_t addr) {
-    uint8_t val = memory->Read(addr);
+void Cpu::Compare(const uint8_t byte, const uint8_t val) {
     flags[Flags::negative] = ((byte - val) >> 7);
     flags[Flags::zero] = (byte == val);
     flags[Flags::carry] = (byte >= val);
+}
+
+void Cpu::CompareWithMemory(const uint8_t byte, const uint16_t addr) {
+    Compare(byte, memory->Read(addr));
     pc += 1;
 }
 
+// The unofficial read-modify-write instructions below leave pc alone, unlike the helpers above
+
+void Cpu::ShiftLeftOr(const uint16_t addr) {
+    uint8_t byte = memory->Read(addr);
+    flags[Flags::carry] = (byte >> 7);
+    byte <<= 1;
+    memory->Write(addr, byte);
+    A |= byte;
+    flags[Flags::negative] = (A >> 7);
+    flags[Flags::zero] = (A == 0);
+}
+
+void Cpu::RotateLeftAnd(const uint16_t addr) {
+    uint8_t byte = memory->Read(addr);
+    bool old_carry = flags[Flags::carry];
+    flags[Flags::carry] = (byte >> 7);
+    byte = (byte << 1) | static_cast<uint8_t>(old_carry);
+    memory->Write(addr, byte);
+    A &= byte;
+    flags[Flags::negative] = (A >> 7);
+    flags[Flags::zero] = (A == 0);
+}
+
+void Cpu::ShiftRightEor(const uint16_t addr) {
+    uint8_t byte = memory->Read(addr);
+    flags[Flags::carry] = (byte & 0x1);
+    byte >>= 1;
+    memory->Write(addr, byte);
+    A ^= byte;
+    flags[Flags::negative] = (A >> 7);
+    flags[Flags::zero] = (A == 0);
+}
+
+void Cpu::RotateRightAdd(const uint16_t addr) {
+    uint8_t byte = memory->Read(addr);
+    bool old_carry = flags[Flags::carry];
+    flags[Flags::carry] = (byte & 0x1);
+    byte = (byte >> 1) | (old_carry << 7);
+    memory->Write(addr, byte);
+    AddToAccWithCarry(byte);
+}
+
+void Cpu::DecrementCompare(const uint16_t addr) {
+    uint8_t byte = memory->Read(addr) - 1;
+    memory->Write(addr, byte);
+    flags[Flags::negative] = ((A - byte) >> 7) & 1;
+    flags[Flags::zero] = (A == byte);
+    flags[Flags::carry] = (A >= byte);
+}
+
+void Cpu::IncrementSubtract(const uint16_t addr) {
+    uint8_t byte = memory->Read(addr) + 1;
+    memory->Write(addr, byte);
+    AddToAccWithCarry(~byte);
+}
+
+// SHA/SHX/SHY/TAS: the stored value is ANDed with the high byte of the target + 1, and
+// when the index crosses a page that value also replaces the high byte of the address
+void Cpu::StoreAndHighByte(const uint16_t base, const uint8_t index, const uint8_t value) {
+    uint16_t addr = base + index;
+    uint8_t result = value & ((base >> 8) + 1);
+    if ((base & 0xFF00) != (addr & 0xFF00)) addr = (result << 8) | (addr & 0xFF);
+    memory->Write(addr, result);
+}
+
+void Cpu::WarnUnstable(const uint8_t opcode, const char* name) {
+    if (warned_opcodes[opcode]) return;  // Once per opcode, a jammed CPU would flood the log otherwise
+    warned_opcodes[opcode] = true;
+
+    log_helper.Log(LogCategory::cpu, LogLevel::warning, "\nUnstable instruction %s (0x%02X) at 0x%04X", name, opcode, pc);
+}
+
 void Cpu::Interpreter(const uint8_t instr) {
     bool increment_pc = true;
-    if (log_instr) {  // TODO: C++20 will have an easy way to simplify this
-        char instr_executed[5];
-        sprintf_s(&instr_executed[0], sizeof(instr_executed), "0x%X", memory->Read(pc));
-        char pc_char[7];
-        sprintf_s(&pc_char[0], sizeof(pc_char), "0x%X", pc);
-        log_helper.AddLog("\nExecuting instruction " + std::string(instr_executed) + " at address " + std::string(pc_char));
-    }
 
     switch (instr) {
     case 0x00: {  // BRK -I
@@ -188,28 +554,44 @@ void Cpu::Interpreter(const uint8_t instr) {
         break;
     }
     case 0x01: {  // ORA (ind_X) -NZ
-        uint16_t addr = memory->Read(pc + 1);
+        uint16_t addr = op_lo;
         A = A | memory->Read((memory->Read((addr + X + 1) % 256) << 8) | memory->Read((addr + X) % 256));
         flags[Flags::negative] = (A >> 7);
         flags[Flags::zero] = (A == 0);
         pc += 1;
         break;
     }
-    /* case 0x02: break;
-    case 0x03: break;
-    case 0x04: break; */
+    case 0x02: {  // JAM --
+        WarnUnstable(instr, "JAM");  // Locks up the CPU until reset
+        increment_pc = false;
+        break;
+    }
+    case 0x03: {  // SLO (ind_X) -NZC
+        ShiftLeftOr(GetIndexedIndirectAddress());
+        pc += 1;
+        break;
+    }
+    case 0x04: {  // NOP (zpg) --
+        memory->Read(op_lo);  // The read still happens on the bus
+        pc += 1;
+        break;
+    }
     case 0x05: {  // ORA (zpg) -NZ
-        A |= memory->Read(memory->Read(pc + 1));
+        A |= memory->Read(op_lo);
         flags[Flags::negative] = (A >> 7);
         flags[Flags::zero] = (A == 0);
         pc += 1;
         break;
     }
     case 0x06: {  // ASL (zpg) -NZC
-        ShiftLeftWithFlags(memory->Read(pc + 1));
+        ShiftLeftWithFlags(op_lo);
+        break;
+    }
+    case 0x07: {  // SLO (zpg) -NZC
+        ShiftLeftOr(op_lo);
+        pc += 1;
         break;
     }
-    // case 0x07: break;
     case 0x08: {  // PHP --
         flags[Flags::breakpoint] = true;
         Push(static_cast<uint8_t>(flags.to_ulong()));
@@ -217,7 +599,7 @@ void Cpu::Interpreter(const uint8_t instr) {
         break;
     }
     case 0x09: {  // ORA (imm) -NZ
-        A |= memory->Read(pc + 1);
+        A |= op_lo;
         flags[Flags::negative] = (A >> 7);
         flags[Flags::zero] = (A == 0);
         pc += 1;
@@ -231,8 +613,19 @@ void Cpu::Interpreter(const uint8_t instr) {
         flags[Flags::zero] = (A == 0);
         break;
     }
-    /* case 0x0b: break;
-    case 0x0c: break; */
+    case 0x0b: {  // ANC (imm) -NZC
+        A &= op_lo;
+        flags[Flags::negative] = (A >> 7);
+        flags[Flags::zero] = (A == 0);
+        flags[Flags::carry] = (A >> 7);
+        pc += 1;
+        break;
+    }
+    case 0x0c: {  // NOP (abs) --
+        memory->Read(GetImmediateAddress());
+        pc += 2;
+        break;
+    }
     case 0x0d: {  // ORA (abs) -NZ
         A |= memory->Read(GetImmediateAddress());
         flags[Flags::negative] = (A >> 7);
@@ -245,13 +638,17 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 1;
         break;
     }
-    //case 0x0f: break;
+    case 0x0f: {  // SLO (abs) -NZC
+        ShiftLeftOr(GetImmediateAddress());
+        pc += 2;
+        break;
+    }
     case 0x10: {  // BPL (rel) --
         increment_pc = false;
         pc += 2;
         if (!flags[Flags::negative]) {
             ++cycles;
-            uint16_t abs = pc + static_cast<int8_t>(memory->Read(pc - 1));
+            uint16_t abs = pc + static_cast<int8_t>(op_lo);
             cycles += ((abs & 0xFF00) != (pc & 0xFF00));
             pc = abs;
             break;
@@ -259,7 +656,7 @@ void Cpu::Interpreter(const uint8_t instr) {
         break;
     }
     case 0x11: {  // ORA (ind_Y) -NZ
-        uint16_t addr = memory->Read(pc + 1);
+        uint16_t addr = op_lo;
         cycles += ((addr + 1) > 0xFF);
         A |= memory->Read(((memory->Read((addr + 1) % 256) << 8) | memory->Read(addr)) + Y);
         flags[Flags::negative] = (A >> 7);
@@ -267,21 +664,37 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 1;
         break;
     }
-    /* case 0x12: break;
-    case 0x13: break;
-    case 0x14: break; */
+    case 0x12: {  // JAM --
+        WarnUnstable(instr, "JAM");  // Locks up the CPU until reset
+        increment_pc = false;
+        break;
+    }
+    case 0x13: {  // SLO (ind_Y) -NZC
+        ShiftLeftOr(GetIndirectIndexedAddress(false));
+        pc += 1;
+        break;
+    }
+    case 0x14: {  // NOP (zpg_X) --
+        memory->Read(GetZeroPageIndexedAddress(X));
+        pc += 1;
+        break;
+    }
     case 0x15: {  // ORA (zpg_X) -NZ
-        A |= memory->Read((memory->Read(pc + 1) + X) % 256);
+        A |= memory->Read((op_lo + X) % 256);
         flags[Flags::negative] = (A >> 7);
         flags[Flags::zero] = (A == 0);
         pc += 1;
         break;
     }
     case 0x16: {  // ASL (zpg_X) -NZC
-        ShiftLeftWithFlags((memory->Read(pc + 1) + X) % 256);
+        ShiftLeftWithFlags((op_lo + X) % 256);
+        break;
+    }
+    case 0x17: {  // SLO (zpg_X) -NZC
+        ShiftLeftOr(GetZeroPageIndexedAddress(X));
+        pc += 1;
         break;
     }
-    //case 0x17: break;
     case 0x18: {  // CLC -C
         flags[Flags::carry] = false;
         break;
@@ -296,9 +709,19 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 2;
         break;
     }
-    /* case 0x1a: break;
-    case 0x1b: break;
-    case 0x1c: break; */
+    case 0x1a: {  // NOP --
+        break;
+    }
+    case 0x1b: {  // SLO (abs_Y) -NZC
+        ShiftLeftOr(GetAbsoluteIndexedAddress(Y, false));
+        pc += 2;
+        break;
+    }
+    case 0x1c: {  // NOP (abs_X) --
+        memory->Read(GetAbsoluteIndexedAddress(X, true));
+        pc += 2;
+        break;
+    }
     case 0x1d: {  // ORA (abs_X) -NZ
         uint16_t abs = GetImmediateAddress();
         uint16_t abs_x = abs + X;
@@ -314,7 +737,11 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 1;
         break;
     }
-    //case 0x1f: break;
+    case 0x1f: {  // SLO (abs_X) -NZC
+        ShiftLeftOr(GetAbsoluteIndexedAddress(X, false));
+        pc += 2;
+        break;
+    }
     case 0x20: {  // JSR --
         Push((pc + 2) >> 8);
         Push((pc + 2) & 0xFF);
@@ -323,17 +750,25 @@ void Cpu::Interpreter(const uint8_t instr) {
         break;
     }
     case 0x21: {  // AND (ind_X) -NZ
-        uint16_t addr = memory->Read(pc + 1);
+        uint16_t addr = op_lo;
         A &= memory->Read((memory->Read((addr + X + 1) % 256) << 8) | memory->Read((addr + X) % 256));
         flags[Flags::negative] = (A >> 7);
         flags[Flags::zero] = (A == 0);
         pc += 1;
         break;
     }
-    /* case 0x22: break;
-    case 0x23: break; */
+    case 0x22: {  // JAM --
+        WarnUnstable(instr, "JAM");  // Locks up the CPU until reset
+        increment_pc = false;
+        break;
+    }
+    case 0x23: {  // RLA (ind_X) -NZC
+        RotateLeftAnd(GetIndexedIndirectAddress());
+        pc += 1;
+        break;
+    }
     case 0x24: {  // BIT (zpg) -NZV
-        uint8_t value = memory->Read(memory->Read(pc + 1));
+        uint8_t value = memory->Read(op_lo);
         flags[Flags::negative] = (value >> 7);
         flags[Flags::zero] = (value & A) == 0;
         flags[Flags::overflow] = (value >> 6) & 1;
@@ -341,24 +776,28 @@ void Cpu::Interpreter(const uint8_t instr) {
         break;
     }
     case 0x25: {  // AND (zpg) -NZ
-        A &= memory->Read(memory->Read(pc + 1));
+        A &= memory->Read(op_lo);
         flags[Flags::negative] = (A >> 7);
         flags[Flags::zero] = (A == 0);
         pc += 1;
         break;
     }
     case 0x26: {  // ROL (zpg) -NZC
-        RotateLeftWithFlags(memory->Read(pc + 1));
+        RotateLeftWithFlags(op_lo);
+        break;
+    }
+    case 0x27: {  // RLA (zpg) -NZC
+        RotateLeftAnd(op_lo);
+        pc += 1;
         break;
     }
-    /* case 0x27: break; */
     case 0x28: {  // PLP -NZCIDV
         flags = Pop();
         flags[Flags::breakpoint] = false;
         break;
     }
     case 0x29: {  // AND (imm) -NZ
-        A &= memory->Read(pc + 1);
+        A &= op_lo;
         flags[Flags::negative] = (A >> 7);
         flags[Flags::zero] = (A == 0);
         pc += 1;
@@ -374,7 +813,14 @@ void Cpu::Interpreter(const uint8_t instr) {
         flags[Flags::negative] = (A >> 7);
         break;
     }
-    /* case 0x2b: break; */
+    case 0x2b: {  // ANC (imm) -NZC
+        A &= op_lo;
+        flags[Flags::negative] = (A >> 7);
+        flags[Flags::zero] = (A == 0);
+        flags[Flags::carry] = (A >> 7);
+        pc += 1;
+        break;
+    }
     case 0x2c: {  // BIT (abs) -NZV
         uint8_t value = memory->Read(GetImmediateAddress());
         flags[Flags::negative] = value >> 7;
@@ -395,13 +841,17 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 1;
         break;
     }
-    /* case 0x2f: break; */
+    case 0x2f: {  // RLA (abs) -NZC
+        RotateLeftAnd(GetImmediateAddress());
+        pc += 2;
+        break;
+    }
     case 0x30: {  // BMI (rel) --
         increment_pc = false;
         pc += 2;
         if (flags[Flags::negative]) {
             ++cycles;
-            uint16_t abs = pc + static_cast<int8_t>(memory->Read(pc - 1));
+            uint16_t abs = pc + static_cast<int8_t>(op_lo);
             cycles += ((abs & 0xFF00) != (pc & 0xFF00));
             pc = abs;
             break;
@@ -409,7 +859,7 @@ void Cpu::Interpreter(const uint8_t instr) {
         break;
     }
     case 0x31: {  // AND (ind_Y) -NZ
-        uint16_t addr = memory->Read(pc + 1);
+        uint16_t addr = op_lo;
         cycles += ((addr + 1) > 0xFF);
         A &= memory->Read(((memory->Read((addr + 1) % 256) << 8) | memory->Read(addr)) + Y);
         flags[Flags::negative] = (A >> 7);
@@ -417,21 +867,37 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 1;
         break;
     }
-    /* case 0x32: break;
-    case 0x33: break;
-    case 0x34: break; */
+    case 0x32: {  // JAM --
+        WarnUnstable(instr, "JAM");  // Locks up the CPU until reset
+        increment_pc = false;
+        break;
+    }
+    case 0x33: {  // RLA (ind_Y) -NZC
+        RotateLeftAnd(GetIndirectIndexedAddress(false));
+        pc += 1;
+        break;
+    }
+    case 0x34: {  // NOP (zpg_X) --
+        memory->Read(GetZeroPageIndexedAddress(X));
+        pc += 1;
+        break;
+    }
     case 0x35: {  // AND (zpg_X) -NZ
-        A &= memory->Read((memory->Read(pc + 1) + X) % 256);
+        A &= memory->Read((op_lo + X) % 256);
         flags[Flags::negative] = (A >> 7);
         flags[Flags::zero] = (A == 0);
         pc += 1;
         break;
     }
     case 0x36: {  // ROL (zpg_X) -NZC
-        RotateLeftWithFlags((memory->Read(pc + 1) + X) % 256);
+        RotateLeftWithFlags((op_lo + X) % 256);
+        break;
+    }
+    case 0x37: {  // RLA (zpg_X) -NZC
+        RotateLeftAnd(GetZeroPageIndexedAddress(X));
+        pc += 1;
         break;
     }
-    /* case 0x37: break; */
     case 0x38: {  // SEC -C
         flags[Flags::carry] = true;
         break;
@@ -446,9 +912,19 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 2;
         break;
     }
-    /* case 0x3a: break;
-    case 0x3b: break;
-    case 0x3c: break; */
+    case 0x3a: {  // NOP --
+        break;
+    }
+    case 0x3b: {  // RLA (abs_Y) -NZC
+        RotateLeftAnd(GetAbsoluteIndexedAddress(Y, false));
+        pc += 2;
+        break;
+    }
+    case 0x3c: {  // NOP (abs_X) --
+        memory->Read(GetAbsoluteIndexedAddress(X, true));
+        pc += 2;
+        break;
+    }
     case 0x3d: {  // AND (abs_X) -NZ
         uint16_t abs = GetImmediateAddress();
         uint16_t abs_x = abs + X;
@@ -464,7 +940,11 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 1;
         break;
     }
-    /* case 0x3f: break; */
+    case 0x3f: {  // RLA (abs_X) -NZC
+        RotateLeftAnd(GetAbsoluteIndexedAddress(X, false));
+        pc += 2;
+        break;
+    }
     case 0x40: {  // RTI -NZCIDV
         flags = Pop();
         flags[Flags::breakpoint] = false;
@@ -473,34 +953,50 @@ void Cpu::Interpreter(const uint8_t instr) {
         break;
     }
     case 0x41: {  // EOR (ind_X) -NZ
-        uint16_t addr = memory->Read(pc + 1);
+        uint16_t addr = op_lo;
         A ^= memory->Read((memory->Read((addr + X + 1) % 256) << 8) | memory->Read((addr + X) % 256));
         flags[Flags::negative] = (A >> 7);
         flags[Flags::zero] = (A == 0);
         pc += 1;
         break;
     }
-    /* case 0x42: break;
-    case 0x43: break;
-    case 0x44: break; */
+    case 0x42: {  // JAM --
+        WarnUnstable(instr, "JAM");  // Locks up the CPU until reset
+        increment_pc = false;
+        break;
+    }
+    case 0x43: {  // SRE (ind_X) -NZC
+        ShiftRightEor(GetIndexedIndirectAddress());
+        pc += 1;
+        break;
+    }
+    case 0x44: {  // NOP (zpg) --
+        memory->Read(op_lo);  // The read still happens on the bus
+        pc += 1;
+        break;
+    }
     case 0x45: {  // EOR (zpg) -NZ
-        A ^= memory->Read(memory->Read(pc + 1));
+        A ^= memory->Read(op_lo);
         flags[Flags::negative] = (A >> 7);
         flags[Flags::zero] = (A == 0);
         pc += 1;
         break;
     }
     case 0x46: {  // LSR (zpg) -ZC
-        ShiftRightWithFlags(memory->Read(pc + 1));
+        ShiftRightWithFlags(op_lo);
+        break;
+    }
+    case 0x47: {  // SRE (zpg) -NZC
+        ShiftRightEor(op_lo);
+        pc += 1;
         break;
     }
-    // case 0x47: break;
     case 0x48: { // PHA
         Push(A);
         break;
     }
     case 0x49: {  // EOR (imm) -NZ
-        A ^= memory->Read(pc + 1);
+        A ^= op_lo;
         flags[Flags::negative] = (A >> 7);
         flags[Flags::zero] = (A == 0);
         pc += 1;
@@ -513,7 +1009,15 @@ void Cpu::Interpreter(const uint8_t instr) {
         flags[Flags::negative] = false;
         break;
     }
-    /* case 0x4b: break; */
+    case 0x4b: {  // ALR (imm) -NZC
+        A &= op_lo;
+        flags[Flags::carry] = (A & 0x1);
+        A >>= 1;
+        flags[Flags::negative] = (A >> 7);
+        flags[Flags::zero] = (A == 0);
+        pc += 1;
+        break;
+    }
     case 0x4c: {  // JMP (abs) --
         pc = GetImmediateAddress();
         increment_pc = false;
@@ -531,13 +1035,17 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 1;
         break;
     }
-    /* case 0x4f: break; */
+    case 0x4f: {  // SRE (abs) -NZC
+        ShiftRightEor(GetImmediateAddress());
+        pc += 2;
+        break;
+    }
     case 0x50: {  // BVC (rel) --
         increment_pc = false;
         pc += 2;
         if (!flags[Flags::overflow]) {
             ++cycles;
-            uint16_t abs = pc + static_cast<int8_t>(memory->Read(pc - 1));
+            uint16_t abs = pc + static_cast<int8_t>(op_lo);
             cycles += ((abs & 0xFF00) != (pc & 0xFF00));
             pc = abs;
             break;
@@ -545,7 +1053,7 @@ void Cpu::Interpreter(const uint8_t instr) {
         break;
     }
     case 0x51: {  // EOR (ind_Y) -NZ
-        uint16_t addr = memory->Read(pc + 1);
+        uint16_t addr = op_lo;
         cycles += ((addr + 1) > 0xFF);
         A ^= memory->Read(((memory->Read((addr + 1) % 256) << 8) | memory->Read(addr)) + Y);
         flags[Flags::negative] = (A >> 7);
@@ -553,22 +1061,41 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 1;
         break;
     }
-    /* case 0x52: break;
-    case 0x53: break;
-    case 0x54: break; */
+    case 0x52: {  // JAM --
+        WarnUnstable(instr, "JAM");  // Locks up the CPU until reset
+        increment_pc = false;
+        break;
+    }
+    case 0x53: {  // SRE (ind_Y) -NZC
+        ShiftRightEor(GetIndirectIndexedAddress(false));
+        pc += 1;
+        break;
+    }
+    case 0x54: {  // NOP (zpg_X) --
+        memory->Read(GetZeroPageIndexedAddress(X));
+        pc += 1;
+        break;
+    }
     case 0x55: {  // EOR (zpg_X) -NZ
-        A ^= memory->Read((memory->Read(pc + 1) + X) % 256);
+        A ^= memory->Read((op_lo + X) % 256);
         flags[Flags::negative] = (A >> 7);
         flags[Flags::zero] = (A == 0);
         pc += 1;
         break;
     }
     case 0x56: {  // LSR (zpg_X) -ZC
-        ShiftRightWithFlags((memory->Read(pc + 1) + X) % 256);
+        ShiftRightWithFlags((op_lo + X) % 256);
+        break;
+    }
+    case 0x57: {  // SRE (zpg_X) -NZC
+        ShiftRightEor(GetZeroPageIndexedAddress(X));
+        pc += 1;
+        break;
+    }
+    case 0x58: {  // CLI -I
+        flags[Flags::interrupt] = false;
         break;
     }
-    /* case 0x57: break;
-    case 0x58: break; */
     case 0x59: {  // EOR (abs_Y) -NZ
         uint16_t abs = GetImmediateAddress();
         uint16_t abs_y = abs + Y;
@@ -579,9 +1106,19 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 2;
         break;
     }
-    /* case 0x5a: break;
-    case 0x5b: break;
-    case 0x5c: break; */
+    case 0x5a: {  // NOP --
+        break;
+    }
+    case 0x5b: {  // SRE (abs_Y) -NZC
+        ShiftRightEor(GetAbsoluteIndexedAddress(Y, false));
+        pc += 2;
+        break;
+    }
+    case 0x5c: {  // NOP (abs_X) --
+        memory->Read(GetAbsoluteIndexedAddress(X, true));
+        pc += 2;
+        break;
+    }
     case 0x5d: {  // EOR (abs_X) -NZ
         uint16_t abs = GetImmediateAddress();
         uint16_t abs_x = abs + X;
@@ -597,28 +1134,48 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 1;
         break;
     }
-    /* case 0x5f: break; */
+    case 0x5f: {  // SRE (abs_X) -NZC
+        ShiftRightEor(GetAbsoluteIndexedAddress(X, false));
+        pc += 2;
+        break;
+    }
     case 0x60: {  // RTS --
         pc = Pop() | (Pop() << 8);
         break;
     }
     case 0x61: {  // ADC (ind_X) -NZCV
-        uint16_t addr = memory->Read(pc + 1);
+        uint16_t addr = op_lo;
         AddMemToAccWithCarry((memory->Read((addr + X + 1) % 256) << 8) | memory->Read((addr + X) % 256));
         break;
     }
-    /* case 0x62: break;
-    case 0x63: break;
-    case 0x64: break; */
+    case 0x62: {  // JAM --
+        WarnUnstable(instr, "JAM");  // Locks up the CPU until reset
+        increment_pc = false;
+        break;
+    }
+    case 0x63: {  // RRA (ind_X) -NZCV
+        RotateRightAdd(GetIndexedIndirectAddress());
+        pc += 1;
+        break;
+    }
+    case 0x64: {  // NOP (zpg) --
+        memory->Read(op_lo);  // The read still happens on the bus
+        pc += 1;
+        break;
+    }
     case 0x65: {  // ADC (zpg) -NZCV
-        AddMemToAccWithCarry(memory->Read(pc + 1));
+        AddMemToAccWithCarry(op_lo);
         break;
     }
     case 0x66: {  // ROR (zpg) -NZC
-        RotateRightWithFlags(memory->Read(pc + 1));
+        RotateRightWithFlags(op_lo);
+        break;
+    }
+    case 0x67: {  // RRA (zpg) -NZCV
+        RotateRightAdd(op_lo);
+        pc += 1;
         break;
     }
-    /* case 0x67: break; */
     case 0x68: {  // PLA -NZ
         A = Pop();
         flags[Flags::negative] = (A >> 7);
@@ -626,7 +1183,8 @@ void Cpu::Interpreter(const uint8_t instr) {
         break;
     }
     case 0x69: {  // ADC (imm) -NZCV
-        AddMemToAccWithCarry(pc + 1);
+        AddToAccWithCarry(op_lo);
+        pc += 1;
         break;
     }
     case 0x6a: {  // ROR (acc) -NZC
@@ -638,7 +1196,16 @@ void Cpu::Interpreter(const uint8_t instr) {
         flags[Flags::zero] = (A == 0);
         break;
     }
-    /* case 0x6b: break; */
+    case 0x6b: {  // ARR (imm) -NZCV
+        A &= op_lo;
+        A = (A >> 1) | (flags[Flags::carry] << 7);
+        flags[Flags::negative] = (A >> 7);
+        flags[Flags::zero] = (A == 0);
+        flags[Flags::carry] = (A >> 6) & 1;
+        flags[Flags::overflow] = ((A >> 6) ^ (A >> 5)) & 1;
+        pc += 1;
+        break;
+    }
     case 0x6c: {  // JMP (ind) --
         uint16_t addr = GetImmediateAddress();
         uint8_t low = (addr & 0xFF);
@@ -660,13 +1227,17 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 1;
         break;
     }
-    /* case 0x6f: break; */
+    case 0x6f: {  // RRA (abs) -NZCV
+        RotateRightAdd(GetImmediateAddress());
+        pc += 2;
+        break;
+    }
     case 0x70: {  // BVS (rel) --
         increment_pc = false;
         pc += 2;
         if (flags[Flags::overflow]) {
             ++cycles;
-            uint16_t abs = pc + static_cast<int8_t>(memory->Read(pc - 1));
+            uint16_t abs = pc + static_cast<int8_t>(op_lo);
             cycles += ((abs & 0xFF00) != (pc & 0xFF00));
             pc = abs;
             break;
@@ -674,23 +1245,39 @@ void Cpu::Interpreter(const uint8_t instr) {
         break;
     }
     case 0x71: {  // ADC (ind_Y) -NZCV
-        uint16_t addr = memory->Read(pc + 1);
+        uint16_t addr = op_lo;
         cycles += ((addr + 1) > 0xFF);
         AddMemToAccWithCarry(((memory->Read((addr + 1) % 256) << 8) | memory->Read(addr)) + Y);
         break;
     }
-    /* case 0x72: break;
-    case 0x73: break;
-    case 0x74: break; */
+    case 0x72: {  // JAM --
+        WarnUnstable(instr, "JAM");  // Locks up the CPU until reset
+        increment_pc = false;
+        break;
+    }
+    case 0x73: {  // RRA (ind_Y) -NZCV
+        RotateRightAdd(GetIndirectIndexedAddress(false));
+        pc += 1;
+        break;
+    }
+    case 0x74: {  // NOP (zpg_X) --
+        memory->Read(GetZeroPageIndexedAddress(X));
+        pc += 1;
+        break;
+    }
     case 0x75: {  // ADC (zpg_X) -NZCV
-        AddMemToAccWithCarry((memory->Read(pc + 1) + X) % 256);
+        AddMemToAccWithCarry((op_lo + X) % 256);
         break;
     }
     case 0x76: {  // ROR (zpg_X) -NZC
-        RotateRightWithFlags((memory->Read(pc + 1) + X) % 256);
+        RotateRightWithFlags((op_lo + X) % 256);
+        break;
+    }
+    case 0x77: {  // RRA (zpg_X) -NZCV
+        RotateRightAdd(GetZeroPageIndexedAddress(X));
+        pc += 1;
         break;
     }
-    /* case 0x77: break; */
     case 0x78: {  // SEI -I
         flags[Flags::interrupt] = true;
         break;
@@ -703,9 +1290,19 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 1;
         break;
     }
-    /* case 0x7a: break;
-    case 0x7b: break;
-    case 0x7c: break; */
+    case 0x7a: {  // NOP --
+        break;
+    }
+    case 0x7b: {  // RRA (abs_Y) -NZCV
+        RotateRightAdd(GetAbsoluteIndexedAddress(Y, false));
+        pc += 2;
+        break;
+    }
+    case 0x7c: {  // NOP (abs_X) --
+        memory->Read(GetAbsoluteIndexedAddress(X, true));
+        pc += 2;
+        break;
+    }
     case 0x7d: {  // ADC (abs_X) -NZCV
         uint16_t abs = GetImmediateAddress();
         uint16_t abs_x = abs + X;
@@ -719,46 +1316,74 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 1;
         break;
     }
-    /* case 0x7f: break;
-    case 0x80: break; */
+    case 0x7f: {  // RRA (abs_X) -NZCV
+        RotateRightAdd(GetAbsoluteIndexedAddress(X, false));
+        pc += 2;
+        break;
+    }
+    case 0x80: {  // NOP (imm) --
+        pc += 1;
+        break;
+    }
     case 0x81: {  // STA (ind_X) --
-        uint16_t addr = memory->Read(pc + 1);
+        uint16_t addr = op_lo;
         memory->Write((memory->Read((addr + X + 1) % 256) << 8) | memory->Read((addr + X) % 256), A);
         pc += 1;
         break;
     }
-    /* case 0x82: break;
-    case 0x83: break; */
+    case 0x82: {  // NOP (imm) --
+        pc += 1;
+        break;
+    }
+    case 0x83: {  // SAX (ind_X) --
+        memory->Write(GetIndexedIndirectAddress(), A & X);
+        pc += 1;
+        break;
+    }
     case 0x84: {  // STY (zpg) --
-        memory->Write(memory->Read(pc + 1), Y);
+        memory->Write(op_lo, Y);
         pc += 1;
         break;
     }
     case 0x85: {  // STA (zpg) --
-        memory->Write(memory->Read(pc + 1), A);
+        memory->Write(op_lo, A);
         pc += 1;
         break;
     }
     case 0x86: {  // STX (zpg) --
-        memory->Write(memory->Read(pc + 1), X);
+        memory->Write(op_lo, X);
+        pc += 1;
+        break;
+    }
+    case 0x87: {  // SAX (zpg) --
+        memory->Write(op_lo, A & X);
         pc += 1;
         break;
     }
-    //case 0x87: break;
     case 0x88: {  // DEY -NZ
         Y -= 1;
         flags[Flags::negative] = (Y >> 7);
         flags[Flags::zero] = (Y == 0);
         break;
     }
-    /* case 0x89: break; */
+    case 0x89: {  // NOP (imm) --
+        pc += 1;
+        break;
+    }
     case 0x8a: { // TXA -NZ
         A = X;
         flags[Flags::negative] = (A >> 7);
         flags[Flags::zero] = (A == 0);
         break;
     }
-    /* case 0x8b: break; */
+    case 0x8b: {  // XAA (imm) -NZ, unstable
+        WarnUnstable(instr, "XAA");
+        A = (A | 0xEE) & X & op_lo;
+        flags[Flags::negative] = (A >> 7);
+        flags[Flags::zero] = (A == 0);
+        pc += 1;
+        break;
+    }
     case 0x8c: {  // STY (abs) --
         memory->Write(GetImmediateAddress(), Y);
         pc += 2;
@@ -774,13 +1399,17 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 2;
         break;
     }
-    // case 0x8f: break;
+    case 0x8f: {  // SAX (abs) --
+        memory->Write(GetImmediateAddress(), A & X);
+        pc += 2;
+        break;
+    }
     case 0x90: {  // BCC (rel) --
         increment_pc = false;
         pc += 2;
         if (!flags[Flags::carry]) {
             ++cycles;
-            uint16_t abs = pc + static_cast<int8_t>(memory->Read(pc - 1));
+            uint16_t abs = pc + static_cast<int8_t>(op_lo);
             cycles += ((abs & 0xFF00) != (pc & 0xFF00));
             pc = abs;
             break;
@@ -788,29 +1417,44 @@ void Cpu::Interpreter(const uint8_t instr) {
         break;
     }
     case 0x91: {  // STA (ind_Y) --
-        uint16_t addr = memory->Read(pc + 1);
+        uint16_t addr = op_lo;
         memory->Write(((memory->Read((addr + 1) % 256) << 8) | memory->Read(addr)) + Y, A);
         pc += 1;
         break;
     }
-    /* case 0x92: break;
-    case 0x93: break; */
+    case 0x92: {  // JAM --
+        WarnUnstable(instr, "JAM");  // Locks up the CPU until reset
+        increment_pc = false;
+        break;
+    }
+    case 0x93: {  // SHA (ind_Y) --, unstable
+        WarnUnstable(instr, "SHA");
+        uint8_t zpg_addr = op_lo;
+        uint8_t low = memory->Read(zpg_addr);
+        StoreAndHighByte((memory->Read((zpg_addr + 1) % 256) << 8) | low, Y, A & X);
+        pc += 1;
+        break;
+    }
     case 0x94: {  // STY (zpg_X) --
-        memory->Write((memory->Read(pc + 1) + X) % 256, Y);
+        memory->Write((op_lo + X) % 256, Y);
         pc += 1;
         break;
     }
     case 0x95: {  // STA (zpg_X) --
-        memory->Write((memory->Read(pc + 1) + X) % 256, A);
+        memory->Write((op_lo + X) % 256, A);
         pc += 1;
         break;
     }
     case 0x96: {  // STX (zpg_Y) --
-        memory->Write((memory->Read(pc + 1) + Y) % 256, X);
+        memory->Write((op_lo + Y) % 256, X);
+        pc += 1;
+        break;
+    }
+    case 0x97: {  // SAX (zpg_Y) --
+        memory->Write(GetZeroPageIndexedAddress(Y), A & X);
         pc += 1;
         break;
     }
-    /* case 0x97: break; */
     case 0x98: {  // TYA -NZ
         A = Y;
         flags[Flags::negative] = (A >> 7);
@@ -826,24 +1470,45 @@ void Cpu::Interpreter(const uint8_t instr) {
         sp = X;
         break;
     }
-    /* case 0x9b: break;
-    case 0x9c: break; */
+    case 0x9b: {  // TAS (abs_Y) --, unstable
+        WarnUnstable(instr, "TAS");
+        sp = A & X;
+        StoreAndHighByte(GetImmediateAddress(), Y, sp);
+        pc += 2;
+        break;
+    }
+    case 0x9c: {  // SHY (abs_X) --, unstable
+        WarnUnstable(instr, "SHY");
+        StoreAndHighByte(GetImmediateAddress(), X, Y);
+        pc += 2;
+        break;
+    }
     case 0x9d: {  // STA (abs_X) --
         memory->Write(GetImmediateAddress() + X, A);
         pc += 2;
         break;
     }
-    /* case 0x9e: break;
-    case 0x9f: break; */
+    case 0x9e: {  // SHX (abs_Y) --, unstable
+        WarnUnstable(instr, "SHX");
+        StoreAndHighByte(GetImmediateAddress(), Y, X);
+        pc += 2;
+        break;
+    }
+    case 0x9f: {  // SHA (abs_Y) --, unstable
+        WarnUnstable(instr, "SHA");
+        StoreAndHighByte(GetImmediateAddress(), Y, A & X);
+        pc += 2;
+        break;
+    }
     case 0xa0: {  // LDY (imm) -NZ
-        Y = memory->Read(pc + 1);
+        Y = op_lo;
         flags[Flags::negative] = (Y >> 7);
         flags[Flags::zero] = (Y == 0);
         pc += 1;
         break;
     }
     case 0xa1: {  // LDA (ind_X) -NZ
-        uint16_t addr = memory->Read(pc + 1);
+        uint16_t addr = op_lo;
         A = memory->Read((memory->Read((addr + X + 1) % 256) << 8) | memory->Read((addr + X) % 256));
         flags[Flags::negative] = (A >> 7);
         flags[Flags::zero] = (A == 0);
@@ -851,35 +1516,47 @@ void Cpu::Interpreter(const uint8_t instr) {
         break;
     }
     case 0xa2: {  // LDX (imm) -NZ
-        X = memory->Read(pc + 1);
+        X = op_lo;
         flags[Flags::negative] = (X >> 7);
         flags[Flags::zero] = (X == 0);
         pc += 1;
         break;
     }
-    /* case 0xa3: break; */
+    case 0xa3: {  // LAX (ind_X) -NZ
+        A = X = memory->Read(GetIndexedIndirectAddress());
+        flags[Flags::negative] = (A >> 7);
+        flags[Flags::zero] = (A == 0);
+        pc += 1;
+        break;
+    }
     case 0xa4: {  // LDY (zpg) -NZ
-        Y = memory->Read(memory->Read(pc + 1));
+        Y = memory->Read(op_lo);
         flags[Flags::negative] = (Y >> 7);
         flags[Flags::zero] = (Y == 0);
         pc += 1;
         break;
     }
     case 0xa5: {  // LDA (zpg) -NZ
-        A = memory->Read(memory->Read(pc + 1));
+        A = memory->Read(op_lo);
         flags[Flags::negative] = (A >> 7);
         flags[Flags::zero] = (A == 0);
         pc += 1;
         break;
     }
     case 0xa6: {  // LDX (zpg) -NZ
-        X = memory->Read(memory->Read(pc + 1));
+        X = memory->Read(op_lo);
         flags[Flags::negative] = (X >> 7);
         flags[Flags::zero] = (X == 0);
         pc += 1;
         break;
     }
-    /* case 0xa7: break; */
+    case 0xa7: {  // LAX (zpg) -NZ
+        A = X = memory->Read(op_lo);
+        flags[Flags::negative] = (A >> 7);
+        flags[Flags::zero] = (A == 0);
+        pc += 1;
+        break;
+    }
     case 0xa8: {  // TAY -NZ
         Y = A;
         flags[Flags::negative] = (Y >> 7);
@@ -887,7 +1564,7 @@ void Cpu::Interpreter(const uint8_t instr) {
         break;
     }
     case 0xa9: {  // LDA (imm) -NZ
-        A = memory->Read(pc + 1);
+        A = op_lo;
         flags[Flags::negative] = (A >> 7);
         flags[Flags::zero] = (A == 0);
         pc += 1;
@@ -899,7 +1576,14 @@ void Cpu::Interpreter(const uint8_t instr) {
         flags[Flags::zero] = (X == 0);
         break;
     }
-    /* case 0xab: break; */
+    case 0xab: {  // LAX (imm) -NZ, unstable
+        WarnUnstable(instr, "LAX");
+        A = X = (A | 0xEE) & op_lo;
+        flags[Flags::negative] = (A >> 7);
+        flags[Flags::zero] = (A == 0);
+        pc += 1;
+        break;
+    }
     case 0xac: {  // LDY (abs) -NZ
         Y = memory->Read(GetImmediateAddress());
         flags[Flags::negative] = (Y >> 7);
@@ -921,13 +1605,19 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 2;
         break;
     }
-    /* case 0xaf: break; */
+    case 0xaf: {  // LAX (abs) -NZ
+        A = X = memory->Read(GetImmediateAddress());
+        flags[Flags::negative] = (A >> 7);
+        flags[Flags::zero] = (A == 0);
+        pc += 2;
+        break;
+    }
     case 0xb0: {  // BCS (rel) --
         increment_pc = false;
         pc += 2;
         if (flags[Flags::carry]) {
             ++cycles;
-            uint16_t abs = pc + static_cast<int8_t>(memory->Read(pc - 1));
+            uint16_t abs = pc + static_cast<int8_t>(op_lo);
             cycles += ((abs & 0xFF00) != (pc & 0xFF00));
             pc = abs;
             break;
@@ -935,7 +1625,7 @@ void Cpu::Interpreter(const uint8_t instr) {
         break;
     }
     case 0xb1: {  // LDA (ind_Y) -NZ
-        uint8_t zpg_addr = memory->Read(pc + 1);
+        uint8_t zpg_addr = op_lo;
         uint16_t addr = ((memory->Read((zpg_addr + 1) % 256) << 8) | memory->Read(zpg_addr)) + Y;
         cycles += ((addr & 0xFF00) != ((addr - Y) & 0xFF00));
         A = memory->Read(addr);
@@ -944,30 +1634,46 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 1;
         break;
     }
-    /* case 0xb2: break;
-    case 0xb3: break; */
+    case 0xb2: {  // JAM --
+        WarnUnstable(instr, "JAM");  // Locks up the CPU until reset
+        increment_pc = false;
+        break;
+    }
+    case 0xb3: {  // LAX (ind_Y) -NZ
+        A = X = memory->Read(GetIndirectIndexedAddress(true));
+        flags[Flags::negative] = (A >> 7);
+        flags[Flags::zero] = (A == 0);
+        pc += 1;
+        break;
+    }
     case 0xb4: {  // LDY (zpg_X) -NZ
-        Y = memory->Read((memory->Read(pc + 1) + X) % 256);
+        Y = memory->Read((op_lo + X) % 256);
         flags[Flags::negative] = (Y >> 7);
         flags[Flags::zero] = (Y == 0);
         pc += 1;
         break;
     }
     case 0xb5: {  // LDA (zpg_X) -NZ
-        A = memory->Read((memory->Read(pc + 1) + X) % 256);
+        A = memory->Read((op_lo + X) % 256);
         flags[Flags::negative] = (A >> 7);
         flags[Flags::zero] = (A == 0);
         pc += 1;
         break;
     }
     case 0xb6: {  // LDX (zpg_Y) -NZ
-        X = memory->Read((memory->Read(pc + 1) + Y) % 256);
+        X = memory->Read((op_lo + Y) % 256);
         flags[Flags::negative] = (X >> 7);
         flags[Flags::zero] = (X == 0);
         pc += 1;
         break;
     }
-    /* case 0xb7: break; */
+    case 0xb7: {  // LAX (zpg_Y) -NZ
+        A = X = memory->Read(GetZeroPageIndexedAddress(Y));
+        flags[Flags::negative] = (A >> 7);
+        flags[Flags::zero] = (A == 0);
+        pc += 1;
+        break;
+    }
     case 0xb8: {  // CLV -V
         flags[Flags::overflow] = false;
         break;
@@ -988,7 +1694,14 @@ void Cpu::Interpreter(const uint8_t instr) {
         flags[Flags::zero] = (X == 0);
         break;
     }
-    /* case 0xbb: break; */
+    case 0xbb: {  // LAS (abs_Y) -NZ, unstable
+        WarnUnstable(instr, "LAS");
+        A = X = sp = memory->Read(GetAbsoluteIndexedAddress(Y, true)) & sp;
+        flags[Flags::negative] = (A >> 7);
+        flags[Flags::zero] = (A == 0);
+        pc += 2;
+        break;
+    }
     case 0xbc: {  // LDY (abs_X) -NZ
         uint16_t abs = GetImmediateAddress();
         uint16_t abs_x = abs + X;
@@ -1019,30 +1732,44 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 2;
         break;
     }
-    /* case 0xbf: break; */
+    case 0xbf: {  // LAX (abs_Y) -NZ
+        A = X = memory->Read(GetAbsoluteIndexedAddress(Y, true));
+        flags[Flags::negative] = (A >> 7);
+        flags[Flags::zero] = (A == 0);
+        pc += 2;
+        break;
+    }
     case 0xc0: {  // CPY (imm) -NZC
-        CompareWithMemory(Y, pc + 1);
+        Compare(Y, op_lo);
+        pc += 1;
         break;
     }
     case 0xc1: {  // CMP (ind_X) -NZC
-        uint16_t addr = memory->Read(pc + 1);
+        uint16_t addr = op_lo;
         CompareWithMemory(A, (memory->Read((addr + X + 1) % 256) << 8) | memory->Read((addr + X) % 256));
         break;
     }
-    /* case 0xc2: break;
-    case 0xc3: break; */
+    case 0xc2: {  // NOP (imm) --
+        pc += 1;
+        break;
+    }
+    case 0xc3: {  // DCP (ind_X) -NZC
+        DecrementCompare(GetIndexedIndirectAddress());
+        pc += 1;
+        break;
+    }
     case 0xc4: {  // CPY (zpg) -NZC
-        CompareWithMemory(Y, memory->Read(pc + 1));
+        CompareWithMemory(Y, op_lo);
         break;
     }
     case 0xc5: {  // CMP (zpg) -NZC
-        CompareWithMemory(A, memory->Read(pc + 1));
+        CompareWithMemory(A, op_lo);
         break;
     }
     case 0xc6: {  // DEC (zpg) -NZ
         uint8_t temp;
         uint8_t addr;
-        addr = memory->Read(pc + 1);
+        addr = op_lo;
         temp = (memory->Read(addr) - 1);
         flags[Flags::negative] = (temp >> 7);
         flags[Flags::zero] = (temp == 0);
@@ -1050,7 +1777,11 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 1;
         break;
     }
-    /* case 0xc7: break; */
+    case 0xc7: {  // DCP (zpg) -NZC
+        DecrementCompare(op_lo);
+        pc += 1;
+        break;
+    }
     case 0xc8: {  // INY -NZ
         Y += 1;
         flags[Flags::negative] = (Y >> 7);
@@ -1058,7 +1789,8 @@ void Cpu::Interpreter(const uint8_t instr) {
         break;
     }
     case 0xc9: {  // CMP (imm) -NZC
-        CompareWithMemory(A, pc + 1);
+        Compare(A, op_lo);
+        pc += 1;
         break;
     }
     case 0xca: {  // DEX -NZ
@@ -1067,7 +1799,16 @@ void Cpu::Interpreter(const uint8_t instr) {
         flags[Flags::zero] = (X == 0);
         break;
     }
-    /* case 0xcb: break; */
+    case 0xcb: {  // AXS (imm) -NZC
+        uint8_t val = op_lo;
+        uint8_t and_result = A & X;
+        flags[Flags::carry] = (and_result >= val);
+        X = and_result - val;
+        flags[Flags::negative] = (X >> 7);
+        flags[Flags::zero] = (X == 0);
+        pc += 1;
+        break;
+    }
     case 0xcc: {  // CPY (abs) -NZC
         CompareWithMemory(Y, GetImmediateAddress());
         pc += 1;
@@ -1089,13 +1830,17 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 2;
         break;
     }
-    /* case 0xcf: break; */
+    case 0xcf: {  // DCP (abs) -NZC
+        DecrementCompare(GetImmediateAddress());
+        pc += 2;
+        break;
+    }
     case 0xd0: {  // BNE (rel) --
         increment_pc = false;
         pc += 2;
         if (!flags[Flags::zero]) {
             ++cycles;
-            uint16_t abs = pc + static_cast<int8_t>(memory->Read(pc - 1));
+            uint16_t abs = pc + static_cast<int8_t>(op_lo);
             cycles += ((abs & 0xFF00) != (pc & 0xFF00));
             pc = abs;
             break;
@@ -1103,22 +1848,34 @@ void Cpu::Interpreter(const uint8_t instr) {
         break;
     }
     case 0xd1: {  // CMP (ind_Y) -NZC
-        uint16_t addr = memory->Read(pc + 1);
+        uint16_t addr = op_lo;
         cycles += ((addr + 1) > 0xFF);
         CompareWithMemory(A, ((memory->Read((addr + 1) % 256) << 8) | memory->Read(addr)) + Y);
         break;
     }
-    /* case 0xd2: break;
-    case 0xd3: break;
-    case 0xd4: break; */
+    case 0xd2: {  // JAM --
+        WarnUnstable(instr, "JAM");  // Locks up the CPU until reset
+        increment_pc = false;
+        break;
+    }
+    case 0xd3: {  // DCP (ind_Y) -NZC
+        DecrementCompare(GetIndirectIndexedAddress(false));
+        pc += 1;
+        break;
+    }
+    case 0xd4: {  // NOP (zpg_X) --
+        memory->Read(GetZeroPageIndexedAddress(X));
+        pc += 1;
+        break;
+    }
     case 0xd5: {  // CMP (zpg_X) -NZC
-        CompareWithMemory(A, (memory->Read(pc + 1) + X) % 256);
+        CompareWithMemory(A, (op_lo + X) % 256);
         break;
     }
     case 0xd6: {  // DEC (zpg_X) -NZ
         uint8_t temp;
         uint8_t addr;
-        addr = (memory->Read(pc + 1) + X) % 256;
+        addr = (op_lo + X) % 256;
         temp = (memory->Read(addr) - 1);
         flags[Flags::negative] = (temp >> 7);
         flags[Flags::zero] = (temp == 0);
@@ -1126,7 +1883,11 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 1;
         break;
     }
-    /* case 0xd7: break; */
+    case 0xd7: {  // DCP (zpg_X) -NZC
+        DecrementCompare(GetZeroPageIndexedAddress(X));
+        pc += 1;
+        break;
+    }
     case 0xd8: {  // CLD -D
         flags[Flags::decimal] = false;
         break;
@@ -1139,9 +1900,19 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 1;
         break;
     }
-    /* case 0xda: break;
-    case 0xdb: break;
-    case 0xdc: break; */
+    case 0xda: {  // NOP --
+        break;
+    }
+    case 0xdb: {  // DCP (abs_Y) -NZC
+        DecrementCompare(GetAbsoluteIndexedAddress(Y, false));
+        pc += 2;
+        break;
+    }
+    case 0xdc: {  // NOP (abs_X) --
+        memory->Read(GetAbsoluteIndexedAddress(X, true));
+        pc += 2;
+        break;
+    }
     case 0xdd: {  // CMP (abs_X) -NZC
         uint16_t abs = GetImmediateAddress();
         uint16_t abs_x = abs + X;
@@ -1161,28 +1932,40 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 2;
         break;
     }
-    /* case 0xdf: break; */
+    case 0xdf: {  // DCP (abs_X) -NZC
+        DecrementCompare(GetAbsoluteIndexedAddress(X, false));
+        pc += 2;
+        break;
+    }
     case 0xe0: {  // CPX (imm) -NZC
-        CompareWithMemory(X, pc + 1);
+        Compare(X, op_lo);
+        pc += 1;
         break;
     }
     case 0xe1: {  // SBC (ind_X) -NZCV
-        uint16_t addr = memory->Read(pc + 1);
+        uint16_t addr = op_lo;
         SubMemFromAccWithBorrow((memory->Read((addr + X + 1) % 256) << 8) | memory->Read((addr + X) % 256));
         break;
     }
-    /* case 0xe2: break;
-    case 0xe3: break; */
+    case 0xe2: {  // NOP (imm) --
+        pc += 1;
+        break;
+    }
+    case 0xe3: {  // ISC (ind_X) -NZCV
+        IncrementSubtract(GetIndexedIndirectAddress());
+        pc += 1;
+        break;
+    }
     case 0xe4: {  // CPX (zpg) -NZC
-        CompareWithMemory(X, memory->Read(pc + 1));
+        CompareWithMemory(X, op_lo);
         break;
     }
     case 0xe5: {  // SBC (zpg) -NZCV
-        SubMemFromAccWithBorrow(memory->Read(pc + 1));
+        SubMemFromAccWithBorrow(op_lo);
         break;
     }
     case 0xe6: {  // INC (zpg) -NZ
-        uint16_t addr = memory->Read(pc + 1);
+        uint16_t addr = op_lo;
         uint8_t byte = memory->Read(addr);
         byte += 1;
         flags[Flags::negative] = (byte >> 7);
@@ -1191,7 +1974,11 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 1;
         break;
     }
-    /* case 0xe7: break; */
+    case 0xe7: {  // ISC (zpg) -NZCV
+        IncrementSubtract(op_lo);
+        pc += 1;
+        break;
+    }
     case 0xe8: {  // INX -NZ
         X += 1;
         flags[Flags::negative] = (X >> 7);
@@ -1199,13 +1986,18 @@ void Cpu::Interpreter(const uint8_t instr) {
         break;
     }
     case 0xe9: {  // SBC (imm) -NZCV
-        SubMemFromAccWithBorrow(pc + 1);
+        AddToAccWithCarry(~op_lo);
+        pc += 1;
         break;
     }
     case 0xea: {  // NOP --
         break;
     }
-    /* case 0xeb: break; */
+    case 0xeb: {  // SBC (imm) -NZCV
+        AddToAccWithCarry(~op_lo);
+        pc += 1;
+        break;
+    }
     case 0xec: {  // CPX (abs) -NZC
         CompareWithMemory(X, GetImmediateAddress());
         pc += 1;
@@ -1226,13 +2018,17 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 2;
         break;
     }
-    /* case 0xef: break; */
+    case 0xef: {  // ISC (abs) -NZCV
+        IncrementSubtract(GetImmediateAddress());
+        pc += 2;
+        break;
+    }
     case 0xf0: {  // BEQ (rel)--
         increment_pc = false;
         pc += 2;
         if (flags[Flags::zero]) {
             ++cycles;
-            uint16_t abs = pc + static_cast<int8_t>(memory->Read(pc - 1));
+            uint16_t abs = pc + static_cast<int8_t>(op_lo);
             cycles += ((abs & 0xFF00) != (pc & 0xFF00));
             pc = abs;
             break;
@@ -1240,20 +2036,32 @@ void Cpu::Interpreter(const uint8_t instr) {
         break;
     }
     case 0xf1: {  // SBC (ind_Y) -NZCV
-        uint16_t addr = memory->Read(pc + 1);
+        uint16_t addr = op_lo;
         cycles += ((addr + 1) > 0xFF);
         SubMemFromAccWithBorrow(((memory->Read((addr + 1) % 256) << 8) | memory->Read(addr)) + Y);
         break;
     }
-    /* case 0xf2: break;
-    case 0xf3: break;
-    case 0xf4: break; */
+    case 0xf2: {  // JAM --
+        WarnUnstable(instr, "JAM");  // Locks up the CPU until reset
+        increment_pc = false;
+        break;
+    }
+    case 0xf3: {  // ISC (ind_Y) -NZCV
+        IncrementSubtract(GetIndirectIndexedAddress(false));
+        pc += 1;
+        break;
+    }
+    case 0xf4: {  // NOP (zpg_X) --
+        memory->Read(GetZeroPageIndexedAddress(X));
+        pc += 1;
+        break;
+    }
     case 0xf5: {  // SBC (zpg_X) -NZCV
-        SubMemFromAccWithBorrow((memory->Read(pc + 1) + X) % 256);
+        SubMemFromAccWithBorrow((op_lo + X) % 256);
         break;
     }
     case 0xf6: {  // INC (zpg_X) -NZ
-        uint16_t addr = ((memory->Read(pc + 1) + X) % 256);
+        uint16_t addr = ((op_lo + X) % 256);
         uint8_t byte = memory->Read(addr);
         byte += 1;
         flags[Flags::negative] = (byte >> 7);
@@ -1262,7 +2070,11 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 1;
         break;
     }
-    /* case 0xf7: break; */
+    case 0xf7: {  // ISC (zpg_X) -NZCV
+        IncrementSubtract(GetZeroPageIndexedAddress(X));
+        pc += 1;
+        break;
+    }
     case 0xf8: {  //  SED -D
         flags[Flags::decimal] = true;
         break;
@@ -1275,9 +2087,19 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 1;
         break;
     }
-    /* case 0xfa: break;
-    case 0xfb: break;
-    case 0xfc: break; */
+    case 0xfa: {  // NOP --
+        break;
+    }
+    case 0xfb: {  // ISC (abs_Y) -NZCV
+        IncrementSubtract(GetAbsoluteIndexedAddress(Y, false));
+        pc += 2;
+        break;
+    }
+    case 0xfc: {  // NOP (abs_X) --
+        memory->Read(GetAbsoluteIndexedAddress(X, true));
+        pc += 2;
+        break;
+    }
     case 0xfd: {  // SBC (abs_X) -NZCV
         uint16_t abs = GetImmediateAddress();
         uint16_t abs_x = abs + X;
@@ -1296,15 +2118,11 @@ void Cpu::Interpreter(const uint8_t instr) {
         pc += 2;
         break;
     }
-    /* case 0xff: break; */
-    default:
-        increment_pc = false;
-        char unimpl_instr[5];
-        sprintf_s(&unimpl_instr[0], sizeof(unimpl_instr), "0x%X", memory->Read(pc));
-        std::string error_message = "\nUnimplemented instruction " + std::string(unimpl_instr);
-        if (log_helper.GetLastMessage() != error_message) {
-            log_helper.AddLog(error_message);
-        }
+    case 0xff: {  // ISC (abs_X) -NZCV
+        IncrementSubtract(GetAbsoluteIndexedAddress(X, false));
+        pc += 2;
+        break;
+    }
     }
 
     cycles += cycle_lut[instr];
@@ -4,7 +4,12 @@
 #include <bitset>
 #include <cassert>
 
+#include "block_cache.h"
+#include "dynarec.h"
 #include "memory.h"
+#include "profiler.h"
+#include "state.h"
+#include "trace.h"
 
 
 constexpr int MASTER_CLOCKSPEED = 21477272;  // NTSC clockspeed
@@ -23,8 +28,28 @@ public:
     void Reset();
     void IRQ();
     void NMI();
+    void SaveState(StateWriter& state) const;
+    bool LoadState(StateReader& state);
+    bool CheckState(StateReader& state) const;  // Walks past the CPU's part without loading it
 
-    bool log_instr = false;
+    bool trace_enabled = false;
+    TraceBuffer trace{};
+    Profiler* profiler = nullptr;  // Only set while profiling
+    bool block_cache_enabled = false;
+    void SetDecodedRom(const DecodedRom* rom);  // Shared pre-decoded ROM, used while the block cache is off
+
+    // Compiled blocks run several instructions per call, the scheduler only hands them windows without PPU events
+    bool dynarec_enabled = false;
+    bool dynarec_verify = false;  // Run every compiled block through the interpreter too and compare
+    uint32_t RunCompiled(uint32_t max_instructions);
+
+    // Polling loops that can not change anything until the next PPU event are fast-forwarded by the scheduler
+    bool idle_skip_enabled = false;
+    bool idle_skip_verify = false;  // Run the skipped iterations anyway and compare the result
+    bool idle_ready = false;  // Set right after the backwards branch of a loop in a steady state
+    uint32_t idle_instructions{}, idle_cycles{};  // Length of one iteration of that loop
+    uint64_t instruction_count{};
+    void SkipIdleIterations(uint32_t iterations);
     Memory* memory = nullptr;
 
     uint8_t A{}, X{}, Y{};
@@ -40,36 +65,75 @@ public:
                         zero-------||
                        carry--------| */
     uint64_t cycles{};
-    uint8_t cycle_lut[256] = {7, 6, 0, 0, 0, 3, 5, 0, 3, 2, 2, 0, 0, 4, 6, 0,
-                              2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
-                              6, 6, 0, 0, 3, 3, 5, 0, 4, 2, 2, 0, 4, 4, 6, 0,
-                              2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
-                              6, 6, 0, 0, 0, 3, 5, 0, 3, 2, 2, 0, 3, 4, 6, 0,
-                              2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
-                              6, 6, 0, 0, 0, 3, 5, 0, 4, 2, 2, 0, 5, 4, 6, 0,
-                              2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
-                              0, 6, 0, 0, 3, 3, 3, 0, 2, 0, 2, 0, 4, 4, 4, 0,
-                              2, 6, 0, 0, 4, 4, 4, 0, 2, 5, 2, 0, 0, 5, 0, 0,
-                              2, 6, 2, 0, 3, 3, 3, 0, 2, 2, 2, 0, 4, 4, 4, 0,
-                              2, 5, 0, 0, 4, 4, 4, 0, 2, 4, 2, 0, 4, 4, 4, 0,
-                              2, 6, 0, 0, 3, 3, 5, 0, 2, 2, 2, 0, 4, 4, 6, 0,
-                              2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
-                              2, 6, 0, 0, 3, 3, 5, 0, 2, 2, 2, 0, 4, 4, 6, 0,
-                              2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0};
+    uint8_t cycle_lut[256] = {7, 6, 0, 8, 3, 3, 5, 5, 3, 2, 2, 2, 4, 4, 6, 6,
+                              2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+                              6, 6, 0, 8, 3, 3, 5, 5, 4, 2, 2, 2, 4, 4, 6, 6,
+                              2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+                              6, 6, 0, 8, 3, 3, 5, 5, 3, 2, 2, 2, 3, 4, 6, 6,
+                              2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+                              6, 6, 0, 8, 3, 3, 5, 5, 4, 2, 2, 2, 5, 4, 6, 6,
+                              2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+                              2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
+                              2, 6, 0, 6, 4, 4, 4, 4, 2, 5, 2, 5, 5, 5, 5, 5,
+                              2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
+                              2, 5, 0, 5, 4, 4, 4, 4, 2, 4, 2, 4, 4, 4, 4, 4,
+                              2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,
+                              2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+                              2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,
+                              2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7};  // JAM opcodes never finish
 
 private:
     void Interpreter(const uint8_t instr);
+    inline void Fetch();
+    inline void Trace();
+    void CheckIdleLoop(const uint16_t branch_pc);
+    bool AnalyzeIdleLoop(const uint16_t start, const uint16_t end);
     inline uint16_t GetImmediateAddress();
+    inline uint16_t GetZeroPageIndexedAddress(const uint8_t index);
+    inline uint16_t GetAbsoluteIndexedAddress(const uint8_t index, const bool page_penalty);
+    inline uint16_t GetIndexedIndirectAddress();
+    inline uint16_t GetIndirectIndexedAddress(const bool page_penalty);
     inline void Push(const uint8_t byte);
     inline uint8_t Pop();
     void ShiftLeftWithFlags(const uint16_t addr);
     void ShiftRightWithFlags(const uint16_t addr);
     void RotateLeftWithFlags(const uint16_t addr);
     void RotateRightWithFlags(const uint16_t addr);
+    void AddToAccWithCarry(const uint8_t val);
     void AddMemToAccWithCarry(const uint16_t addr);
     void SubMemFromAccWithBorrow(const uint16_t addr);
+    void Compare(const uint8_t byte, const uint8_t val);
     void CompareWithMemory(const uint8_t byte, const uint16_t addr);
+    void ShiftLeftOr(const uint16_t addr);
+    void RotateLeftAnd(const uint16_t addr);
+    void ShiftRightEor(const uint16_t addr);
+    void RotateRightAdd(const uint16_t addr);
+    void DecrementCompare(const uint16_t addr);
+    void IncrementSubtract(const uint16_t addr);
+    void StoreAndHighByte(const uint16_t base, const uint8_t index, const uint8_t value);
+    void WarnUnstable(const uint8_t opcode, const char* name);
 
     uint8_t instr{};
+    uint8_t op_lo{}, op_hi{};  // Operand bytes of instr, fetched before it executes
+    BlockCache block_cache{};
+    const BlockCache::Block* current_block = nullptr;
+    const DecodedRom* decoded_rom = nullptr;
+    uint32_t decoded_rom_generation{};  // Map generation decoded_rom_matches was worked out for
+    bool decoded_rom_matches = false;
+    inline bool DecodedRomMatches();
+    uint8_t block_pos{};
+    uint16_t block_next_pc{};
+    uint32_t interrupt_count{};
+    Dynarec dynarec{};
+    void VerifyCompiled(const DynState& state, const uint8_t* ram_before);
+
+    struct IdleLoop {
+        int32_t branch_pc = -1;  // -1 when no loop has been seen
+        bool valid = false;
+        uint8_t A{}, X{}, Y{}, P{}, sp{};
+        uint32_t interrupt_count{};
+        uint64_t instruction_count{}, cycles{};
+    } idle_loop{};
+    std::bitset<256> warned_opcodes{};
 };
 
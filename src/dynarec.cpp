@@ -0,0 +1,361 @@
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "dynarec.h"
+#include "trace.h"
+
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define DYNAREC_X64
+#endif
+
+static_assert(offsetof(DynState, A) == 0 && offsetof(DynState, X) == 1 && offsetof(DynState, Y) == 2 && offsetof(DynState, P) == 3 &&
+              offsetof(DynState, sp) == 4 && offsetof(DynState, pc) == 8 && offsetof(DynState, instructions) == 12 &&
+              offsetof(DynState, cycles) == 16, "The emitted code hardcodes the DynState layout");
+
+namespace {
+
+enum : uint8_t { REG_A = 0, REG_X = 1, REG_Y = 2, REG_P = 3, REG_SP = 4 };
+enum : uint8_t { FLAG_C = 0x01, FLAG_Z = 0x02, FLAG_D = 0x08, FLAG_V = 0x40, FLAG_N = 0x80 };
+
+// The state pointer lives in r9 for the whole block, al holds the value being worked on, rcx and dl are scratch.
+// All of them are volatile in both the Windows and System V calling conventions, so nothing has to be saved.
+class Assembler {
+public:
+    std::vector<uint8_t> bytes{};
+
+    void Emit(std::initializer_list<uint8_t> list) { bytes.insert(bytes.end(), list); }
+    void Emit32(uint32_t value) { for (int i = 0; i < 4; ++i) bytes.push_back(static_cast<uint8_t>(value >> (i * 8))); }
+    void Emit64(uint64_t value) { for (int i = 0; i < 8; ++i) bytes.push_back(static_cast<uint8_t>(value >> (i * 8))); }
+
+    void Prologue() {
+#ifdef _WIN32
+        Emit({0x49, 0x89, 0xC9});  // mov r9, rcx
+#else
+        Emit({0x49, 0x89, 0xF9});  // mov r9, rdi
+#endif
+    }
+    void LoadReg(uint8_t reg) { Emit({0x41, 0x8A, 0x41, reg}); }  // mov al, [r9+reg]
+    void StoreReg(uint8_t reg) { Emit({0x41, 0x88, 0x41, reg}); }  // mov [r9+reg], al
+    void LoadImmediate(uint8_t value) { Emit({0xB0, value}); }  // mov al, imm8
+    void AluImmediate(uint8_t op, uint8_t value) { Emit({op, value}); }  // and/or/xor al, imm8
+    void Increment() { Emit({0xFE, 0xC0}); }  // inc al
+    void Decrement() { Emit({0xFE, 0xC8}); }  // dec al
+    void ClearFlags(uint8_t mask) { Emit({0x41, 0x80, 0x61, REG_P, static_cast<uint8_t>(~mask)}); }  // and byte [r9+P], ~mask
+    void SetFlags(uint8_t mask) { Emit({0x41, 0x80, 0x49, REG_P, mask}); }  // or byte [r9+P], mask
+
+    // Z and N from al
+    void UpdateNZ() {
+        ClearFlags(FLAG_N | FLAG_Z);
+        Emit({0x84, 0xC0});  // test al, al
+        Emit({0x0F, 0x94, 0xC1});  // setz cl
+        Emit({0xD0, 0xE1});  // shl cl, 1
+        Emit({0x88, 0xC2});  // mov dl, al
+        Emit({0x80, 0xE2, 0x80});  // and dl, 0x80
+        Emit({0x08, 0xD1});  // or cl, dl
+        Emit({0x41, 0x08, 0x49, REG_P});  // or [r9+P], cl
+    }
+
+    // C, Z and N of al - value, al is clobbered
+    void Compare(uint8_t value) {
+        ClearFlags(FLAG_N | FLAG_Z | FLAG_C);
+        Emit({0x3C, value});  // cmp al, imm8
+        Emit({0x0F, 0x93, 0xC2});  // setae dl
+        Emit({0x0F, 0x94, 0xC1});  // setz cl
+        Emit({0xD0, 0xE1});  // shl cl, 1
+        Emit({0x08, 0xD1});  // or cl, dl
+        Emit({0x2C, value});  // sub al, imm8
+        Emit({0x24, 0x80});  // and al, 0x80
+        Emit({0x08, 0xC1});  // or cl, al
+        Emit({0x41, 0x08, 0x49, REG_P});  // or [r9+P], cl
+    }
+
+    // Loads a page table entry into rcx, returns the jump to patch for a null page
+    size_t LoadPage(const void* slot) {
+        Emit({0x48, 0xB9});  // mov rcx, imm64
+        Emit64(reinterpret_cast<uint64_t>(slot));
+        Emit({0x48, 0x8B, 0x09});  // mov rcx, [rcx]
+        Emit({0x48, 0x85, 0xC9});  // test rcx, rcx
+        return JumpIf(0x84);
+    }
+    void LoadFromPage(uint8_t offset) { Emit({0x8A, 0x81}); Emit32(offset); }  // mov al, [rcx+offset]
+    void StoreToPage(uint8_t offset) { Emit({0x88, 0x81}); Emit32(offset); }  // mov [rcx+offset], al
+
+    void StoreBus(uint8_t* open_bus) {
+        Emit({0x48, 0xB9});  // mov rcx, imm64
+        Emit64(reinterpret_cast<uint64_t>(open_bus));
+        Emit({0x88, 0x01});  // mov [rcx], al
+    }
+    void StoreBus(uint8_t* open_bus, uint8_t value) {
+        Emit({0x48, 0xB9});  // mov rcx, imm64
+        Emit64(reinterpret_cast<uint64_t>(open_bus));
+        Emit({0xC6, 0x01, value});  // mov byte [rcx], imm8
+    }
+
+    void TestFlags(uint8_t mask) { Emit({0x41, 0xF6, 0x41, REG_P, mask}); }  // test byte [r9+P], mask
+    size_t JumpIf(uint8_t condition) {  // jcc rel32, 0x84 is jz and 0x85 jnz
+        Emit({0x0F, condition});
+        Emit32(0);
+        return bytes.size() - 4;
+    }
+    void PatchJump(size_t position) {
+        uint32_t rel = static_cast<uint32_t>(bytes.size() - (position + 4));
+        memcpy(&bytes[position], &rel, 4);
+    }
+
+    void Exit(uint16_t pc, uint32_t instructions, uint32_t cycles) {
+        Emit({0x66, 0x41, 0xC7, 0x41, 0x08});  // mov word [r9+pc], imm16
+        bytes.push_back(static_cast<uint8_t>(pc));
+        bytes.push_back(static_cast<uint8_t>(pc >> 8));
+        Emit({0x41, 0xC7, 0x41, 0x0C});  // mov dword [r9+instructions], imm32
+        Emit32(instructions);
+        Emit({0x49, 0x81, 0x41, 0x10});  // add qword [r9+cycles], imm32
+        Emit32(cycles);
+        Emit({0xC3});  // ret
+    }
+};
+
+struct SideExit {
+    size_t jump;
+    uint16_t pc;
+    uint32_t instructions, cycles;
+    int32_t bus;  // Left by the instruction before, -1 when the compiled code already stored it
+};
+
+}  // namespace
+
+
+Dynarec::~Dynarec() {
+    if (!code) return;
+#ifdef _WIN32
+    VirtualFree(code, 0, MEM_RELEASE);
+#else
+    munmap(code, CODE_SIZE);
+#endif
+}
+
+bool Dynarec::IsSupported() {
+#ifdef DYNAREC_X64
+    return true;
+#else
+    return false;
+#endif
+}
+
+const Dynarec::Block* Dynarec::Find(Memory& memory, const uint16_t pc, const uint8_t* cycle_lut) {
+    if (!IsSupported()) return nullptr;
+    if (map_generation != memory.map_generation) {  // Bank switches, ROM itself never changes
+        Flush();
+        map_generation = memory.map_generation;
+    }
+
+    // Only cartridge ROM is compiled, code in RAM tends to be rewritten all the time
+    if (pc < 0x8000 || !memory.read_pages[pc >> 8] || memory.write_pages[pc >> 8]) return nullptr;
+    const uint32_t phys = memory.GetPhysicalAddress(pc);
+    if (phys >= Memory::PHYS_SIZE) return nullptr;
+    if (block_index.empty()) block_index.assign(Memory::PHYS_SIZE, -1);  // Only allocated once the recompiler is used
+    if (block_index[phys] >= 0) return &blocks[block_index[phys]];
+
+    if (!code) {
+#ifdef _WIN32
+        code = static_cast<uint8_t*>(VirtualAlloc(nullptr, CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE));
+#else
+        void* mapping = mmap(nullptr, CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        code = mapping == MAP_FAILED ? nullptr : static_cast<uint8_t*>(mapping);
+#endif
+        if (!code) {
+            log_helper.AddLog("\nCould not allocate memory for the recompiler", LogCategory::cpu, LogLevel::error);
+            return nullptr;
+        }
+    }
+
+    Block block;
+    if (Compile(memory, pc, cycle_lut, block)) {  // Out of code space
+        Flush();
+        if (Compile(memory, pc, cycle_lut, block)) return nullptr;
+    }
+
+    block_index[phys] = static_cast<int32_t>(blocks.size());
+    blocks.push_back(block);
+    return &blocks.back();
+}
+
+void Dynarec::Flush() {
+    std::fill(block_index.begin(), block_index.end(), -1);
+    blocks.clear();
+    code_used = 0;
+}
+
+// Returns true when the code does not fit into what is left of the buffer
+bool Dynarec::Compile(Memory& memory, const uint16_t pc, const uint8_t* cycle_lut, Block& block) {
+    Assembler as;
+    std::vector<SideExit> side_exits;
+    as.Prologue();
+
+    uint16_t addr = pc;
+    uint32_t count = 0, cycles = 0;
+    int32_t bus = -1;  // Value the last instruction left on the bus when known while compiling
+    bool ended = false;
+
+    while (count < MAX_BLOCK_OPS && !ended) {
+        const uint8_t opcode = memory.Peek(addr);
+        const uint8_t length = Disassembler::GetLength(opcode);
+        if ((addr & 0xFF) + length > 0x100) break;  // The next page may be banked differently
+        const uint8_t lo = memory.Peek(addr + 1);
+        const uint8_t hi = memory.Peek(addr + 2);
+        const uint16_t operand = (hi << 8) | lo;
+        const uint16_t next = addr + length;
+        const uint32_t after = cycles + cycle_lut[opcode];
+
+        auto side_exit = [&](size_t jump) { side_exits.push_back({jump, addr, count, cycles, bus}); };
+        auto load = [&](uint16_t address) {
+            side_exit(as.LoadPage(&memory.read_pages[address >> 8]));
+            as.LoadFromPage(address & 0xFF);
+            as.StoreBus(&memory.open_bus);
+        };
+        auto store = [&](uint16_t address) {  // al has to be loaded after this, the page check clobbers nothing else
+            side_exit(as.LoadPage(&memory.write_pages[address >> 8]));
+        };
+
+        switch (opcode) {
+        case 0xA9: case 0xA2: case 0xA0: {  // LDA, LDX, LDY (imm)
+            as.LoadImmediate(lo);
+            as.StoreReg(opcode == 0xA9 ? REG_A : (opcode == 0xA2 ? REG_X : REG_Y));
+            as.UpdateNZ();
+            bus = lo;
+            break;
+        }
+        case 0xA5: case 0xA6: case 0xA4: case 0xAD: case 0xAE: case 0xAC: {  // LDA, LDX, LDY (zpg, abs)
+            load(length == 2 ? lo : operand);
+            const uint8_t low = opcode & 0x03;
+            as.StoreReg(low == 0x01 ? REG_A : (low == 0x02 ? REG_X : REG_Y));
+            as.UpdateNZ();
+            bus = -1;
+            break;
+        }
+        case 0x85: case 0x86: case 0x84: case 0x8D: case 0x8E: case 0x8C: {  // STA, STX, STY (zpg, abs)
+            const uint16_t address = length == 2 ? lo : operand;
+            if (address >= 0x2000) goto done;  // Everything else may be I/O or battery backed
+            store(address);
+            const uint8_t low = opcode & 0x03;
+            as.LoadReg(low == 0x01 ? REG_A : (low == 0x02 ? REG_X : REG_Y));
+            as.StoreToPage(address & 0xFF);
+            as.StoreBus(&memory.open_bus);
+            bus = -1;
+            break;
+        }
+        case 0xE6: case 0xC6: {  // INC, DEC (zpg)
+            store(lo);
+            as.LoadFromPage(lo);
+            if (opcode == 0xE6) as.Increment();
+            else as.Decrement();
+            as.StoreToPage(lo);
+            as.UpdateNZ();
+            as.StoreBus(&memory.open_bus);
+            bus = -1;
+            break;
+        }
+        case 0xAA: case 0xA8: case 0x8A: case 0x98: case 0xBA: case 0x9A: {  // TAX, TAY, TXA, TYA, TSX, TXS
+            static const uint8_t from[] = {REG_A, REG_A, REG_X, REG_Y, REG_SP, REG_X};
+            static const uint8_t to[] = {REG_X, REG_Y, REG_A, REG_A, REG_X, REG_SP};
+            const int i = opcode == 0xAA ? 0 : opcode == 0xA8 ? 1 : opcode == 0x8A ? 2 : opcode == 0x98 ? 3 : opcode == 0xBA ? 4 : 5;
+            as.LoadReg(from[i]);
+            as.StoreReg(to[i]);
+            if (opcode != 0x9A) as.UpdateNZ();
+            bus = opcode;
+            break;
+        }
+        case 0xE8: case 0xC8: case 0xCA: case 0x88: {  // INX, INY, DEX, DEY
+            const uint8_t reg = (opcode == 0xE8 || opcode == 0xCA) ? REG_X : REG_Y;
+            as.LoadReg(reg);
+            if (opcode == 0xE8 || opcode == 0xC8) as.Increment();
+            else as.Decrement();
+            as.StoreReg(reg);
+            as.UpdateNZ();
+            bus = opcode;
+            break;
+        }
+        case 0x29: case 0x09: case 0x49: {  // AND, ORA, EOR (imm)
+            as.LoadReg(REG_A);
+            as.AluImmediate(opcode == 0x29 ? 0x24 : (opcode == 0x09 ? 0x0C : 0x34), lo);
+            as.StoreReg(REG_A);
+            as.UpdateNZ();
+            bus = lo;
+            break;
+        }
+        case 0xC9: case 0xE0: case 0xC0: {  // CMP, CPX, CPY (imm)
+            as.LoadReg(opcode == 0xC9 ? REG_A : (opcode == 0xE0 ? REG_X : REG_Y));
+            as.Compare(lo);
+            bus = lo;
+            break;
+        }
+        case 0x18: as.ClearFlags(FLAG_C); bus = opcode; break;  // CLC
+        case 0x38: as.SetFlags(FLAG_C); bus = opcode; break;  // SEC
+        case 0xD8: as.ClearFlags(FLAG_D); bus = opcode; break;  // CLD
+        case 0xF8: as.SetFlags(FLAG_D); bus = opcode; break;  // SED
+        case 0xB8: as.ClearFlags(FLAG_V); bus = opcode; break;  // CLV
+        case 0xEA: bus = opcode; break;  // NOP
+        case 0x4C: {  // JMP (abs)
+            as.StoreBus(&memory.open_bus, hi);
+            as.Exit(operand, count + 1, after);
+            ended = true;
+            break;
+        }
+        case 0x10: case 0x30: case 0x50: case 0x70: case 0x90: case 0xB0: case 0xD0: case 0xF0: {  // Branches
+            static const uint8_t masks[] = {FLAG_N, FLAG_V, FLAG_C, FLAG_Z};
+            const uint8_t mask = masks[opcode >> 6];
+            const bool taken_when_set = (opcode & 0x20) != 0;
+            const uint16_t target = next + static_cast<int8_t>(lo);
+            as.StoreBus(&memory.open_bus, lo);
+            as.TestFlags(mask);
+            const size_t taken = as.JumpIf(taken_when_set ? 0x85 : 0x84);
+            as.Exit(next, count + 1, after);
+            as.PatchJump(taken);
+            as.Exit(target, count + 1, after + 1 + ((target & 0xFF00) != (next & 0xFF00)));
+            ended = true;
+            break;
+        }
+        default:
+            goto done;
+        }
+
+        if (!ended) {
+            ++count;
+            cycles = after;
+            addr = next;
+            if ((addr & 0xFF) == 0) break;
+        }
+    }
+done:
+    if (ended) ++count;
+    else {
+        if (count == 0) {  // Nothing compiled, cache that so the lookup stays cheap
+            block = Block{};
+            return false;
+        }
+        if (bus >= 0) as.StoreBus(&memory.open_bus, static_cast<uint8_t>(bus));
+        as.Exit(addr, count, cycles);
+    }
+
+    for (const SideExit& exit : side_exits) {
+        as.PatchJump(exit.jump);
+        if (exit.bus >= 0) as.StoreBus(&memory.open_bus, static_cast<uint8_t>(exit.bus));
+        as.Exit(exit.pc, exit.instructions, exit.cycles);
+    }
+
+    if (code_used + as.bytes.size() > CODE_SIZE) return true;
+    memcpy(code + code_used, as.bytes.data(), as.bytes.size());
+    block.code = reinterpret_cast<Function>(code + code_used);
+    block.instructions = static_cast<uint8_t>(count);
+    code_used += as.bytes.size();
+    return false;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "memory.h"
+
+
+// Guest registers as the compiled code sees them, Cpu copies them in before and out after a block
+struct DynState {
+    uint8_t A, X, Y, P, sp;
+    uint8_t pad[3];
+    uint16_t pc;  // Where execution continues after the block
+    uint16_t pad2;
+    uint32_t instructions;  // How many instructions of the block actually ran
+    uint64_t cycles;
+};
+
+// Translates straight-line runs of simple 6502 instructions into x86-64 code. Only register, immediate
+// and fixed address RAM and cartridge accesses are compiled, everything else ends the block so the
+// interpreter runs it. Memory is reached through the page table at run time, a null page leaves the
+// block right before the access, which is how I/O and writes to pages holding code are handed back.
+class Dynarec {
+public:
+    static constexpr uint32_t MAX_BLOCK_OPS = 32;
+    static constexpr size_t CODE_SIZE = 4 * 1024 * 1024;  // Everything is flushed once this fills up
+
+    typedef void (*Function)(DynState* state);
+    struct Block {
+        Function code = nullptr;  // Null when the first instruction can not be compiled
+        uint8_t instructions{};  // Upper bound of instructions one call runs
+    };
+
+    Dynarec() = default;
+    ~Dynarec();
+    Dynarec(const Dynarec&) = delete;
+    Dynarec& operator=(const Dynarec&) = delete;
+
+    static bool IsSupported();
+    const Block* Find(Memory& memory, uint16_t pc, const uint8_t* cycle_lut);  // Compiles on a miss
+    void Flush();
+
+private:
+    bool Compile(Memory& memory, uint16_t pc, const uint8_t* cycle_lut, Block& block);
+
+    uint8_t* code = nullptr;  // Executable memory, allocated on first use
+    size_t code_used{};
+    std::vector<int32_t> block_index{};  // Physical address to index in blocks, -1 when not compiled
+    std::vector<Block> blocks{};
+    uint32_t map_generation{};
+};
@@ -0,0 +1,151 @@
+#include <string.h>
+#include <mutex>
+
+#include "console.h"
+#include "eznes.h"
+#include "forked_state.h"
+
+
+struct eznes {
+    Console console{};
+    std::vector<uint8_t> power_state{};  // Taken right after loading, eznes_reset goes back to it
+};
+
+struct eznes_forked_state {
+    ForkedState state;
+};
+
+// The log thread runs while any environment exists, it is stopped with the last one so the library can be unloaded
+static std::mutex env_mutex;
+static uint32_t env_count{};
+
+eznes* eznes_create(const char* rom_path, uint32_t flags) {
+    {
+        std::lock_guard<std::mutex> lock(env_mutex);
+        if (env_count++ == 0) log_helper.Start();
+    }
+    eznes* env = new eznes;
+    env->console.memory.use_save_file = false;  // Every environment starts from the same blank battery RAM
+    if (!rom_path || env->console.LoadROM(rom_path, nullptr)) {
+        eznes_destroy(env);
+        return nullptr;
+    }
+    const bool fast = (flags & EZNES_FAST_PATHS) != 0;
+    env->console.cpu.block_cache_enabled = fast;
+    env->console.cpu.dynarec_enabled = fast;
+    env->console.cpu.idle_skip_enabled = fast;
+    env->console.ppu.line_hashing = (flags & EZNES_LINE_HASHES) != 0;
+    env->console.SaveState(env->power_state);
+    return env;
+}
+
+void eznes_destroy(eznes* env) {
+    delete env;
+    std::lock_guard<std::mutex> lock(env_mutex);
+    if (--env_count == 0) log_helper.Stop();
+}
+
+void eznes_reset(eznes* env) {
+    env->console.LoadState(env->power_state.data(), env->power_state.size());
+}
+
+void eznes_step(eznes* env, uint8_t buttons) {
+    env->console.memory.controller[0] = buttons;
+    env->console.RunFrame();
+}
+
+uint64_t eznes_get_frame_count(eznes* env) {
+    return env->console.ppu.frame_count;
+}
+
+const uint8_t* eznes_get_ram(eznes* env) {
+    return env->console.memory.GetRam();
+}
+
+const uint32_t* eznes_get_frame(eznes* env) {
+    return &(*env->console.ppu.image_data)[0][0];
+}
+
+void eznes_set_output(eznes* env, int rgba, int indexed) {
+    env->console.ppu.rgba_output = rgba != 0;
+    env->console.ppu.indexed_output = indexed != 0;
+}
+
+const uint8_t* eznes_get_indexed_frame(eznes* env) {
+    return &(*env->console.ppu.indexed_data)[0][0];
+}
+
+const uint8_t* eznes_get_line_emphasis(eznes* env) {
+    return &env->console.ppu.line_emphasis[0];
+}
+
+void eznes_get_palette(eznes* env, uint32_t palette[64]) {
+    for (uint8_t i = 0; i < 64; ++i) palette[i] = env->console.ppu.GetPaletteColor(i);
+}
+
+uint64_t eznes_get_frame_hash(eznes* env) {
+    return env->console.ppu.GetFrameHash();
+}
+
+void eznes_get_dirty_lines(eznes* env, uint8_t dirty[EZNES_FRAME_HEIGHT / 8]) {
+    memset(dirty, 0, EZNES_FRAME_HEIGHT / 8);
+    for (int line = 0; line < EZNES_FRAME_HEIGHT; ++line) {
+        if (env->console.ppu.dirty_lines[line]) dirty[line >> 3] |= 1 << (line & 7);
+    }
+}
+
+int eznes_set_observation(eznes* env, uint32_t scale, int greyscale) {
+    return env->console.ppu.SetObservation(scale, greyscale != 0) ? 1 : 0;
+}
+
+const uint8_t* eznes_get_observation(eznes* env, uint32_t* width, uint32_t* height, uint32_t* channels) {
+    const Ppu& ppu = env->console.ppu;
+    if (width) *width = ppu.GetObservationWidth();
+    if (height) *height = ppu.GetObservationHeight();
+    if (channels) *channels = ppu.GetObservationChannels();
+    return ppu.GetObservationWidth() ? ppu.GetObservation() : nullptr;
+}
+
+size_t eznes_get_counters(eznes* env, uint64_t* values, size_t count) {
+    const Counters& counters = env->console.memory.counters;
+    for (size_t i = 0; i < count && i < Counters::FIELD_COUNT; ++i) values[i] = counters.values[i];
+    return Counters::FIELD_COUNT;
+}
+
+const char* eznes_get_counter_name(size_t index) {
+    return Counters::GetName(static_cast<int>(index));
+}
+
+size_t eznes_state_size(eznes* env) {
+    return env->console.GetStateSize();
+}
+
+int eznes_save_state(eznes* env, void* buffer, size_t size) {
+    if (size < env->console.GetStateSize()) return 1;
+    env->console.SaveState(static_cast<uint8_t*>(buffer), size);
+    return 0;
+}
+
+int eznes_load_state(eznes* env, const void* buffer, size_t size) {
+    return env->console.LoadState(static_cast<const uint8_t*>(buffer), size) ? 1 : 0;
+}
+
+uint32_t eznes_get_state_hash(eznes* env) {
+    return env->console.GetStateHash();
+}
+
+eznes_forked_state* eznes_fork(eznes* env, const eznes_forked_state* parent) {
+    return new eznes_forked_state{ForkedState(env->console, parent ? &parent->state : nullptr)};
+}
+
+int eznes_restore_fork(eznes* env, const eznes_forked_state* fork) {
+    return fork->state.Restore(env->console) ? 1 : 0;
+}
+
+size_t eznes_fork_own_size(const eznes_forked_state* fork) {
+    return fork->state.GetOwnSize();
+}
+
+void eznes_free_fork(eznes_forked_state* fork) {
+    delete fork;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+// Plain C interface to the emulator core for driving it from other languages, e.g. as a reinforcement
+// learning environment. Nothing here allocates per step, the getters return pointers into the
+// console's own buffers which stay valid until eznes_destroy.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32) && defined(EZNES_BUILD_DLL)
+#define EZNES_API __declspec(dllexport)
+#else
+#define EZNES_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct eznes eznes;
+typedef struct eznes_forked_state eznes_forked_state;
+
+#define EZNES_RAM_SIZE 0x800
+#define EZNES_FRAME_WIDTH 256
+#define EZNES_FRAME_HEIGHT 240
+
+// Flags for eznes_create
+#define EZNES_FAST_PATHS 0x1  // Block cache, recompiler and idle loop skipping, same results just faster
+#define EZNES_LINE_HASHES 0x2  // Hash every line as it is drawn, needed by eznes_get_frame_hash and eznes_get_dirty_lines
+
+// Buttons for eznes_step, one bit each
+#define EZNES_RIGHT 0x01
+#define EZNES_LEFT 0x02
+#define EZNES_DOWN 0x04
+#define EZNES_UP 0x08
+#define EZNES_START 0x10
+#define EZNES_SELECT 0x20
+#define EZNES_B 0x40
+#define EZNES_A 0x80
+
+// Functions returning int give 0 on success
+EZNES_API eznes* eznes_create(const char* rom_path, uint32_t flags);  // NULL if the ROM can not be loaded
+EZNES_API void eznes_destroy(eznes* env);  // Destroying the last environment also stops the log thread
+EZNES_API void eznes_reset(eznes* env);  // Back to the state right after eznes_create
+EZNES_API void eznes_step(eznes* env, uint8_t buttons);  // Runs one frame with the buttons held on controller 1
+EZNES_API uint64_t eznes_get_frame_count(eznes* env);
+
+EZNES_API const uint8_t* eznes_get_ram(eznes* env);  // EZNES_RAM_SIZE bytes at $0000
+EZNES_API const uint32_t* eznes_get_frame(eznes* env);  // EZNES_FRAME_HEIGHT rows of EZNES_FRAME_WIDTH 0xRRGGBBAA pixels
+
+// Indexed output has one byte per pixel holding the 6 bit NES colour, eznes_get_palette converts them to RGBA.
+// The emphasis bits of PPUMASK come once per line. Turning rgba off stops eznes_get_frame from updating.
+EZNES_API void eznes_set_output(eznes* env, int rgba, int indexed);
+EZNES_API const uint8_t* eznes_get_indexed_frame(eznes* env);  // EZNES_FRAME_HEIGHT rows of EZNES_FRAME_WIDTH bytes
+EZNES_API const uint8_t* eznes_get_line_emphasis(eznes* env);  // EZNES_FRAME_HEIGHT values of 0-7
+EZNES_API void eznes_get_palette(eznes* env, uint32_t palette[64]);
+
+// Hashes of the last frame taken while it was drawn, from the indexed output when it is on. Equal frames
+// have equal hashes within one process. dirty has a bit per line, set for lines that changed from the frame before.
+// Both need EZNES_LINE_HASHES, without it the hash stays 0 and no line is dirty.
+EZNES_API uint64_t eznes_get_frame_hash(eznes* env);
+EZNES_API void eznes_get_dirty_lines(eznes* env, uint8_t dirty[EZNES_FRAME_HEIGHT / 8]);
+
+// Optional smaller observation filled in while the frame is drawn. scale is 1, 2, 4 or 8, 0 turns it off.
+// Rows of width pixels with channels bytes each, 1 for greyscale and 3 for RGB.
+EZNES_API int eznes_set_observation(eznes* env, uint32_t scale, int greyscale);
+EZNES_API const uint8_t* eznes_get_observation(eznes* env, uint32_t* width, uint32_t* height, uint32_t* channels);
+
+// Hot path event counts since eznes_create, only taken in builds with EZNES_COUNTERS and zero otherwise.
+// Copies up to count values and returns how many counters there are.
+EZNES_API size_t eznes_get_counters(eznes* env, uint64_t* values, size_t count);
+EZNES_API const char* eznes_get_counter_name(size_t index);
+
+EZNES_API size_t eznes_state_size(eznes* env);
+EZNES_API int eznes_save_state(eznes* env, void* buffer, size_t size);  // size has to be at least eznes_state_size
+EZNES_API int eznes_load_state(eznes* env, const void* buffer, size_t size);
+EZNES_API uint32_t eznes_get_state_hash(eznes* env);  // CRC32 of the registers, RAM and PPU memory, equal for equal states
+
+// Saved states for tree search. A fork shares what did not change with the parent it was taken from, so
+// branching from one position only stores what each branch changed. Forks are immutable and can be restored
+// into any environment of the same ROM, from any thread. The parent may be freed before its children.
+EZNES_API eznes_forked_state* eznes_fork(eznes* env, const eznes_forked_state* parent);  // parent may be NULL
+EZNES_API int eznes_restore_fork(eznes* env, const eznes_forked_state* fork);
+EZNES_API size_t eznes_fork_own_size(const eznes_forked_state* fork);  // Bytes not shared with the parent
+EZNES_API void eznes_free_fork(eznes_forked_state* fork);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,40 @@
+#include <string.h>
+
+#include "forked_state.h"
+
+
+// The flat state is put together in here, one per thread because states are shared between threads
+static uint8_t* GetScratch(size_t size) {
+    static thread_local std::vector<uint8_t> scratch;
+    if (scratch.size() < size) scratch.resize(size);
+    return &scratch[0];
+}
+
+ForkedState::ForkedState(const Console& console, const ForkedState* parent) {
+    size = console.GetStateSize();
+    const size_t padded = ((size + PAGE_SIZE - 1) / PAGE_SIZE) * PAGE_SIZE;
+    uint8_t* data = GetScratch(padded);
+    console.SaveState(data, size);
+    memset(data + size, 0, padded - size);  // Zero padded so every page is whole
+
+    const bool share = parent && parent->size == size;
+    pages.resize(padded / PAGE_SIZE);
+    for (size_t i = 0; i < pages.size(); ++i) {
+        const uint8_t* bytes = &data[i * PAGE_SIZE];
+        if (share && !memcmp(parent->pages[i]->data(), bytes, PAGE_SIZE)) {
+            pages[i] = parent->pages[i];
+            continue;
+        }
+        std::shared_ptr<Page> page = std::make_shared<Page>();
+        memcpy(page->data(), bytes, PAGE_SIZE);
+        pages[i] = page;
+        ++own_pages;
+    }
+}
+
+bool ForkedState::Restore(Console& console) const {
+    if (IsEmpty()) return true;
+    uint8_t* data = GetScratch(pages.size() * PAGE_SIZE);
+    for (size_t i = 0; i < pages.size(); ++i) memcpy(data + i * PAGE_SIZE, pages[i]->data(), PAGE_SIZE);
+    return console.LoadState(data, size);
+}
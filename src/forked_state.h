@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+#include <array>
+#include <memory>
+#include <vector>
+
+#include "console.h"
+
+
+// A save state cut into pages. Pages that are the same as in the state it was forked from are shared with
+// that one instead of copied, so a search tree branching from one position only pays for what each branch
+// changed. States are immutable once taken and can be shared between threads.
+class ForkedState {
+public:
+    static constexpr size_t PAGE_SIZE = 0x100;
+
+    ForkedState() = default;
+    ForkedState(const Console& console, const ForkedState* parent);  // parent may be null for a root
+    bool Restore(Console& console) const;
+    inline bool IsEmpty() const { return pages.empty(); }
+    inline size_t GetOwnSize() const { return own_pages * PAGE_SIZE; }  // Bytes not shared with the parent
+
+private:
+    typedef std::array<uint8_t, PAGE_SIZE> Page;
+
+    std::vector<std::shared_ptr<const Page>> pages{};
+    size_t size{};
+    size_t own_pages{};
+};
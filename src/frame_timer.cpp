@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <algorithm>
+
+#include "frame_timer.h"
+
+
+FrameTimer::FrameTimer() {
+    for (std::vector<float>& samples : history) samples.assign(HISTORY_SIZE, 0.0f);
+}
+
+void FrameTimer::EndFrame() {
+    for (int i = 0; i < SECTION_COUNT; ++i) {
+        history[i][next] = current[i];
+        current[i] = 0.0f;
+    }
+    next = (next + 1) % HISTORY_SIZE;
+    if (sample_count < HISTORY_SIZE) ++sample_count;
+    ++frame_number;
+}
+
+void FrameTimer::Reset() {
+    for (int i = 0; i < SECTION_COUNT; ++i) {
+        std::fill(history[i].begin(), history[i].end(), 0.0f);
+        current[i] = 0.0f;
+    }
+    next = 0;
+    sample_count = 0;
+    frame_number = 0;
+}
+
+float FrameTimer::GetPercentile(Section section, float fraction) const {
+    if (!sample_count) return 0.0f;
+    const std::vector<float>& samples = history[static_cast<int>(section)];
+    std::vector<float> sorted(samples.begin(), samples.begin() + sample_count);  // The ring only fills from the front
+    const size_t rank = std::min(static_cast<size_t>(fraction * sample_count), static_cast<size_t>(sample_count - 1));
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    return sorted[rank];
+}
+
+float FrameTimer::GetMax(Section section) const {
+    const std::vector<float>& samples = history[static_cast<int>(section)];
+    return sample_count ? *std::max_element(samples.begin(), samples.begin() + sample_count) : 0.0f;
+}
+
+const char* FrameTimer::GetSectionName(Section section) {
+    switch (section) {
+    case Section::emulation: return "emulation";
+    case Section::viewers: return "viewers";
+    case Section::upload: return "upload";
+    case Section::capture: return "capture";
+    case Section::ui: return "ui";
+    case Section::frame: return "frame";
+    default: return "unknown";
+    }
+}
+
+bool FrameTimer::WriteCsv(const std::string& location) const {
+    FILE* file = nullptr;
+    if (fopen_s(&file, location.c_str(), "w")) return true;
+
+    fprintf(file, "frame");
+    for (int i = 0; i < SECTION_COUNT; ++i) fprintf(file, ",%s_ms", GetSectionName(static_cast<Section>(i)));
+    fprintf(file, "\n");
+    for (uint32_t n = 0; n < sample_count; ++n) {
+        const uint32_t index = (GetHistoryOffset() + n) % HISTORY_SIZE;
+        fprintf(file, "%llu", static_cast<unsigned long long>(frame_number - sample_count + n));
+        for (int i = 0; i < SECTION_COUNT; ++i) fprintf(file, ",%.3f", history[i][index]);
+        fprintf(file, "\n");
+    }
+
+    bool error = ferror(file) != 0;
+    error |= fclose(file) != 0;
+    return error;
+}
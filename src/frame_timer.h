@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+
+// Wall time spent per section in each host frame, kept for the last HISTORY_SIZE frames. A section can be
+// timed more than once per frame, the times add up. Percentiles and the CSV come from the kept history.
+class FrameTimer {
+public:
+    static constexpr uint32_t HISTORY_SIZE = 600;  // Ten seconds at 60 Hz
+
+    enum class Section {
+        emulation = 0,  // CPU and PPU, they are interleaved dot by dot and can't be told apart cheaply
+        viewers,        // Redrawing the debug viewers
+        upload,         // Texture uploads
+        capture,        // Copying frames out for recording and screenshots
+        ui,             // Building and drawing the interface
+        frame,          // The whole host frame, including the wait for vsync
+        count
+    };
+
+    FrameTimer();
+    inline void Begin(Section section) { starts[static_cast<int>(section)] = Clock::now(); }
+    inline void End(Section section) {
+        const int i = static_cast<int>(section);
+        current[i] += std::chrono::duration<float, std::milli>(Clock::now() - starts[i]).count();
+    }
+    void EndFrame();  // Keeps the sums as one sample and starts the next
+    void Reset();
+
+    inline uint32_t GetSampleCount() const { return sample_count; }
+    inline const float* GetHistory(Section section) const { return history[static_cast<int>(section)].data(); }  // Milliseconds
+    inline uint32_t GetHistoryOffset() const { return sample_count < HISTORY_SIZE ? 0 : next; }  // Index of the oldest sample
+    float GetPercentile(Section section, float fraction) const;
+    float GetMax(Section section) const;
+    static const char* GetSectionName(Section section);
+    bool WriteCsv(const std::string& location) const;  // Oldest sample first
+
+private:
+    typedef std::chrono::steady_clock Clock;
+    static constexpr int SECTION_COUNT = static_cast<int>(Section::count);
+
+    Clock::time_point starts[SECTION_COUNT]{};
+    float current[SECTION_COUNT]{};
+    std::vector<float> history[SECTION_COUNT]{};
+    uint32_t next{}, sample_count{};
+    uint64_t frame_number{};  // Of the next sample
+};
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Much faster than Crc32, for change detection within one run only. seed goes in as if it were more input,
+// for a value that belongs with the data but is not stored next to it.
+uint64_t Hash64(const uint8_t* data, size_t size, uint64_t seed = 0);
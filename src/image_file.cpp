@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "archive.h"
+#include "image_file.h"
+
+
+namespace {
+
+// DEFLATE writes its bits least significant first, the Huffman codes go in reversed
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : out(out) {}
+
+    void Put(uint32_t value, int count) {
+        bits |= value << bit_count;
+        bit_count += count;
+        while (bit_count >= 8) {
+            out.push_back(static_cast<uint8_t>(bits));
+            bits >>= 8;
+            bit_count -= 8;
+        }
+    }
+
+    void PutCode(uint32_t code, int length) {
+        uint32_t reversed = 0;
+        for (int i = 0; i < length; ++i) reversed |= ((code >> i) & 1) << (length - 1 - i);
+        Put(reversed, length);
+    }
+
+    void Flush() {
+        if (bit_count) out.push_back(static_cast<uint8_t>(bits));
+        bits = 0;
+        bit_count = 0;
+    }
+
+private:
+    std::vector<uint8_t>& out;
+    uint32_t bits{};
+    int bit_count{};
+};
+
+const uint16_t length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const uint8_t length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const uint16_t distance_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+                                     4097, 6145, 8193, 12289, 16385, 24577 };
+const uint8_t distance_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+void PutLiteral(BitWriter& writer, uint32_t symbol) {  // The fixed code from RFC 1951 3.2.6
+    if (symbol < 144) writer.PutCode(0x30 + symbol, 8);
+    else if (symbol < 256) writer.PutCode(0x190 + symbol - 144, 9);
+    else if (symbol < 280) writer.PutCode(symbol - 256, 7);
+    else writer.PutCode(0xC0 + symbol - 280, 8);
+}
+
+void PutMatch(BitWriter& writer, uint32_t length, uint32_t distance) {
+    int code = 28;
+    while (length_base[code] > length) --code;
+    PutLiteral(writer, 257 + code);
+    writer.Put(length - length_base[code], length_extra[code]);
+    code = 29;
+    while (distance_base[code] > distance) --code;
+    writer.PutCode(code, 5);
+    writer.Put(distance - distance_base[code], distance_extra[code]);
+}
+
+// One final block with the fixed codes. Matches come from hash chains over the last 32 KB, cut short after
+// a few candidates, the frames repeat whole tiles and lines so the first hits are usually long ones.
+void Deflate(const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    constexpr uint32_t WINDOW = 0x8000, HASH_SIZE = 0x8000, MAX_CHAIN = 16, MIN_MATCH = 3, MAX_MATCH = 258;
+    std::vector<int32_t> head(HASH_SIZE, -1), prev(WINDOW, -1);
+    auto hash = [data](size_t pos) { return ((data[pos] << 10) ^ (data[pos + 1] << 5) ^ data[pos + 2]) & (HASH_SIZE - 1); };
+    auto insert = [&](size_t pos) {
+        const uint32_t h = hash(pos);
+        prev[pos & (WINDOW - 1)] = head[h];
+        head[h] = static_cast<int32_t>(pos);
+    };
+
+    BitWriter writer(out);
+    writer.Put(1, 1);  // Final block
+    writer.Put(1, 2);  // Fixed codes
+    size_t pos = 0;
+    while (pos < size) {
+        uint32_t best_length = 0, best_distance = 0;
+        if (pos + MIN_MATCH <= size) {
+            const size_t limit = size - pos < MAX_MATCH ? size - pos : MAX_MATCH;
+            int32_t candidate = head[hash(pos)];
+            for (uint32_t chain = 0; candidate >= 0 && pos - candidate <= WINDOW && chain < MAX_CHAIN; ++chain) {
+                uint32_t length = 0;
+                while (length < limit && data[candidate + length] == data[pos + length]) ++length;
+                if (length > best_length) {
+                    best_length = length;
+                    best_distance = static_cast<uint32_t>(pos - candidate);
+                    if (length == limit) break;
+                }
+                candidate = prev[candidate & (WINDOW - 1)];
+            }
+        }
+
+        if (best_length >= MIN_MATCH) {
+            PutMatch(writer, best_length, best_distance);
+            for (uint32_t i = 0; i < best_length; ++i, ++pos) {
+                if (pos + MIN_MATCH <= size) insert(pos);
+            }
+        }
+        else {
+            PutLiteral(writer, data[pos]);
+            if (pos + MIN_MATCH <= size) insert(pos);
+            ++pos;
+        }
+    }
+    PutLiteral(writer, 256);  // End of block
+    writer.Flush();
+}
+
+uint32_t Adler32(const uint8_t* data, size_t size) {
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < size; ++i) {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+void PutBE32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) out.push_back(static_cast<uint8_t>(value >> shift));
+}
+
+void PutChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data) {
+    PutBE32(out, static_cast<uint32_t>(data.size()));
+    const size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    PutBE32(out, Crc32(0, &out[start], out.size() - start));
+}
+
+}  // namespace
+
+void EncodePng(const uint32_t* pixels, uint32_t width, uint32_t height, std::vector<uint8_t>& out) {
+    const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    out.insert(out.end(), &signature[0], &signature[8]);
+
+    std::vector<uint8_t> header;
+    PutBE32(header, width);
+    PutBE32(header, height);
+    header.insert(header.end(), { 8, 2, 0, 0, 0 });  // 8 bit RGB, deflate, no interlacing
+    PutChunk(out, "IHDR", header);
+
+    // Every line starts with filter 0, the raw pixels compress well enough as they are
+    std::vector<uint8_t> raw;
+    raw.reserve(height * (width * 3 + 1));
+    for (uint32_t y = 0; y < height; ++y) {
+        raw.push_back(0);
+        for (uint32_t x = 0; x < width; ++x) {
+            const uint32_t pixel = pixels[y * width + x];
+            raw.push_back(static_cast<uint8_t>(pixel >> 24));
+            raw.push_back(static_cast<uint8_t>(pixel >> 16));
+            raw.push_back(static_cast<uint8_t>(pixel >> 8));
+        }
+    }
+    std::vector<uint8_t> compressed = { 0x78, 0x01 };  // zlib header, 32 KB window
+    Deflate(raw.data(), raw.size(), compressed);
+    PutBE32(compressed, Adler32(raw.data(), raw.size()));
+    PutChunk(out, "IDAT", compressed);
+    PutChunk(out, "IEND", std::vector<uint8_t>());
+}
+
+bool WriteImage(const std::string& location, const uint32_t* pixels, uint32_t width, uint32_t height) {
+    std::vector<uint8_t> data;
+    const size_t dot = location.find_last_of('.');
+    if (dot != std::string::npos && location.substr(dot) == ".ppm") {
+        char header[32];
+        const int length = snprintf(&header[0], sizeof(header), "P6\n%u %u\n255\n", width, height);
+        data.assign(&header[0], &header[length]);
+        for (size_t i = 0; i < static_cast<size_t>(width) * height; ++i) {
+            data.push_back(static_cast<uint8_t>(pixels[i] >> 24));
+            data.push_back(static_cast<uint8_t>(pixels[i] >> 16));
+            data.push_back(static_cast<uint8_t>(pixels[i] >> 8));
+        }
+    }
+    else EncodePng(pixels, width, height, data);
+
+    FILE* file = nullptr;
+    if (fopen_s(&file, location.c_str(), "wb")) return true;
+    bool error = fwrite(data.data(), 1, data.size(), file) != data.size();
+    error |= fclose(file) != 0;
+    return error;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+// Pixels are 0xRRGGBBAA like the PPU output, the alpha is dropped. The PNG is compressed with fixed Huffman
+// codes and a short match search, which gets NES frames to a few KB without holding up a worker for long.
+void EncodePng(const uint32_t* pixels, uint32_t width, uint32_t height, std::vector<uint8_t>& out);  // Appends to out
+bool WriteImage(const std::string& location, const uint32_t* pixels, uint32_t width, uint32_t height);  // Binary PPM for .ppm, otherwise PNG
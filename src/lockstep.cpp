@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "lockstep.h"
+
+
+bool Lockstep::Start(const Console& source, const Options& options) {
+    Stop();
+    reference.reset(new Console);
+    test.reset(new Console);
+    reference->memory.use_save_file = false;  // Both would map the same file and see each other's writes
+    test->memory.use_save_file = false;
+    if (reference->LoadROM(source) || test->LoadROM(source)) {
+        Stop();
+        return true;
+    }
+
+    reference->memory.write_log = &reference_writes;
+    test->memory.write_log = &test_writes;
+    reference->cpu.trace_enabled = true;
+    reference->ppu.line_hashing = test->ppu.line_hashing = true;
+    test->cpu.block_cache_enabled = options.block_cache;
+    test->cpu.dynarec_enabled = options.dynarec;
+    test->cpu.idle_skip_enabled = options.idle_skip;
+    log_helper.AddLog("\nLockstep comparison started\n", LogCategory::cpu, LogLevel::info);
+    return false;
+}
+
+void Lockstep::Stop() {
+    reference.reset();
+    test.reset();
+    reference_writes.clear();
+    test_writes.clear();
+    diverged = false;
+    frames = 0;
+    report.clear();
+}
+
+bool Lockstep::RunFrame(const std::bitset<8> controller[2]) {
+    if (!IsRunning() || diverged) return diverged;
+    for (int i = 0; i < 2; ++i) reference->memory.controller[i] = test->memory.controller[i] = controller[i];
+
+    while (!test->ppu.frame_done) {
+        const uint16_t block_pc = test->cpu.pc;
+        reference_writes.clear();
+        test_writes.clear();
+        test->Step();
+        while (reference->cpu.instruction_count < test->cpu.instruction_count) reference->Step();
+        if (Compare(block_pc)) return true;
+    }
+    if (ComparePpuMemory()) return true;
+    test->ppu.frame_done = false;
+    reference->ppu.frame_done = false;
+    ++frames;
+    return false;
+}
+
+// Both consoles are at the same instruction count, which also puts their PPUs on the same dot
+bool Lockstep::Compare(const uint16_t block_pc) {
+    const Cpu& ref = reference->cpu;
+    const Cpu& fast = test->cpu;
+    char line[128], name[16];
+    std::string differences;
+    auto compare = [&](const char* name, uint64_t expected, uint64_t actual) {
+        if (expected == actual) return;
+        snprintf(&line[0], sizeof(line), "  %-12s %12llX %12llX\n", name, static_cast<unsigned long long>(expected), static_cast<unsigned long long>(actual));
+        differences += &line[0];
+    };
+    auto compare_bytes = [&](const char* format, uint32_t base, const uint8_t* expected, const uint8_t* actual, uint32_t size) {
+        if (!memcmp(expected, actual, size)) return;
+        for (uint32_t i = 0; i < size; ++i) {
+            if (expected[i] == actual[i]) continue;
+            snprintf(&name[0], sizeof(name), format, base + i);
+            compare(&name[0], expected[i], actual[i]);
+        }
+    };
+
+    compare("instructions", ref.instruction_count, fast.instruction_count);
+    compare("PC", ref.pc, fast.pc);
+    compare("A", ref.A, fast.A);
+    compare("X", ref.X, fast.X);
+    compare("Y", ref.Y, fast.Y);
+    compare("P", ref.flags.to_ulong(), fast.flags.to_ulong());
+    compare("SP", ref.sp, fast.sp);
+    compare("cycles", ref.cycles, fast.cycles);
+    compare("open bus", reference->memory.open_bus, test->memory.open_bus);
+    compare("scanline", static_cast<uint16_t>(reference->ppu.GetScanline()), static_cast<uint16_t>(test->ppu.GetScanline()));
+    compare("dot", static_cast<uint16_t>(reference->ppu.GetCycle()), static_cast<uint16_t>(test->ppu.GetCycle()));
+
+    const Ppu::Registers ref_ppu = reference->ppu.GetRegisters();
+    const Ppu::Registers fast_ppu = test->ppu.GetRegisters();
+    compare("PPU v", ref_ppu.v, fast_ppu.v);
+    compare("PPU t", ref_ppu.t, fast_ppu.t);
+    compare("PPU x", ref_ppu.x, fast_ppu.x);
+    compare("PPU w", ref_ppu.w, fast_ppu.w);
+    compare("PPUCTRL", ref_ppu.ctrl, fast_ppu.ctrl);
+    compare("PPUMASK", ref_ppu.mask, fast_ppu.mask);
+    compare("PPUSTATUS", ref_ppu.status, fast_ppu.status);
+    compare("OAMADDR", ref_ppu.oam_addr, fast_ppu.oam_addr);
+    compare("PPU buffer", ref_ppu.read_buffer, fast_ppu.read_buffer);
+    compare("PPU latch", ref_ppu.io_latch, fast_ppu.io_latch);
+    compare_bytes("OAM $%02X", 0, reference->ppu.GetOam(), test->ppu.GetOam(), 0x100);
+    compare_bytes("RAM $%04X", 0, reference->memory.GetRam(), test->memory.GetRam(), Memory::RAM_SIZE);
+    compare_bytes("RAM $%04X", 0x6000, reference->memory.GetPrgRam(), test->memory.GetPrgRam(), Memory::PRG_RAM_SIZE);
+
+    char expected[16], actual[16];
+    for (size_t i = 0; i < reference_writes.size() || i < test_writes.size(); ++i) {
+        const MemoryWrite* ref_write = i < reference_writes.size() ? &reference_writes[i] : nullptr;
+        const MemoryWrite* fast_write = i < test_writes.size() ? &test_writes[i] : nullptr;
+        if (ref_write && fast_write && ref_write->addr == fast_write->addr && ref_write->byte == fast_write->byte) continue;
+        if (ref_write) snprintf(&expected[0], sizeof(expected), "$%04X=%02X", ref_write->addr, ref_write->byte);
+        else snprintf(&expected[0], sizeof(expected), "none");
+        if (fast_write) snprintf(&actual[0], sizeof(actual), "$%04X=%02X", fast_write->addr, fast_write->byte);
+        else snprintf(&actual[0], sizeof(actual), "none");
+        snprintf(&name[0], sizeof(name), "write %u", static_cast<unsigned>(i));
+        snprintf(&line[0], sizeof(line), "  %-12s %12s %12s\n", &name[0], &expected[0], &actual[0]);
+        differences += &line[0];
+    }
+    if (differences.empty()) return false;
+
+    diverged = true;
+    snprintf(&line[0], sizeof(line), "Divergence in frame %llu after %llu instructions, the fast core's step started at $%04X\n",
+             static_cast<unsigned long long>(frames), static_cast<unsigned long long>(ref.instruction_count), block_pc);
+    report = &line[0];
+    report += "  field           reference         fast\n";
+    report += differences;
+    WriteExcerpt();
+    log_helper.AddLog("\n" + report, LogCategory::cpu, LogLevel::error);
+    return true;
+}
+
+// PPU memory is only written through PPUDATA, whose writes are compared every step, so looking at all of it once
+// a frame is enough. The frames are compared by hash.
+bool Lockstep::ComparePpuMemory() {
+    if (reference->ppu.GetFrameHash() != test->ppu.GetFrameHash()) {
+        int line = 0;
+        while (reference->ppu.GetLineHash(line) == test->ppu.GetLineHash(line)) ++line;
+        char line_text[128];
+        snprintf(&line_text[0], sizeof(line_text), "Divergence in the picture at line %d in frame %llu\n", line, static_cast<unsigned long long>(frames));
+        diverged = true;
+        report = &line_text[0];
+        WriteExcerpt();
+        log_helper.AddLog("\n" + report, LogCategory::ppu, LogLevel::error);
+        return true;
+    }
+
+    const std::vector<uint8_t>& ref = reference->ppu.ppu_memory;
+    const std::vector<uint8_t>& fast = test->ppu.ppu_memory;
+    if (ref == fast) return false;
+
+    size_t addr = 0;
+    while (ref[addr] == fast[addr]) ++addr;
+    char line[128];
+    snprintf(&line[0], sizeof(line), "Divergence in PPU memory at $%04X in frame %llu: %02X on the reference, %02X on the fast core\n",
+             static_cast<unsigned>(addr), static_cast<unsigned long long>(frames), ref[addr], fast[addr]);
+    diverged = true;
+    report = &line[0];
+    WriteExcerpt();
+    log_helper.AddLog("\n" + report, LogCategory::ppu, LogLevel::error);
+    return true;
+}
+
+void Lockstep::WriteExcerpt() {
+    const TraceBuffer& trace = reference->cpu.trace;
+    const uint32_t count = trace.GetCount();
+    const uint32_t first = count > EXCERPT_SIZE ? count - EXCERPT_SIZE : 0;
+    char line[Disassembler::LINE_SIZE];
+    report += "Reference trace:\n";
+    for (uint32_t i = first; i < count; ++i) {
+        int length = Disassembler::Format(trace.Get(i), &line[0], sizeof(line));
+        report.append("  ").append(&line[0], length).append("\n");
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <bitset>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "console.h"
+
+
+// Runs a console on the plain interpreter next to one using the fast paths and compares the two after every
+// instruction, or every block when the fast one runs several at once. The CPU and PPU registers, OAM, RAM and
+// every write that went to I/O, the mapper or battery RAM during the step are compared. Stops at the first
+// difference and keeps a report with the reference's trace leading up to it.
+class Lockstep {
+public:
+    static constexpr uint32_t EXCERPT_SIZE = 32;  // Traced instructions shown in the report
+
+    struct Options {
+        bool block_cache = true;
+        bool dynarec = true;
+        bool idle_skip = true;
+    };
+
+    bool Start(const Console& source, const Options& options);  // Loads the ROM source is running
+    void Stop();
+    bool RunFrame(const std::bitset<8> controller[2]);  // Returns true once the consoles have diverged
+    inline bool IsRunning() const { return reference != nullptr; }
+    inline bool HasDiverged() const { return diverged; }
+    inline uint64_t GetInstructionCount() const { return reference ? reference->cpu.instruction_count : 0; }
+    inline uint64_t GetFrameCount() const { return frames; }
+    inline const std::string& GetReport() const { return report; }
+
+private:
+    bool Compare(uint16_t block_pc);
+    bool ComparePpuMemory();
+    void WriteExcerpt();
+
+    std::unique_ptr<Console> reference{}, test{};
+    std::vector<MemoryWrite> reference_writes{}, test_writes{};  // Of the current step
+    bool diverged = false;
+    uint64_t frames{};
+    std::string report = "";
+};
@@ -1,15 +1,175 @@
+#include <string.h>
+#include <chrono>
+
+#include "imgui/imgui.h"
+
 #include "log.h"
 
 
-void Logging::AddLog(std::string entry) {
-    if (buff.size() > 0x10000) buff.clear();
-    last_message = entry;
-    buff.append(entry.c_str());
+Logging::Logging() : records(new Record[CAPACITY]) {
+    for (uint32_t i = 0; i < CAPACITY; ++i) records[i].sequence.store(i, std::memory_order_relaxed);
+    for (auto& level : levels) level.store(LogLevel::info, std::memory_order_relaxed);
+}
+
+Logging::~Logging() {
+    Stop();
+    CloseFile();
+}
+
+void Logging::Stop() {
+    std::unique_lock<std::mutex> lock(wake_mutex);
+    if (!running.load() || stop) return;
+    stop = true;
+    wake.notify_one();
+    lock.unlock();
+    consumer.join();
+
+    lock.lock();
+    consumer = std::thread();
+    stop = false;
+    running.store(false);
+    drained.notify_all();
+}
+
+void Logging::Start() {
+    std::lock_guard<std::mutex> lock(wake_mutex);
+    if (running.load()) return;
+    running.store(true);
+    consumer = std::thread(&Logging::ConsumerThread, this);
+}
+
+void Logging::AddLog(const char* entry, LogCategory category, LogLevel level) {
+    if (!IsEnabled(category, level)) return;
+
+    // Messages longer than a record are split, the pieces stay in order unless another thread logs in between
+    size_t length = strlen(entry);
+    do {
+        uint64_t position;
+        Record* record = Claim(position);
+        if (!record) return;
+
+        size_t chunk = length < PAYLOAD_SIZE ? length : PAYLOAD_SIZE;
+        memcpy(&record->payload[0], entry, chunk);
+        record->format = nullptr;
+        record->category = category;
+        record->level = level;
+        record->length = static_cast<uint8_t>(chunk);
+        Publish(record, position);
+
+        entry += chunk;
+        length -= chunk;
+    } while (length > 0);
+}
+
+void Logging::AddLog(const std::string& entry, LogCategory category, LogLevel level) {
+    AddLog(entry.c_str(), category, level);
+}
+
+// Bounded MPMC queue by Dmitry Vyukov, every slot carries a sequence number telling whose turn it is
+Logging::Record* Logging::Claim(uint64_t& position) {
+    position = enqueue_pos.load(std::memory_order_relaxed);
+    while (true) {
+        Record* record = &records[position & (CAPACITY - 1)];
+        int64_t diff = static_cast<int64_t>(record->sequence.load(std::memory_order_acquire) - position);
+        if (diff == 0) {
+            if (enqueue_pos.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) return record;
+        }
+        else if (diff < 0) {  // The consumer is a full lap behind
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        else position = enqueue_pos.load(std::memory_order_relaxed);
+    }
+}
+
+const char* Logging::GetCategoryName(LogCategory category) {
+    static const char* names[] = {"General", "CPU", "PPU", "Memory", "I/O"};
+    return names[static_cast<int>(category)];
+}
+
+// Going to sleep announces it first and then looks at the queue once more. A producer publishes and then
+// looks at the flag, so with the fences in between at least one of them sees the other. The producer's
+// notify can still land just before the wait starts, the timeout bounds how late that makes the message.
+void Logging::ConsumerThread() {
+    while (true) {
+        while (Consume()) {}
+        std::unique_lock<std::mutex> lock(wake_mutex);
+        drained.notify_all();
+        if (stop && !HasPending()) break;  // Only after a final pass, so nothing queued before Stop is lost
+        sleeping.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!HasPending() && !stop) wake.wait_for(lock, std::chrono::milliseconds(5));
+        sleeping.store(false);
+    }
+}
+
+bool Logging::Consume() {
+    Record& record = records[dequeue_pos & (CAPACITY - 1)];
+    if (record.sequence.load(std::memory_order_acquire) != dequeue_pos + 1) return false;
+
+    char line[512];
+    size_t length;
+    if (record.format) {
+        int result = record.format(&record.payload[0], &line[0], sizeof(line));
+        length = result < 0 ? 0 : (static_cast<size_t>(result) < sizeof(line) ? result : sizeof(line) - 1);
+    }
+    else {
+        length = record.length;
+        memcpy(&line[0], &record.payload[0], length);
+    }
+
+    record.sequence.store(dequeue_pos + CAPACITY, std::memory_order_release);
+    ++dequeue_pos;
+
+    uint32_t lost = dropped.exchange(0, std::memory_order_relaxed);
+    if (lost) {
+        char notice[64];
+        int notice_length = snprintf(&notice[0], sizeof(notice), "\n[%u log messages dropped]\n", lost);
+        Append(&notice[0], notice_length);
+    }
+    Append(&line[0], length);
+    consumed_pos.store(dequeue_pos, std::memory_order_release);
+    return true;
+}
+
+void Logging::Append(const char* entry, size_t length) {
+    std::lock_guard<std::mutex> lock(text_mutex);
+    if (text.size() + length > TEXT_LIMIT) {
+        size_t cut = text.find('\n', text.size() / 2);
+        text.erase(0, cut == std::string::npos ? text.size() : cut + 1);
+    }
+    text.append(entry, length);
+    last_message.assign(entry, length);
+    if (file) fwrite(entry, 1, length, file);
     if (scroll_enabled) scroll_to_bottom = true;
 }
 
+bool Logging::OpenFile(const std::string& location) {
+    std::lock_guard<std::mutex> lock(text_mutex);
+    if (file) fclose(file);
+    file = nullptr;
+    return fopen_s(&file, location.c_str(), "w") != 0;
+}
+
+void Logging::CloseFile() {
+    std::lock_guard<std::mutex> lock(text_mutex);
+    if (file) fclose(file);
+    file = nullptr;
+}
+
+void Logging::Flush() {
+    const uint64_t target = enqueue_pos.load(std::memory_order_acquire);
+    {
+        std::unique_lock<std::mutex> lock(wake_mutex);
+        drained.wait(lock, [this, target]() { return consumed_pos.load(std::memory_order_acquire) >= target || !running.load(); });
+    }
+    std::lock_guard<std::mutex> lock(text_mutex);
+    if (file) fflush(file);
+}
+
 void Logging::Clear() {
-    buff.clear();
+    std::lock_guard<std::mutex> lock(text_mutex);
+    text.clear();
 }
 
 void Logging::Draw(bool *show_log_window) {
@@ -18,22 +178,40 @@ void Logging::Draw(bool *show_log_window) {
         return;
     }
 
+    if (ImGui::CollapsingHeader("Levels")) {
+        static const char* level_names[] = {"Debug", "Info", "Warning", "Error", "Off"};
+        for (int i = 0; i < static_cast<int>(LogCategory::count); ++i) {
+            LogCategory category = static_cast<LogCategory>(i);
+            int level = static_cast<int>(GetLevel(category));
+            ImGui::PushID(i);
+            ImGui::PushItemWidth(100.0f);
+            if (ImGui::Combo(GetCategoryName(category), &level, level_names, IM_ARRAYSIZE(level_names))) {
+                SetLevel(category, static_cast<LogLevel>(level));
+            }
+            ImGui::PopItemWidth();
+            ImGui::PopID();
+            if (i % 3 != 2) ImGui::SameLine();
+        }
+        ImGui::NewLine();
+    }
+
     ImGui::Separator();
     ImGui::BeginChild("scrolling", ImVec2(0, 0), false, ImGuiWindowFlags_HorizontalScrollbar);
 
-    const char* buff_begin = buff.begin();
-    const char* buff_end = buff.end();
-
-    ImGui::TextUnformatted(buff_begin, buff_end);
-
-    if (scroll_to_bottom) ImGui::SetScrollHereY(1.0f);
-    scroll_to_bottom = false;
+    {
+        std::lock_guard<std::mutex> lock(text_mutex);
+        ImGui::TextUnformatted(text.data(), text.data() + text.size());
+        if (scroll_to_bottom) ImGui::SetScrollHereY(1.0f);
+        scroll_to_bottom = false;
+    }
     ImGui::EndChild();
     ImGui::End();
 }
 
 std::string Logging::GetLastMessage() {
+    std::lock_guard<std::mutex> lock(text_mutex);
     return last_message;
 }
 
-Logging log_helper;
+// Deliberately leaked, a static destructor would join the consumer under the loader lock when a DLL is unloaded
+Logging& log_helper = *new Logging;
@@ -1,23 +1,148 @@
 #pragma once
 
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
-#include "imgui/imgui.h"
 
+enum class LogCategory : uint8_t {
+    general = 0, cpu, ppu, memory, io,
+    count
+};
+
+enum class LogLevel : uint8_t {
+    debug = 0, info, warning, error,
+    off
+};
 
+// Producers on any thread push fixed-size records into a bounded lock-free queue, formatting is
+// deferred to a consumer thread. Producers never lock or allocate, when the queue is full the record is
+// dropped and counted instead. A consumer asleep on an empty queue is notified without the mutex, it also
+// wakes up on its own every few milliseconds in case that was missed. The consumer runs from Start to
+// Stop, messages logged outside of that wait in the queue.
 class Logging {
 public:
     bool scroll_enabled = true;
 
-    void AddLog(std::string entry);
+    Logging();
+    ~Logging();
+    void Start();  // Before the first message that should show up, e.g. at the top of main
+    void Stop();  // Formats everything queued and ends the consumer, Start brings it back
+
+    // Only string literals may be used as the format, the arguments must be trivially copyable
+    template <typename... Args>
+    inline void Log(LogCategory category, LogLevel level, const char* format, Args... args);
+    void AddLog(const char* entry, LogCategory category = LogCategory::general, LogLevel level = LogLevel::info);
+    void AddLog(const std::string& entry, LogCategory category = LogCategory::general, LogLevel level = LogLevel::info);
+
+    inline bool IsEnabled(LogCategory category, LogLevel level) const {
+        return level >= levels[static_cast<int>(category)].load(std::memory_order_relaxed);
+    }
+    void SetLevel(LogCategory category, LogLevel level) { levels[static_cast<int>(category)].store(level, std::memory_order_relaxed); }
+    LogLevel GetLevel(LogCategory category) const { return levels[static_cast<int>(category)].load(std::memory_order_relaxed); }
+    static const char* GetCategoryName(LogCategory category);
+
+    bool OpenFile(const std::string& location);
+    void CloseFile();
+    void Flush();  // Blocks until everything queued so far has been formatted and written
     void Clear();
     void Draw(bool *show_log_window);
     std::string GetLastMessage();
 
 private:
-    ImGuiTextBuffer buff;
-    bool scroll_to_bottom = false;
+    static constexpr uint32_t CAPACITY = 0x1000;  // Must be a power of two
+    static constexpr size_t PAYLOAD_SIZE = 104;
+    static constexpr size_t TEXT_LIMIT = 0x10000;  // The oldest half of the text is dropped past this
+
+    typedef int (*FormatFunction)(const uint8_t* payload, char* out, size_t size);
+
+    struct Record {
+        std::atomic<uint64_t> sequence{};
+        FormatFunction format = nullptr;  // Null for plain text records
+        LogCategory category{};
+        LogLevel level{};
+        uint8_t length{};
+        alignas(8) uint8_t payload[PAYLOAD_SIZE];
+    };
+
+    template <typename... Args>
+    struct Deferred {
+        const char* format;
+        std::tuple<Args...> args;
+
+        static int Format(const uint8_t* payload, char* out, size_t size) {
+            const Deferred& self = *reinterpret_cast<const Deferred*>(payload);
+            return self.Apply(out, size, std::index_sequence_for<Args...>{});
+        }
+
+        template <size_t... I>
+        int Apply(char* out, size_t size, std::index_sequence<I...>) const {
+            return snprintf(out, size, format, std::get<I>(args)...);
+        }
+    };
+
+    template <bool... B> struct BoolPack {};
+    template <typename... T>
+    struct AllTrivial : std::is_same<BoolPack<true, std::is_trivially_copyable<T>::value...>, BoolPack<std::is_trivially_copyable<T>::value..., true>> {};
+
+    Record* Claim(uint64_t& position);
+    inline void Publish(Record* record, uint64_t position) {
+        record->sequence.store(position + 1, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);  // Pairs with the one in ConsumerThread
+        if (sleeping.load(std::memory_order_relaxed)) wake.notify_one();
+    }
+    void ConsumerThread();
+    bool Consume();
+    inline bool HasPending() const {
+        return records[dequeue_pos & (CAPACITY - 1)].sequence.load(std::memory_order_acquire) == dequeue_pos + 1;
+    }
+    void Append(const char* text, size_t length);
+
+    std::unique_ptr<Record[]> records{};
+    std::atomic<uint64_t> enqueue_pos{0};
+    uint64_t dequeue_pos{};  // Only touched by the consumer
+    std::atomic<uint64_t> consumed_pos{0};
+    std::atomic<uint32_t> dropped{0};
+    std::atomic<LogLevel> levels[static_cast<int>(LogCategory::count)];
+
+    std::thread consumer{};
+    std::mutex wake_mutex{};  // Guards starting and stopping the consumer and its sleep, producers never take it
+    std::condition_variable wake{}, drained{};
+    std::atomic<bool> running{false}, sleeping{false};
+    bool stop = false;
+
+    std::mutex text_mutex{};  // Guards everything below, shared between the consumer and the UI
+    std::string text{};
     std::string last_message{};
+    FILE* file = nullptr;
+    bool scroll_to_bottom = false;
 };
 
-extern Logging log_helper;
+template <typename... Args>
+inline void Logging::Log(LogCategory category, LogLevel level, const char* format, Args... args) {
+    typedef Deferred<typename std::decay<Args>::type...> Payload;
+    static_assert(sizeof(Payload) <= PAYLOAD_SIZE, "Too many log arguments");
+    static_assert(AllTrivial<typename std::decay<Args>::type...>::value, "Log arguments must be trivially copyable");
+
+    if (!IsEnabled(category, level)) return;
+    uint64_t position;
+    Record* record = Claim(position);
+    if (!record) return;
+
+    new (&record->payload[0]) Payload{format, std::make_tuple(args...)};
+    record->format = &Payload::Format;
+    record->category = category;
+    record->level = level;
+    Publish(record, position);
+}
+
+extern Logging& log_helper;  // Never destroyed, call Stop before the process or library goes away
@@ -1,4 +1,7 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
 #include <ctime>
 
 #include "imgui/imgui.h"
@@ -10,24 +13,42 @@
 
 #include "portable-file-dialogs/portable-file-dialogs.h"
 
-#include "cpu.h"
-#include "memory.h"
-#include "ppu.h"
+#include "archive.h"
+#include "batch_runner.h"
+#include "console.h"
+#include "console_batch.h"
+#include "frame_timer.h"
+#include "lockstep.h"
+#include "screenshot_writer.h"
+#include "test_runner.h"
+#include "work_pool.h"
+#include "texture_uploader.h"
+#include "video_capture.h"
 
 #include "log.h"
 
 constexpr int display_width = 256;
 constexpr int display_height = 240;
 
-bool LoadROM(Memory& mem, Cpu& cpu, Ppu& ppu);
-void Clock(Cpu& cpu, Ppu& ppu);
-void Frame(double elapsed_time, Cpu& cpu, Ppu& ppu, GLuint& framebuffer);
+bool LoadROM(Console& console, std::string& open_archive, std::vector<ArchiveEntry>& archive_roms);
+bool StartROM(Console& console, const std::string& path, const ArchiveEntry* entry);
+void Frame(double elapsed_time, double& time_left, Console& console, TextureUploader& uploader, GLuint framebuffer, VideoCapture& capture, ScreenshotWriter& screenshots, FrameTimer& timer);
+int RunLockstep(int argc, char* argv[]);
+int RunTests(int argc, char* argv[]);
+int RunBatch(int argc, char* argv[]);
+int RunThroughput(int argc, char* argv[]);
 void DebugCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* msg, const void* data);
 inline void SetTexParams();
 
 int main(int argc, char* argv[]){
+    log_helper.Start();
+    if (argc > 1 && !strcmp(argv[1], "--lockstep")) return RunLockstep(argc, argv);
+    if (argc > 1 && !strcmp(argv[1], "--test")) return RunTests(argc, argv);
+    if (argc > 1 && !strcmp(argv[1], "--batch")) return RunBatch(argc, argv);
+    if (argc > 1 && !strcmp(argv[1], "--throughput")) return RunThroughput(argc, argv);
+
     if (!glfwInit()) {
-        log_helper.AddLog("Error while initialising glfw!\n");
+        log_helper.AddLog("Error while initialising glfw!\n", LogCategory::general, LogLevel::error);
         return 1;
     }
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
@@ -42,11 +63,11 @@ int main(int argc, char* argv[]){
     glfwSwapInterval(1);  // VSync
 
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-        log_helper.AddLog("Error while initialising OpenGL!\n");
+        log_helper.AddLog("Error while initialising OpenGL!\n", LogCategory::general, LogLevel::error);
         return 1;
     }
     if (gladLoadGL() == 0) {
-        log_helper.AddLog("Error while initialising glad!\n");
+        log_helper.AddLog("Error while initialising glad!\n", LogCategory::general, LogLevel::error);
         return 1;
     }
 
@@ -61,20 +82,27 @@ int main(int argc, char* argv[]){
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init("#version 450");
 
-    Memory mem;
-    Ppu ppu;
-    Cpu cpu;
+    rom_index.Load("rom_index.txt");
 
-    cpu.memory = &mem;
-    ppu.memory = &mem;
-    mem.ppu = &ppu;
+    Console console;
+    Memory& mem = console.memory;
+    Ppu& ppu = console.ppu;
+    Cpu& cpu = console.cpu;
+    Profiler profiler;
+    FrameTimer timer;
+    Lockstep lockstep;
+    Lockstep::Options lockstep_options;
 
     bool multiplayer_enabled = true;
 
     bool emulation_running = false;
+    bool step_frame = false;  // Set by the Frame button, emulated at the start of the next loop so it is not timed as ui
     bool rom_loaded = false;
     bool run_immediately = true;
+    std::string open_archive = "";  // Archive with more than one ROM, waiting for the user to pick one
+    std::vector<ArchiveEntry> archive_roms{};  // Its NES ROMs, listed once when it was opened
     double elapsed_time{};
+    double frame_time_left{};  // Until the next emulated frame is due
     std::clock_t begin{}, end{};
 
     bool show_log_window = false;
@@ -83,6 +111,10 @@ int main(int argc, char* argv[]){
     bool show_palette = false;
     bool show_pattern_tables = false;
     bool show_nametables = false;
+    bool show_trace = false;
+    bool show_profiler = false;
+    bool show_timing = false;
+    bool show_lockstep = false;
     uint8_t selected_palette{};
 
     ImVec4 red(1.0f, 0.0f, 0.0f, 1.0f);
@@ -126,43 +158,48 @@ int main(int argc, char* argv[]){
     SetTexParams();
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 256, 240, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
 
+    // Room for every texture in one region, the game screen, both pattern tables, the palette and four nametables
+    TextureUploader uploader;
+    uploader.Init(sizeof(*ppu.image_data) + sizeof(*ppu.pattern_table_data) + sizeof(*ppu.palette_data) + sizeof(*ppu.nametable_data));
+    ppu.line_hashing = true;  // Only the lines that changed are uploaded
+    VideoCapture capture;
+    ScreenshotWriter screenshots(1, false);
+    int dump_interval = 60;  // Frames between dumped screenshots
+
     while (!glfwWindowShouldClose(window)) {
         elapsed_time = std::fmod(std::difftime(end, begin) / CLOCKS_PER_SEC, 0.016f);
         // Windows is using wall time for clock() and without the fmod() stuff would break during debugging
         // It also assumes that we are running above NES speeds
         begin = std::clock();
+        timer.Begin(FrameTimer::Section::frame);
 
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
+        uploader.BeginFrame();
 
         if (emulation_running) {
+            // The viewers only redraw what changed, only those lines are uploaded
+            timer.Begin(FrameTimer::Section::viewers);
+            if (show_pattern_tables) ppu.SetPatternTables(selected_palette);
+            if (show_palette) ppu.SetPaletteImage();
+            if (show_nametables) ppu.SetNametables();
+            timer.End(FrameTimer::Section::viewers);
+
+            timer.Begin(FrameTimer::Section::upload);
             if (show_pattern_tables) {
-                ppu.SetPatternTables(selected_palette);
-                glBindTexture(GL_TEXTURE_2D, pattern_table_0);
-                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 128, 128, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8, ppu.pattern_table_data->data() + 0);
-                glBindTexture(GL_TEXTURE_2D, pattern_table_1);
-                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 128, 128, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8, ppu.pattern_table_data->data() + 1);
-            }
-
-            if (show_palette) {
-                ppu.SetPaletteImage();
-                glBindTexture(GL_TEXTURE_2D, palette);
-                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 16, 2, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8, ppu.palette_data->data());
+                uploader.UploadLines(pattern_table_0, 128, 128, &(*ppu.pattern_table_data)[0][0][0], ppu.pattern_table_lines[0]);
+                uploader.UploadLines(pattern_table_1, 128, 128, &(*ppu.pattern_table_data)[1][0][0], ppu.pattern_table_lines[1]);
             }
-
+            if (show_palette) uploader.UploadIfChanged(palette, 16, 2, &(*ppu.palette_data)[0][0]);
             if (show_nametables) {
-                ppu.SetNametables();
-                glBindTexture(GL_TEXTURE_2D, nametable_0);
-                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 256, 240, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8, ppu.nametable_data->data() + 0);
-                glBindTexture(GL_TEXTURE_2D, nametable_1);
-                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 256, 240, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8, ppu.nametable_data->data() + 1);
-                glBindTexture(GL_TEXTURE_2D, nametable_2);
-                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 256, 240, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8, ppu.nametable_data->data() + 2);
-                glBindTexture(GL_TEXTURE_2D, nametable_3);
-                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 256, 240, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8, ppu.nametable_data->data() + 3);
-
+                uploader.UploadLines(nametable_0, 256, 240, &(*ppu.nametable_data)[0][0][0], ppu.nametable_lines[0]);
+                uploader.UploadLines(nametable_1, 256, 240, &(*ppu.nametable_data)[1][0][0], ppu.nametable_lines[1]);
+                uploader.UploadLines(nametable_2, 256, 240, &(*ppu.nametable_data)[2][0][0], ppu.nametable_lines[2]);
+                uploader.UploadLines(nametable_3, 256, 240, &(*ppu.nametable_data)[3][0][0], ppu.nametable_lines[3]);
             }
+            timer.End(FrameTimer::Section::upload);
+
             mem.controller[0][0] = ImGui::IsKeyDown(GLFW_KEY_D);  // Right
             mem.controller[0][1] = ImGui::IsKeyDown(GLFW_KEY_A);  // Left
             mem.controller[0][2] = ImGui::IsKeyDown(GLFW_KEY_S);  // Down
@@ -182,13 +219,17 @@ int main(int argc, char* argv[]){
                 mem.controller[1][7] = ImGui::IsKeyDown(GLFW_KEY_KP_2);  // A
             }
 
-            Frame(elapsed_time, cpu, ppu, framebuffer);
+            Frame(elapsed_time, frame_time_left, console, uploader, framebuffer, capture, screenshots, timer);
         }
+        else if (step_frame && rom_loaded) Frame(0.017f, frame_time_left, console, uploader, framebuffer, capture, screenshots, timer);
+        step_frame = false;
+        if (lockstep.IsRunning() && !lockstep.HasDiverged()) lockstep.RunFrame(mem.controller);
 
+        timer.Begin(FrameTimer::Section::ui);
         if (ImGui::BeginMainMenuBar()) {
             if (ImGui::BeginMenu("File")) {
                 if (ImGui::MenuItem("Load ROM", "", false)) {
-                    rom_loaded = LoadROM(mem, cpu, ppu);
+                    rom_loaded = LoadROM(console, open_archive, archive_roms);
                     emulation_running = (run_immediately && rom_loaded)? true : false;
                 }
                 if (ImGui::MenuItem("Exit", "", false)) glfwSetWindowShouldClose(window, 1);
@@ -197,13 +238,36 @@ int main(int argc, char* argv[]){
             if (ImGui::BeginMenu("Emulation")) {
                 if (ImGui::MenuItem("Resume", "", false)) emulation_running = true;
                 if (ImGui::MenuItem("Pause", "", false)) emulation_running = false;
+                ImGui::Checkbox("Skip idle loops", &cpu.idle_skip_enabled);
+                ImGui::Checkbox("Verify idle loop skipping", &cpu.idle_skip_verify);
+                if (Dynarec::IsSupported()) {
+                    ImGui::Checkbox("Recompiler", &cpu.dynarec_enabled);
+                    ImGui::Checkbox("Verify recompiled blocks", &cpu.dynarec_verify);
+                }
                 if (ImGui::MenuItem("Reload", "", false)) {
                     if (rom_loaded) {
                         // Hopefully the ROMs don't modify themselves in memory so I can just reset the registers
-                        cpu.Power();  // The CPU does some weird stuff on reset, so I just set it to power-on instead
-                        ppu.Reset();
+                        console.Power();
                     }
                 }
+                if (!capture.IsRunning() && ImGui::MenuItem("Start recording", "", false)) {
+                    std::string file = pfd::save_file("Record to", "recording.y4m", { "YUV4MPEG2 video", "*.y4m", "Run-length frames", "*.rle" }).result();
+                    if (!file.empty() && capture.Start(file, ppu, false)) {
+                        pfd::message error("Error", "Could not start recording, the log has the details!", pfd::choice::ok, pfd::icon::error);
+                    }
+                }
+                if (capture.IsRunning() && ImGui::MenuItem("Stop recording", "", false)) capture.Stop();
+                if (ImGui::MenuItem("Save screenshot", "", false)) {
+                    std::string file = pfd::save_file("Save screenshot", "screenshot.png", { "PNG image", "*.png", "PPM image", "*.ppm" }).result();
+                    if (!file.empty()) screenshots.Save(ppu, file);
+                }
+                ImGui::InputInt("Dump interval", &dump_interval);
+                if (dump_interval < 1) dump_interval = 1;
+                if (!screenshots.IsDumping() && ImGui::MenuItem("Start frame dump", "", false)) {
+                    std::string file = pfd::save_file("Dump frames to", "frame.png", { "PNG image", "*.png", "PPM image", "*.ppm" }).result();
+                    if (!file.empty()) screenshots.StartDump(file, static_cast<uint32_t>(dump_interval));
+                }
+                if (screenshots.IsDumping() && ImGui::MenuItem("Stop frame dump", "", false)) screenshots.StopDump();
                 ImGui::EndMenu();
             }
             if (ImGui::BeginMenu("Window")) {
@@ -213,6 +277,10 @@ int main(int argc, char* argv[]){
                 ImGui::Checkbox("Show/hide pattern tables", &show_pattern_tables);
                 ImGui::Checkbox("Show/hide palette", &show_palette);
                 ImGui::Checkbox("Show/hide nametables", &show_nametables);
+                ImGui::Checkbox("Show/hide instruction trace", &show_trace);
+                ImGui::Checkbox("Show/hide profiler", &show_profiler);
+                ImGui::Checkbox("Show/hide timing", &show_timing);
+                ImGui::Checkbox("Show/hide lockstep comparison", &show_lockstep);
                 ImGui::EndMenu();
                 
             }
@@ -252,12 +320,31 @@ int main(int argc, char* argv[]){
             ImGui::End();
         }
 
+        if (!open_archive.empty()) {
+            bool show_archive = true;
+            ImGui::Begin("Archive contents", &show_archive);
+            for (const ArchiveEntry& entry : archive_roms) {
+                char details[32];
+                sprintf_s(&details[0], sizeof(details), "%u KB  CRC %08X", entry.size / 1024, entry.crc);
+                if (ImGui::Selectable(entry.name.c_str(), false, 0, ImVec2(ImGui::GetWindowContentRegionWidth() * 0.7f, 0))) {
+                    rom_loaded = StartROM(console, open_archive, &entry);
+                    emulation_running = (run_immediately && rom_loaded) ? true : false;
+                    show_archive = false;
+                }
+                ImGui::SameLine();
+                ImGui::TextUnformatted(&details[0]);
+            }
+            ImGui::End();
+            if (!show_archive) {
+                open_archive = "";
+                archive_roms.clear();
+            }
+        }
+
         if (show_log_window) {
             ImGui::Begin("Log", &show_log_window);
             ImGui::Checkbox("Autoscroll", &log_helper.scroll_enabled);
             ImGui::SameLine();
-            ImGui::Checkbox("Log instructions", &cpu.log_instr);
-            ImGui::SameLine();
             if(ImGui::Button("Clear log")) log_helper.Clear();
             log_helper.Draw(&show_log_window);
             ImGui::End();
@@ -273,9 +360,7 @@ int main(int argc, char* argv[]){
             ImGui::SameLine();
             if (ImGui::Button("Stop")) emulation_running = false;
             ImGui::SameLine();
-            if (ImGui::Button("Frame")) {
-                if (rom_loaded) Frame(0.017f, cpu, ppu, framebuffer);
-            }
+            if (ImGui::Button("Frame")) step_frame = true;
             ImGui::SameLine();
             ImGui::Checkbox("Run immediately", &run_immediately);
             ImGui::Text("Palette used: ");
@@ -304,6 +389,115 @@ int main(int argc, char* argv[]){
             ImGui::End();
         }
 
+        if (show_trace) {
+            ImGui::Begin("Instruction trace", &show_trace);
+            ImGui::Checkbox("Trace instructions", &cpu.trace_enabled);
+            ImGui::SameLine();
+            if (ImGui::Button("Clear")) cpu.trace.Clear();
+            ImGui::SameLine();
+            if (ImGui::Button("Dump to trace.log")) {
+                if (cpu.trace.Dump("trace.log")) log_helper.AddLog("Error while writing trace.log\n", LogCategory::general, LogLevel::error);
+                else log_helper.AddLog("Instruction trace written to trace.log\n");
+            }
+            ImGui::Separator();
+
+            // Only the visible lines are disassembled, so the whole ring can be scrolled through
+            ImGui::BeginChild("trace_lines", ImVec2(0, 0), false, ImGuiWindowFlags_HorizontalScrollbar);
+            char line[Disassembler::LINE_SIZE];
+            ImGuiListClipper clipper(static_cast<int>(cpu.trace.GetCount()));
+            while (clipper.Step()) {
+                for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i) {
+                    int length = Disassembler::Format(cpu.trace.Get(i), &line[0], sizeof(line));
+                    ImGui::TextUnformatted(&line[0], &line[length]);
+                }
+            }
+            if (emulation_running && cpu.trace_enabled) ImGui::SetScrollHereY(1.0f);
+            ImGui::EndChild();
+            ImGui::End();
+        }
+
+        if (show_profiler) {
+            ImGui::Begin("Profiler", &show_profiler);
+            bool profiling = cpu.profiler != nullptr;
+            if (ImGui::Checkbox("Profile", &profiling)) cpu.profiler = profiling ? &profiler : nullptr;
+            ImGui::SameLine();
+            if (ImGui::Button("Reset")) profiler.Reset();
+            ImGui::SameLine();
+            if (ImGui::Button("Write profile.txt")) {
+                if (profiler.WriteReport("profile.txt", mem)) log_helper.AddLog("Error while writing profile.txt\n", LogCategory::general, LogLevel::error);
+                else log_helper.AddLog("Profile written to profile.txt\n");
+            }
+            const double total = profiler.GetTotalCycles() ? static_cast<double>(profiler.GetTotalCycles()) : 1.0;
+
+            if (ImGui::CollapsingHeader("Hottest instructions", ImGuiTreeNodeFlags_DefaultOpen)) {
+                for (const Profiler::Hotspot& spot : profiler.GetHotspots(15)) {
+                    ImGui::Text("$%04X  %-5s  %5.1f%%", spot.addr, Disassembler::GetMnemonic(mem.Peek(spot.addr)), 100.0 * spot.cycles / total);
+                }
+            }
+            if (ImGui::CollapsingHeader("Hottest routines", ImGuiTreeNodeFlags_DefaultOpen)) {
+                for (const Profiler::Hotspot& routine : profiler.GetRoutines(10)) {
+                    ImGui::Text("$%04X  %8llu calls  %5.1f%%", routine.addr, static_cast<unsigned long long>(routine.count), 100.0 * routine.cycles / total);
+                }
+            }
+            if (ImGui::CollapsingHeader("Loops", ImGuiTreeNodeFlags_DefaultOpen)) {
+                for (const Profiler::Loop& loop : profiler.GetLoops(mem, 10)) {
+                    ImGui::Text("$%04X-$%04X  %-11s  %5.1f%%", loop.start, loop.end, Profiler::GetLoopKindName(loop.kind), 100.0 * loop.cycles / total);
+                }
+            }
+            ImGui::End();
+        }
+
+        if (show_lockstep) {
+            ImGui::Begin("Lockstep comparison", &show_lockstep);
+            ImGui::TextUnformatted("Fast core:");
+            ImGui::SameLine();
+            ImGui::Checkbox("Block cache", &lockstep_options.block_cache);
+            ImGui::SameLine();
+            ImGui::Checkbox("Recompiler", &lockstep_options.dynarec);
+            ImGui::SameLine();
+            ImGui::Checkbox("Idle loop skipping", &lockstep_options.idle_skip);
+            if (ImGui::Button("Start")) {
+                // Runs from power-on next to the game, so restart the game as well to keep the input in sync
+                if (rom_loaded && !lockstep.Start(console, lockstep_options)) console.Power();
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Stop")) lockstep.Stop();
+            ImGui::Separator();
+
+            if (!lockstep.IsRunning()) ImGui::TextUnformatted("Not running");
+            else if (!lockstep.HasDiverged()) {
+                ImGui::Text("%llu frames, %llu instructions, no difference", static_cast<unsigned long long>(lockstep.GetFrameCount()),
+                            static_cast<unsigned long long>(lockstep.GetInstructionCount()));
+            }
+            else {
+                ImGui::BeginChild("lockstep_report", ImVec2(0, 0), false, ImGuiWindowFlags_HorizontalScrollbar);
+                ImGui::TextUnformatted(lockstep.GetReport().c_str());
+                ImGui::EndChild();
+            }
+            ImGui::End();
+        }
+
+        if (show_timing) {
+            ImGui::Begin("Timing", &show_timing);
+            if (ImGui::Button("Reset")) timer.Reset();
+            ImGui::SameLine();
+            if (ImGui::Button("Export CSV")) {
+                if (timer.WriteCsv("frame_times.csv")) log_helper.AddLog("Error while writing frame_times.csv\n", LogCategory::general, LogLevel::error);
+                else log_helper.AddLog("Frame times written to frame_times.csv\n", LogCategory::general, LogLevel::info);
+            }
+            const int samples = static_cast<int>(timer.GetSampleCount());
+            for (int i = 0; i < static_cast<int>(FrameTimer::Section::count); ++i) {
+                const FrameTimer::Section section = static_cast<FrameTimer::Section>(i);
+                const float max = timer.GetMax(section);
+                char overlay[64];
+                snprintf(&overlay[0], sizeof(overlay), "p50 %.2f  p99 %.2f  max %.2f ms", timer.GetPercentile(section, 0.5f),
+                         timer.GetPercentile(section, 0.99f), max);
+                ImGui::PlotLines(FrameTimer::GetSectionName(section), timer.GetHistory(section), samples, timer.GetHistoryOffset(), &overlay[0],
+                                 0.0f, max > 1.0f ? max : 1.0f, ImVec2(0, 50));
+            }
+            ImGui::End();
+        }
+
         if (show_demo_window) ImGui::ShowDemoWindow(&show_demo_window);
 
         ImGui::Render();
@@ -315,73 +509,289 @@ int main(int argc, char* argv[]){
         glClearColor(0.45f, 0.55f, 0.60f, 1.00f);
         glClear(GL_COLOR_BUFFER_BIT);
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        timer.End(FrameTimer::Section::ui);
+        timer.Begin(FrameTimer::Section::upload);
+        uploader.EndFrame();
+        timer.End(FrameTimer::Section::upload);
 
         glfwMakeContextCurrent(window);
         glfwSwapBuffers(window);
         glfwPollEvents();
+        timer.End(FrameTimer::Section::frame);
+        timer.EndFrame();
 
         end = std::clock();
     }
 
-    delete ppu.image_data;
-    delete ppu.pattern_table_data;
-    delete ppu.palette_data;
-    delete ppu.nametable_data;
+    rom_index.Save();
 
+    capture.Stop();
+    screenshots.Wait();
+    uploader.Shutdown();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
 
     glfwDestroyWindow(window);
     glfwTerminate();
+    log_helper.Stop();
 
     return 0;
 }
 
-bool LoadROM(Memory& mem, Cpu& cpu, Ppu& ppu) {
-    std::vector<std::string> file = pfd::open_file("Select a file", ".", { "NES ROMS", "*" }).result();
+bool LoadROM(Console& console, std::string& open_archive, std::vector<ArchiveEntry>& archive_roms) {
+    std::vector<std::string> file = pfd::open_file("Select a file", ".", { "NES ROMS", "*.nes *.zip *.gz *.7z", "All files", "*" }).result();
     if (file.empty()) return false;
-    mem.rom_path = file[0];
-    if (!mem.LoadROM(mem.rom_path.c_str())) {
-        if (!mem.SetupMapper()) {
-            cpu.Power();
-            ppu.Reset();
-            //cpu.Reset(); TODO: not even sure if this needs to be emulated
-            //apu.Reset(); TODO:
-            return true;
-        }
-        else pfd::message error("Error", "Unsupported mapper!", pfd::choice::ok, pfd::icon::error);
+    if (!Archive::IsArchive(file[0])) return StartROM(console, file[0], nullptr);
+
+    const std::vector<ArchiveEntry>* entries = rom_index.GetEntries(file[0]);
+    if (!entries) {
+        pfd::message error("Error", "Invalid or unsupported archive!", pfd::choice::ok, pfd::icon::error);
+        return false;
     }
-    else pfd::message error("Error", "Invalid ROM file!", pfd::choice::ok, pfd::icon::error);
-    mem.rom_path = "";
-    return false;
-}
 
-void Clock(Cpu& cpu, Ppu& ppu) {
-    static int8_t clock_count = 0;
-    ppu.Run();
-    if (clock_count == 2) {  // TODO: Maybe i have to use the returned cpu cycles
-        cpu.Run();
-        clock_count = -1;
+    std::vector<ArchiveEntry> roms;
+    for (const ArchiveEntry& entry : *entries) {
+        if (Archive::IsNesFile(entry.name)) roms.push_back(entry);
     }
-    if (ppu.nmi) {
-        ppu.nmi = false;
-        cpu.NMI();
+    if (roms.empty()) {
+        pfd::message error("Error", "No NES ROM found in the archive!", pfd::choice::ok, pfd::icon::error);
+        return false;
     }
+    if (roms.size() == 1) return StartROM(console, file[0], &roms[0]);
 
-    ++clock_count;
+    open_archive = file[0];  // Let the user pick from the archive contents window
+    archive_roms.swap(roms);
+    return false;
+}
+
+bool StartROM(Console& console, const std::string& path, const ArchiveEntry* entry) {
+    if (!console.LoadROM(path, entry)) return true;
+    pfd::message error("Error", "Could not load the ROM, the log has the details!", pfd::choice::ok, pfd::icon::error);
+    return false;
 }
 
-void Frame(double elapsed_time ,Cpu& cpu, Ppu& ppu, GLuint& framebuffer) {
-    static double time_left = 0;
+void Frame(double elapsed_time, double& time_left, Console& console, TextureUploader& uploader, GLuint framebuffer, VideoCapture& capture, ScreenshotWriter& screenshots, FrameTimer& timer) {
     if (time_left > 0.0f) time_left -= elapsed_time;
     else {
         time_left += (1.0f / 60.0f) - elapsed_time;
-        while (!ppu.frame_done) Clock(cpu, ppu);
-        glBindTexture(GL_TEXTURE_2D, framebuffer);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, display_width, display_height, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8, ppu.image_data->data());
-        ppu.frame_done = false;
+        timer.Begin(FrameTimer::Section::emulation);
+        console.RunFrame();
+        timer.End(FrameTimer::Section::emulation);
+        timer.Begin(FrameTimer::Section::capture);
+        capture.Push(console.ppu);
+        screenshots.Push(console.ppu);
+        timer.End(FrameTimer::Section::capture);
+        // The texture always holds the previous emulated frame, so the lines that changed since then are enough
+        timer.Begin(FrameTimer::Section::upload);
+        uploader.UploadLines(framebuffer, display_width, display_height, &(*console.ppu.image_data)[0][0], console.ppu.dirty_lines);
+        timer.End(FrameTimer::Section::upload);
+    }
+}
+
+// EzNES --lockstep <rom> [frames] [--no-block-cache] [--no-recompiler] [--no-idle-skip]
+int RunLockstep(int argc, char* argv[]) {
+    if (argc < 3) {
+        printf("Usage: EzNES --lockstep <rom> [frames] [--no-block-cache] [--no-recompiler] [--no-idle-skip]\n");
+        return 2;
+    }
+    Lockstep::Options options;
+    uint64_t frames = 600;
+    for (int i = 3; i < argc; ++i) {
+        if (!strcmp(argv[i], "--no-block-cache")) options.block_cache = false;
+        else if (!strcmp(argv[i], "--no-recompiler")) options.dynarec = false;
+        else if (!strcmp(argv[i], "--no-idle-skip")) options.idle_skip = false;
+        else frames = strtoull(argv[i], nullptr, 10);
+    }
+
+    Console source;
+    const std::string path = argv[2];
+    bool error;
+    if (!Archive::IsArchive(path)) error = source.LoadROM(path, nullptr);
+    else {
+        const std::vector<ArchiveEntry>* entries = rom_index.GetEntries(path);
+        const ArchiveEntry* rom = nullptr;
+        if (entries) {
+            for (const ArchiveEntry& entry : *entries) {
+                if (Archive::IsNesFile(entry.name)) {
+                    rom = &entry;
+                    break;
+                }
+            }
+        }
+        error = !rom || source.LoadROM(path, rom);
+    }
+
+    Lockstep lockstep;
+    if (error || lockstep.Start(source, options)) {
+        log_helper.Stop();
+        printf("Could not load %s\n", path.c_str());
+        return 2;
+    }
+
+    const std::bitset<8> controller[2] = {};
+    for (uint64_t frame = 0; frame < frames; ++frame) {
+        if (lockstep.RunFrame(controller)) break;
     }
+    if (lockstep.HasDiverged()) printf("%s", lockstep.GetReport().c_str());
+    else printf("No difference in %llu frames, %llu instructions\n", static_cast<unsigned long long>(lockstep.GetFrameCount()),
+                static_cast<unsigned long long>(lockstep.GetInstructionCount()));
+    log_helper.Stop();  // The divergence report also went to the log
+    return lockstep.HasDiverged() ? 1 : 0;
+}
+
+// EzNES --test <rom or manifest.tsv>... [--frames N] [--threads N] [--fast] [--out results.tsv]
+int RunTests(int argc, char* argv[]) {
+    TestRunner runner;
+    uint32_t frames = TestRunner::DEFAULT_FRAMES, threads = 0;
+    std::string out = "";
+    std::vector<std::string> roms;
+    for (int i = 2; i < argc; ++i) {
+        if (!strcmp(argv[i], "--frames") && i + 1 < argc) frames = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc) threads = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--out") && i + 1 < argc) out = argv[++i];
+        else if (!strcmp(argv[i], "--fast")) runner.fast_paths = true;
+        else roms.push_back(argv[i]);
+    }
+    if (roms.empty()) {
+        printf("Usage: EzNES --test <rom or manifest.tsv>... [--frames N] [--threads N] [--fast] [--out results.tsv]\n");
+        return 2;
+    }
+
+    for (const std::string& path : roms) {
+        const std::string extension = path.substr(path.find_last_of('.') + 1);
+        if (extension != "tsv" && extension != "txt") runner.AddRom(path, frames);
+        else if (runner.AddManifest(path)) {
+            printf("Could not read %s\n", path.c_str());
+            return 2;
+        }
+    }
+    runner.Run(threads);
+
+    FILE* file = stdout;
+    if (!out.empty() && fopen_s(&file, out.c_str(), "w")) {
+        printf("Could not open %s\n", out.c_str());
+        return 2;
+    }
+    bool error = runner.WriteResults(file);
+    if (file != stdout) fclose(file);
+    log_helper.Stop();
+    if (error) return 2;
+    return runner.GetFailureCount() ? 1 : 0;
+}
+
+// EzNES --batch <jobs.tsv>... [--threads N] [--fast] [--dump N] [--out results.tsv] [--counters counters.tsv]
+int RunBatch(int argc, char* argv[]) {
+    BatchRunner runner;
+    uint32_t threads = 0;
+    std::string out = "", counters_out = "";
+    bool has_jobs = false;
+    for (int i = 2; i < argc; ++i) {
+        if (!strcmp(argv[i], "--threads") && i + 1 < argc) threads = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--out") && i + 1 < argc) out = argv[++i];
+        else if (!strcmp(argv[i], "--counters") && i + 1 < argc) counters_out = argv[++i];
+        else if (!strcmp(argv[i], "--fast")) runner.fast_paths = true;
+        else if (!strcmp(argv[i], "--dump") && i + 1 < argc) runner.dump_interval = strtoul(argv[++i], nullptr, 10);
+        else if (runner.AddJobs(argv[i])) {
+            printf("Could not read %s\n", argv[i]);
+            return 2;
+        }
+        else has_jobs = true;
+    }
+    if (!has_jobs) {
+        printf("Usage: EzNES --batch <jobs.tsv>... [--threads N] [--fast] [--dump N] [--out results.tsv] [--counters counters.tsv]\n");
+        return 2;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    runner.Run(threads);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    FILE* file = stdout;
+    if (!out.empty() && fopen_s(&file, out.c_str(), "w")) {
+        printf("Could not open %s\n", out.c_str());
+        return 2;
+    }
+    bool error = runner.WriteResults(file);
+    if (file != stdout) fclose(file);
+    if (!counters_out.empty()) {
+        if (!Counters::enabled) fprintf(stderr, "Built without EZNES_COUNTERS, the counters are all zero\n");
+        if (fopen_s(&file, counters_out.c_str(), "w")) {
+            printf("Could not open %s\n", counters_out.c_str());
+            return 2;
+        }
+        error |= runner.WriteCounters(file);
+        fclose(file);
+    }
+    fprintf(stderr, "Finished in %.2f s\n", seconds);
+    log_helper.Stop();
+    if (error) return 2;
+    return runner.GetErrorCount() ? 1 : 0;
+}
+
+// EzNES --throughput <rom> [consoles] [frames] [--threads N]
+// Steps the same number of consoles once as a ConsoleBatch and once as independent consoles on a pool,
+// each loading the ROM itself and run as its own task, and prints the aggregate frame rate of both.
+int RunThroughput(int argc, char* argv[]) {
+    if (argc < 3) {
+        printf("Usage: EzNES --throughput <rom> [consoles] [frames] [--threads N]\n");
+        return 2;
+    }
+    uint32_t counts[2] = { 64, 600 };
+    uint32_t threads = 0, positional = 0;
+    for (int i = 3; i < argc; ++i) {
+        if (!strcmp(argv[i], "--threads") && i + 1 < argc) threads = strtoul(argv[++i], nullptr, 10);
+        else if (positional < 2) counts[positional++] = strtoul(argv[i], nullptr, 10);
+    }
+    const std::string rom = argv[2];
+    const uint32_t consoles = counts[0], frames = counts[1];
+    const std::vector<uint8_t> actions(consoles, 0);
+    auto seconds_since = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    ConsoleBatch batch(threads);
+    auto start = std::chrono::steady_clock::now();
+    if (batch.Load(rom, nullptr, consoles)) {
+        printf("Could not load %s\n", rom.c_str());
+        return 2;
+    }
+    const double batch_load = seconds_since(start);
+    start = std::chrono::steady_clock::now();
+    for (uint32_t frame = 0; frame < frames; ++frame) batch.Step(actions.data());
+    const double batch_run = seconds_since(start);
+
+    WorkPool pool(threads);
+    std::vector<std::unique_ptr<Console>> independent(consoles);
+    std::atomic<uint32_t> load_errors{0};
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < consoles; ++i) {
+        pool.Submit([&independent, &load_errors, &rom, i]() {
+            independent[i].reset(new Console);
+            independent[i]->memory.use_save_file = false;
+            if (independent[i]->LoadROM(rom, nullptr)) ++load_errors;
+        });
+    }
+    pool.Wait();
+    const double independent_load = seconds_since(start);
+    if (load_errors) {
+        printf("Could not load %s\n", rom.c_str());
+        return 2;
+    }
+    start = std::chrono::steady_clock::now();
+    for (uint32_t frame = 0; frame < frames; ++frame) {
+        for (uint32_t i = 0; i < consoles; ++i) pool.Submit([&independent, i]() { independent[i]->RunFrame(); });
+        pool.Wait();
+    }
+    const double independent_run = seconds_since(start);
+
+    const double total = static_cast<double>(consoles) * frames;
+    printf("%u consoles, %u frames each, %u threads\n", consoles, frames, pool.GetThreadCount());
+    printf("batch:       load %.3f s, run %.3f s, %.0f frames/s\n", batch_load, batch_run, total / batch_run);
+    printf("independent: load %.3f s, run %.3f s, %.0f frames/s\n", independent_load, independent_run, total / independent_run);
+    printf("speedup %.2fx\n", independent_run / batch_run);
+    log_helper.Stop();
+    return 0;
 }
 
 void DebugCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* msg, const void* data) {
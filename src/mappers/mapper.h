@@ -7,4 +7,5 @@ class Mapper {
 public:
     virtual uint16_t TranslateAddress(uint16_t addr) = 0;
     virtual uint16_t TranslatePpuAddress(uint16_t addr) = 0;
+    virtual bool DecodesExpansion() const { return false; }  // Whether the cartridge answers at $4020-$5FFF
 };
@@ -1,53 +1,118 @@
 #include <stdio.h>
+#include <algorithm>
+#include <cassert>
 
 #include "memory.h"
 #include "ppu.h"
 
 
 Memory::Memory() {
-    cpu_memory.resize(0x10000);
+    cpu_memory.resize(ROM_START);
+    prg_ram_buffer.resize(0x2000);
+    prg_ram = &prg_ram_buffer[0];
+    MapPages();
 }
 
 bool Memory::LoadROM(std::string location) {
+    FILE* input_ROM = nullptr;
     if (fopen_s(&input_ROM, location.c_str(), "rb")) {
-        log_helper.AddLog("Error while opening ROM!\n");
+        log_helper.AddLog("Error while opening ROM!\n", LogCategory::memory, LogLevel::error);
+        return true;
     }
-    log_helper.AddLog("\nLoading ROM at " + static_cast<std::string>(location) + '\n');
-    // TODO: add more error checking
+    log_helper.AddLog("\nLoading ROM at " + static_cast<std::string>(location) + '\n', LogCategory::memory, LogLevel::info);
+
+    rom_stream_pos = 0;
+    bool error = false;
+    uint8_t buff[0x4000];
+    size_t chunk;
+    while (!error && (chunk = fread(&buff[0], 1, sizeof(buff), input_ROM)) > 0) error = ConsumeROMData(&buff[0], chunk);
 
-    if (ReadHeader()) return true; // Error occured
+    fclose(input_ROM);
+    return error || FinishROMData();
+}
 
-    uint16_t offset = 0x10;
-    if (trainer) offset += 0x200;
+bool Memory::LoadROM(std::string location, const ArchiveEntry& entry) {
+    log_helper.AddLog("\nLoading ROM " + entry.name + " from archive " + location + '\n', LogCategory::memory, LogLevel::info);
 
-    fseek(input_ROM, offset, SEEK_SET);
-    fread(&prg_memory[0], 1, prg_rom_size, input_ROM);
-    fread(&chr_memory[0], 1, chr_rom_size, input_ROM);
+    rom_stream_pos = 0;
+    Archive::Sink sink = [this](const uint8_t* data, size_t size) { return ConsumeROMData(data, size); };
+    if (Archive::Extract(location, entry, sink)) return true;
 
-    fclose(input_ROM);
+    return FinishROMData();
+}
+
+bool Memory::LoadROM(const Memory& other) {
+    if (!other.rom) return true;
+    memcpy(&header[0], &other.header[0], sizeof(header));
+    if (ReadHeader()) return true;
+    rom = other.rom;
     return false;
 }
 
-bool Memory::ReadHeader() {
-    fread(&header[0], 1, 0x10, input_ROM);
+// Takes the ROM in arbitrary sized chunks so archives can be decompressed straight into the PRG/CHR buffers
+bool Memory::ConsumeROMData(const uint8_t* data, size_t size) {
+    while (size > 0) {
+        size_t chunk;
+        if (rom_stream_pos < 0x10) {
+            chunk = std::min<size_t>(size, 0x10 - rom_stream_pos);
+            memcpy(&header[rom_stream_pos], data, chunk);
+            if (rom_stream_pos + chunk == 0x10) {
+                if (ReadHeader()) return true;  // Error occured
+                loading_rom = std::make_shared<CartridgeRom>();
+                loading_rom->prg.resize(prg_rom_size);
+                loading_rom->chr.resize(chr_rom_size);
+            }
+        }
+        else {
+            uint32_t prg_start = trainer ? 0x210 : 0x10;
+            uint32_t chr_start = prg_start + prg_rom_size;
+            uint32_t rom_end = chr_start + chr_rom_size;
+
+            if (rom_stream_pos < prg_start) chunk = std::min<size_t>(size, prg_start - rom_stream_pos);  // Trainer is ignored
+            else if (rom_stream_pos < chr_start) {
+                chunk = std::min<size_t>(size, chr_start - rom_stream_pos);
+                memcpy(&loading_rom->prg[rom_stream_pos - prg_start], data, chunk);
+            }
+            else if (rom_stream_pos < rom_end) {
+                chunk = std::min<size_t>(size, rom_end - rom_stream_pos);
+                memcpy(&loading_rom->chr[rom_stream_pos - chr_start], data, chunk);
+            }
+            else return false;  // Anything after the CHR-ROM is not needed
+        }
+        rom_stream_pos += static_cast<uint32_t>(chunk);
+        data += chunk;
+        size -= chunk;
+    }
+    return false;
+}
 
+bool Memory::FinishROMData() {
+    uint32_t rom_end = (trainer ? 0x210 : 0x10) + prg_rom_size + chr_rom_size;
+    if (rom_stream_pos < 0x10 || rom_stream_pos < rom_end) {
+        log_helper.AddLog("ROM file is truncated!\n", LogCategory::memory, LogLevel::error);
+        return true;
+    }
+    rom = std::move(loading_rom);
+    return false;
+}
+
+bool Memory::ReadHeader() {
     if (!(header[0] == (int)"N"[0] && header[1] == (int)"E"[0] && header[2] == (int)"S"[0] && header[3] == 0x1A)) {
-        log_helper.AddLog("Unknown file format!\n");
+        log_helper.AddLog("Unknown file format!\n", LogCategory::memory, LogLevel::error);
         return true;
     }
 
     bool NES_ver_2;
     if ((header[7] >> 2) && 0x3 == 0x2) {
-        log_helper.AddLog("NES 2.0 format detected!\n");
+        log_helper.AddLog("NES 2.0 format detected!\n", LogCategory::memory, LogLevel::info);
         NES_ver_2 = true;
     }
     else {
-        log_helper.AddLog("iNES format detected!\n");
+        log_helper.AddLog("iNES format detected!\n", LogCategory::memory, LogLevel::info);
         NES_ver_2 = false;
     }
     if (!NES_ver_2) {  // iNES header
         prg_rom_size = (header[4]) * 0x4000;
-        prg_memory.resize(prg_rom_size);
         if (header[5] == 0) {
             chr_ram_size = 0x2000;
             chr_rom_size = 0;
@@ -55,15 +120,15 @@ bool Memory::ReadHeader() {
             chr_ram_size = 0;
             chr_rom_size = (header[5]) * 0x2000;
         }
-        chr_memory.resize(static_cast<uint64_t>(chr_rom_size) + chr_ram_size);  // One of them is always going to be 0
-        mirroring = (header[6] & 0x1) ? Mirroring::vertical : Mirroring::horizontal;
+        if (header[6] & 0x8) mirroring = Mirroring::four_screen;
+        else mirroring = (header[6] & 0x1) ? Mirroring::vertical : Mirroring::horizontal;
         prg_ram_battery = header[6] & 0x2;
         trainer = header[6] & 0x4;
         flags_6 = header[6];  // This can be separated later
 
         bool overwritten = (header[11] + header[12] + header[13] + header[14] + header[15]) != 0;
         if (overwritten) {
-            log_helper.AddLog("Incorrect header, ignoring bytes 7-15!\n");
+            log_helper.AddLog("Incorrect header, ignoring bytes 7-15!\n", LogCategory::memory, LogLevel::warning);
             mapper = header[6] >> 4;
         }
         else {
@@ -94,7 +159,7 @@ bool Memory::ReadHeader() {
 
     }
     else {  // NES 2.0 header
-        log_helper.AddLog("NES 2.0 is currently unsupported!\n");
+        log_helper.AddLog("NES 2.0 is currently unsupported!\n", LogCategory::memory, LogLevel::error);
         return true;
         /*
         uint8_t prg_nibble = header[9] & 0x0F;
@@ -141,41 +206,183 @@ bool Memory::ReadHeader() {
 
 bool Memory::SetupMapper() {
     if (mapper == 0) { // NROM
-        memcpy(&cpu_memory[0x8000], &prg_memory[0], 0x4000);
-
         bool nrom_256 = false;
         if (prg_rom_size == 0x8000) nrom_256 = true;
-        if (nrom_256) memcpy(&cpu_memory[0xC000], &prg_memory[0x4000], 0x4000);
 
-        memcpy(&ppu->ppu_memory[0], &chr_memory[0], 0x2000);
+        if (chr_rom_size) chr = &rom->chr[0];
+        else {  // CHR-RAM
+            memset(&ppu->ppu_memory[0], 0, 0x2000);
+            chr = &ppu->ppu_memory[0];
+        }
+        ppu->InvalidateViewers();
         curr_mapper = std::make_unique<NROM>(nrom_256);
+        SetupPrgRam();
+        SetMirroring(mirroring);
+        MapPages();
         return 0;
     }
 
     return 1;
 }
 
-uint8_t Memory::Read(const uint16_t addr) {
-    if (addr <= 0x1FFF) return cpu_ram[addr & 0x7FF];
+void Memory::SetupPrgRam() {
+    uint32_t size = (prg_ram_size == 0) ? 0x2000 : std::min<uint32_t>(prg_ram_size, 0x2000);  // 0 means 8 KB for compatibility
+    save_ram.Close();
+
+    if (prg_ram_battery && use_save_file) {
+        std::string save_path = rom_path.substr(0, rom_path.find_last_of('.')) + ".sav";
+        if (!save_ram.Open(save_path, size)) {
+            prg_ram = save_ram.GetData();
+            return;
+        }
+    }
+
+    prg_ram_buffer.assign(0x2000, 0);
+    prg_ram = &prg_ram_buffer[0];
+}
+
+void Memory::MapPages() {
+    EZNES_COUNT(counters, Counters::remap);
+    for (int page = 0; page < 0x100; ++page) MapPage(page);
 
-    else if (addr >= 0x2000 && addr <= 0x3FFF) return ppu->ReadPpuReg(addr & 0x7);
+    code_pages.reset();
+    dirty_code_pages.reset();
+    ++map_generation;
+    ++code_generation;
+}
+
+void Memory::MapPage(const int page) {
+    uint16_t addr = static_cast<uint16_t>(page << 8);
+    read_pages[page] = nullptr;
+    write_pages[page] = nullptr;
+    page_phys[page] = addr;
+
+    if (addr <= 0x1FFF) {
+        read_pages[page] = write_pages[page] = &cpu_ram[addr & 0x7FF];
+        page_phys[page] = addr & 0x7FF;
+    }
+    else if (addr >= 0x6000 && addr <= 0x7FFF) {
+        read_pages[page] = &prg_ram[addr & 0x1FFF];
+        if (!prg_ram_battery) write_pages[page] = &prg_ram[addr & 0x1FFF];  // Battery writes have to mark the save dirty
+    }
+    else if (curr_mapper && (addr >= 0x8000 || (addr >= 0x4100 && curr_mapper->DecodesExpansion()))) {  // Bank granularity is never smaller than a page
+        const uint32_t phys = curr_mapper->TranslateAddress(addr);
+        page_phys[page] = phys;
+        if (phys < ROM_START) read_pages[page] = write_pages[page] = &cpu_memory[phys];
+        else if (phys - ROM_START < rom->prg.size()) read_pages[page] = &rom->prg[phys - ROM_START];  // Shared, so never written
+    }
+}
 
-    else if (addr >= 0x4000 && addr <= 0x4015) return 0;  // TODO: APU
+// Sends the writes to every mirror of the page through WriteSlow, which notices when decoded code is modified
+void Memory::ProtectCodePage(const uint32_t phys_page) {
+    if (code_pages[phys_page] || phys_page >= ROM_START >> 8) return;  // ROM writes never reach it anyway
+    code_pages[phys_page] = true;
+    for (int page = 0; page < 0x100; ++page) {
+        if ((page_phys[page] >> 8) == phys_page) write_pages[page] = nullptr;
+    }
+}
+
+// The page's decoded code is out of date, its writes go straight to memory again until it is decoded anew
+void Memory::UnprotectCodePage(const uint32_t phys_page) {
+    code_pages[phys_page] = false;
+    dirty_code_pages[phys_page] = true;
+    ++code_generation;
+    for (int page = 0; page < 0x100; ++page) {
+        if ((page_phys[page] >> 8) == phys_page) MapPage(page);
+    }
+}
+
+// ROM can not change, so only the memory the game can write is saved
+void Memory::SaveState(StateWriter& state) const {
+    state.Write(&cpu_ram[0], RAM_SIZE);
+    state.Write(prg_ram, PRG_RAM_SIZE);
+    state.Write(&cpu_memory[0x4000], EXPANSION_SIZE);
+    state.Write(static_cast<uint8_t>(mirroring));
+    for (int i = 0; i < 2; ++i) {
+        state.Write(static_cast<uint8_t>(controller[i].to_ulong()));
+        state.Write(controller_shift[i]);
+    }
+    state.Write(open_bus);
+}
+
+// The page table only depends on the mapper, which has no state of its own yet, so it is kept as it is.
+// Decoded code only has to go where the state brings different bytes.
+bool Memory::LoadState(StateReader& state) {
+    uint8_t mode{}, buttons[2]{};
+    LoadPages(state, &cpu_ram[0], 0x0000, RAM_SIZE);
+    LoadPages(state, prg_ram, 0x6000, PRG_RAM_SIZE);
+    LoadPages(state, &cpu_memory[0x4000], 0x4000, EXPANSION_SIZE);
+    state.Read(mode);
+    for (int i = 0; i < 2; ++i) {
+        state.Read(buttons[i]);
+        state.Read(controller_shift[i]);
+    }
+    state.Read(open_bus);
+    if (state.HasError() || mode > static_cast<uint8_t>(Mirroring::four_screen)) return true;
+
+    for (int i = 0; i < 2; ++i) controller[i] = buttons[i];
+    if (prg_ram_battery) save_ram.Touch();
+    SetMirroring(static_cast<Mirroring>(mode));
+    return false;
+}
+
+// Reads size bytes of memory at physical address phys, pages holding decoded code are only replaced when they differ
+void Memory::LoadPages(StateReader& state, uint8_t* data, const uint32_t phys, const uint32_t size) {
+    for (uint32_t offset = 0; offset < size; offset += 0x100) {
+        const uint32_t phys_page = (phys + offset) >> 8;
+        if (!code_pages[phys_page]) {
+            state.Read(data + offset, 0x100);
+            continue;
+        }
+        uint8_t page[0x100];
+        state.Read(&page[0], sizeof(page));
+        if (!memcmp(data + offset, &page[0], sizeof(page))) continue;
+        UnprotectCodePage(phys_page);
+        memcpy(data + offset, &page[0], sizeof(page));
+    }
+}
+
+bool Memory::CheckState(StateReader& state) const {
+    uint8_t mode{};
+    state.Skip(RAM_SIZE + PRG_RAM_SIZE + EXPANSION_SIZE);
+    state.Read(mode);
+    state.Skip(sizeof(controller_shift) + 2 + sizeof(open_bus));  // Controller buttons are saved as one byte each
+    return state.HasError() || mode > static_cast<uint8_t>(Mirroring::four_screen);
+}
+
+uint8_t Memory::ReadSlow(const uint16_t addr) {
+    if (addr >= 0x2000 && addr <= 0x3FFF) return ppu->ReadPpuReg(addr & 0x7);
 
     else if (addr == 0x4016 || addr == 0x4017) {
         uint8_t player_num = (addr == 0x4016) ? 0 : 1;
         bool is_pressed = controller_shift[player_num] & 0x80;
         controller_shift[player_num] <<= 1;
-        return is_pressed;
+        return (open_bus & 0xE0) | is_pressed;  // Only the low bits are driven
     }
 
-    else return cpu_memory[curr_mapper->TranslateAddress(addr)];
+    else if (addr >= 0x4000 && addr <= 0x401F) return open_bus;  // TODO: APU
+
+    else if (addr >= 0x6000 && addr <= 0x7FFF) return prg_ram[addr & 0x1FFF];
+
+    else if (addr < 0x6000 && !curr_mapper->DecodesExpansion()) return open_bus;  // Nothing drives the bus
+
+    const uint32_t phys = curr_mapper->TranslateAddress(addr);
+    if (phys < ROM_START) return cpu_memory[phys];
+    return phys - ROM_START < rom->prg.size() ? rom->prg[phys - ROM_START] : open_bus;
 }
 
-void Memory::Write(const uint16_t addr, const uint8_t byte) {
-    if (addr <= 0x1FFF) cpu_ram[addr & 0x7FF] = byte;
+void Memory::WriteSlow(const uint16_t addr, const uint8_t byte) {
+    const uint32_t phys_page = page_phys[addr >> 8] >> 8;
+    if (phys_page < code_pages.size() && code_pages[phys_page]) {  // Self-modifying code, unprotect the page until it is decoded again
+        UnprotectCodePage(phys_page);
+        if (write_pages[addr >> 8]) {
+            write_pages[addr >> 8][addr & 0xFF] = byte;
+            return;
+        }
+    }
+    if (write_log) write_log->push_back({addr, byte});
 
-    else if (addr >= 0x2000 && addr <= 0x3FFF) ppu->WritePpuReg(addr & 0x7, byte);
+    if (addr >= 0x2000 && addr <= 0x3FFF) ppu->WritePpuReg(addr & 0x7, byte);
 
     else if (addr >= 0x4000 && addr <= 0x4015);  // TODO: APU
 
@@ -184,26 +391,26 @@ void Memory::Write(const uint16_t addr, const uint8_t byte) {
         controller_shift[player_num] = static_cast<uint8_t>(controller[player_num].to_ulong());
     }
 
+    else if (addr >= 0x6000 && addr <= 0x7FFF) {
+        prg_ram[addr & 0x1FFF] = byte;
+        if (prg_ram_battery) save_ram.Touch();
+    }
+
+    else if (addr < 0x6000 && !curr_mapper->DecodesExpansion());
+
+    else if (addr >= 0x8000);  // ROM, mappers with registers would take the write here
+
     else cpu_memory[curr_mapper->TranslateAddress(addr)] = byte;
 }
+
 uint8_t Memory::PpuRead(/*const*/ uint16_t addr) {
     //assert(addr <= 0x3FFF);
     addr &= 0x3FFF;
+    EZNES_COUNT(counters, Counters::ppu_read + Counters::GetPpuRegion(addr));
 
-    if (addr <= 0x1FFF) return ppu->ppu_memory[curr_mapper->TranslatePpuAddress(addr)];
+    if (addr <= 0x1FFF) return chr[curr_mapper->TranslatePpuAddress(addr)];
 
-    else if (addr >= 0x2000 && addr <= 0x3EFF) {
-        if (mirroring == Mirroring::vertical) {
-            return ppu->ppu_memory[addr & 0x27FF];
-        }
-        else if (mirroring == Mirroring::horizontal) {
-            return ppu->ppu_memory[addr & 0x2BFF];
-        }
-        else {
-            assert(0);  // Unimplemented
-            return 0;
-        }
-    }
+    else if (addr >= 0x2000 && addr <= 0x3EFF) return nametable[(addr >> 10) & 0x3][addr & 0x3FF];  // Counted above already
 
     else {  // I extracted this into the Ppu::GetColorFromPalette function to make it faster
         uint16_t temp = addr & 0x3F1F;
@@ -218,16 +425,18 @@ uint8_t Memory::PpuRead(/*const*/ uint16_t addr) {
 
 void Memory::PpuWrite(const uint16_t addr, const uint8_t byte) {
     assert(addr <= 0x3FFF);
+    EZNES_COUNT(counters, Counters::ppu_write + Counters::GetPpuRegion(addr));
 
-    if (addr <= 0x1FFF) ppu->ppu_memory[curr_mapper->TranslatePpuAddress(addr)] = byte;
+    if (addr <= 0x1FFF) {
+        if (chr_rom_size) return;  // CHR-ROM
+        const uint32_t phys = curr_mapper->TranslatePpuAddress(addr);
+        ppu->ppu_memory[phys] = byte;
+        ppu->MarkViewerWrite(phys);
+    }
 
     else if (addr >= 0x2000 && addr <= 0x3EFF) {
-        if (mirroring == Mirroring::vertical) {
-            ppu->ppu_memory[addr & 0x27FF] = byte;
-        }
-        else if (mirroring == Mirroring::horizontal) {
-            ppu->ppu_memory[addr & 0x2BFF] = byte;
-        }
+        NametableWrite(addr, byte);
+        ppu->MarkViewerWrite(GetNametableAddress((addr >> 10) & 0x3) + (addr & 0x3FF));
     }
 
     else {
@@ -240,3 +449,22 @@ void Memory::PpuWrite(const uint16_t addr, const uint8_t byte) {
         ppu->ppu_memory[temp] = byte;
     }
 }
+
+uint16_t Memory::GetNametableAddress(const int index) const {
+    return static_cast<uint16_t>(nametable[index] - &ppu->ppu_memory[0]);
+}
+
+void Memory::SetMirroring(const Mirroring mode) {
+    // Offsets of the physical 1 KB pages in VRAM, four-screen uses the whole $2000-$2FFF area
+    static const uint16_t layouts[5][4] = {
+        {0x2000, 0x2000, 0x2800, 0x2800},  // Horizontal
+        {0x2000, 0x2400, 0x2000, 0x2400},  // Vertical
+        {0x2000, 0x2000, 0x2000, 0x2000},  // Single-screen A
+        {0x2400, 0x2400, 0x2400, 0x2400},  // Single-screen B
+        {0x2000, 0x2400, 0x2800, 0x2C00}   // Four-screen
+    };
+
+    mirroring = mode;
+    const uint16_t* layout = layouts[static_cast<int>(mode)];
+    for (int i = 0; i < 4; ++i) nametable[i] = &ppu->ppu_memory[layout[i]];
+}
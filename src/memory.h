@@ -6,37 +6,130 @@
 #include <string>
 #include <vector>
 
+#include "archive.h"
+#include "counters.h"
 #include "log.h"
+#include "save_ram.h"
+#include "state.h"
 
 #include "mappers/nrom.h"
 
 
 class Ppu;
 
+// Cartridge ROM as it was read from the file. Nothing writes to it once loaded, so consoles running the same game
+// share one.
+struct CartridgeRom {
+    std::vector<uint8_t> prg{};
+    std::vector<uint8_t> chr{};  // Empty when the cartridge has CHR-RAM
+};
+
+struct MemoryWrite {
+    uint16_t addr;
+    uint8_t byte;
+};
+
 class Memory {
 public:
     Ppu* ppu = nullptr;
 
+    enum class Mirroring {
+        horizontal = 0,
+        vertical,
+        single_screen_a,
+        single_screen_b,
+        four_screen
+    };
+
     Memory();
     bool LoadROM(std::string location);
+    bool LoadROM(std::string location, const ArchiveEntry& entry);
+    bool LoadROM(const Memory& other);  // Shares the ROM another console has loaded
     bool ReadHeader();
     bool SetupMapper();
-    uint8_t Read(uint16_t addr);
-    void Write(uint16_t addr, uint8_t byte);
+    void SetupPrgRam();
+    void MapPages();
+    void ProtectCodePage(uint32_t phys_page);
+    void SaveState(StateWriter& state) const;  // Only what can be written, ROM is left out
+    bool LoadState(StateReader& state);  // Keeps everything decoded from code the state does not change
+    bool CheckState(StateReader& state) const;  // True when the mirroring mode is invalid
+    uint8_t ReadSlow(uint16_t addr);
+    void WriteSlow(uint16_t addr, uint8_t byte);
+    inline uint8_t Read(uint16_t addr) {
+        EZNES_COUNT(counters, Counters::cpu_read + Counters::GetCpuRegion(addr));
+        const uint8_t* page = read_pages[addr >> 8];
+        open_bus = page ? page[addr & 0xFF] : ReadSlow(addr);
+        return open_bus;
+    }
+    // Reads without side effects for debugging, registers and other unmapped pages read as 0
+    inline uint8_t Peek(uint16_t addr) const {
+        const uint8_t* page = read_pages[addr >> 8];
+        return page ? page[addr & 0xFF] : 0;
+    }
+    // Address with mirroring and banking resolved, the same code or data always has the same physical address
+    inline uint32_t GetPhysicalAddress(uint16_t addr) const { return page_phys[addr >> 8] | (addr & 0xFF); }
+    inline void Write(uint16_t addr, uint8_t byte) {
+        EZNES_COUNT(counters, Counters::cpu_write + Counters::GetCpuRegion(addr));
+        open_bus = byte;
+        uint8_t* page = write_pages[addr >> 8];
+        if (page) page[addr & 0xFF] = byte;
+        else WriteSlow(addr, byte);
+    }
     uint8_t PpuRead(uint16_t addr);
     void PpuWrite(uint16_t addr, uint8_t byte);
+    void SetMirroring(Mirroring mode);  // Mappers with mirroring control call this on every change
+    inline uint32_t GetPpuPhysicalAddress(uint16_t addr) const { return curr_mapper ? curr_mapper->TranslatePpuAddress(addr & 0x1FFF) : addr & 0x1FFF; }  // CHR only
+    inline uint8_t PeekChr(uint16_t addr) const { return chr ? chr[GetPpuPhysicalAddress(addr)] : 0; }  // Pattern tables without counting the read
+    uint16_t GetNametableAddress(int index) const;  // Where in ppu_memory one of the four nametables is
+    inline uint8_t NametableRead(uint16_t addr) {  // The renderer's fetches, counted like PpuRead
+        EZNES_COUNT(counters, Counters::ppu_read + 1);
+        return nametable[(addr >> 10) & 0x3][addr & 0x3FF];
+    }
+    inline void NametableWrite(uint16_t addr, uint8_t byte) { nametable[(addr >> 10) & 0x3][addr & 0x3FF] = byte; }
 
     std::string rom_path = "";
+    bool use_save_file = true;  // Off for consoles that must not touch the .sav next to the ROM
     std::bitset<8> controller[2] = {0b00000000, 0b00000000};
     uint8_t controller_shift[2] = {0, 0};
+    uint8_t open_bus{};  // Last value seen on the CPU data bus
+    Counters counters{};  // For the whole console, not part of save states
+    std::vector<MemoryWrite>* write_log = nullptr;  // When set, gets every write to I/O, the mapper and battery RAM
+
+    // 256 byte pages, a null entry sends the access through the slow path (I/O, ROM writes, battery RAM)
+    const uint8_t* read_pages[0x100]{};
+    uint8_t* write_pages[0x100]{};
+    uint32_t page_phys[0x100]{};  // Physical address of each page, RAM mirrors fold onto $0000-$07FF
+    static constexpr uint32_t PHYS_SIZE = 0x10000;
+    static constexpr uint32_t RAM_SIZE = 0x800;
+    static constexpr uint32_t PRG_RAM_SIZE = 0x2000;
+    static constexpr uint32_t EXPANSION_SIZE = 0x2000;  // $4000-$5FFF, RAM on the cartridges that decode it
+    static constexpr uint32_t ROM_START = 0x8000;  // Physical addresses from here on are cartridge ROM, which is never written
+    inline uint8_t* GetRam() { return &cpu_ram[0]; }
+    inline uint8_t* GetPrgRam() { return prg_ram; }
+    inline void EndFrame() { if (prg_ram_battery) save_ram.Update(); }  // Gives the battery save flusher a copy when it asked for one
+
+    // Decoded code caches compare these to find out when to drop blocks
+    uint32_t code_generation{};  // Bumped by every change below
+    uint32_t map_generation{};  // Bumped when the page table is rebuilt, e.g. on a bank switch
+    std::bitset<PHYS_SIZE / 0x100> dirty_code_pages{};  // Physical pages holding decoded code that has been written to
 
 private:
-    std::vector<uint8_t> cpu_memory{};
-    std::vector<uint8_t> prg_memory{};
-    std::vector<uint8_t> chr_memory{};
-    uint8_t cpu_ram[0x800]{};
+    std::vector<uint8_t> cpu_memory{};  // Physical addresses below ROM_START, only $4000-$5FFF is used, by mappers that decode it
+    std::shared_ptr<const CartridgeRom> rom{};
+    std::shared_ptr<CartridgeRom> loading_rom{};  // Filled while the file is read
+    const uint8_t* chr = nullptr;  // Pattern tables, the CHR-ROM or the CHR-RAM at the start of ppu_memory
+    uint8_t cpu_ram[RAM_SIZE]{};
+    uint8_t* prg_ram = nullptr;  // $6000-$7FFF, points into save_ram when the cartridge has a battery
+    std::vector<uint8_t> prg_ram_buffer{};
+    SaveRam save_ram{};
+    std::bitset<PHYS_SIZE / 0x100> code_pages{};  // Physical pages with decoded code, their writes go through the slow path
+    void MapPage(int page);
+    void UnprotectCodePage(uint32_t phys_page);
+    void LoadPages(StateReader& state, uint8_t* data, uint32_t phys, uint32_t size);
 
-    FILE* input_ROM = nullptr;
+    uint32_t rom_stream_pos{};
+    bool ConsumeROMData(const uint8_t* data, size_t size);
+    bool FinishROMData();
 
     std::unique_ptr<Mapper> curr_mapper{};
 
@@ -51,10 +144,8 @@ private:
           nametable mirroring type----|*/
     bool prg_ram_battery = false;
     bool trainer = false;
-    enum class Mirroring {
-        horizontal = 0,
-        vertical
-    } mirroring{};
+    Mirroring mirroring{};
+    uint8_t* nametable[4]{};  // 1 KB pages for $2000, $2400, $2800 and $2C00
     uint16_t mapper{};
     uint8_t submapper{};
     uint32_t prg_ram_size{}, eeprom_size{};
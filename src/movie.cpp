@@ -0,0 +1,39 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "movie.h"
+
+
+// Input lines look like |commands|RLDUTSBA|RLDUTSBA||, any character but '.' and ' ' is a pressed button.
+// That order is Right, Left, Down, Up, Start, Select, B, A, which is exactly the bit order of the controller.
+bool Movie::Load(const std::string& location) {
+    FILE* file = nullptr;
+    if (fopen_s(&file, location.c_str(), "r")) return true;
+    frames.clear();
+
+    char line[256];
+    while (fgets(&line[0], sizeof(line), file)) {
+        if (line[0] != '|') continue;
+
+        Frame frame;
+        char* field = &line[1];
+        const int commands = atoi(field);
+        frame.reset = (commands & 1) != 0;
+        frame.power = (commands & 2) != 0;
+
+        for (int port = 0; port < 2; ++port) {
+            field = strchr(field, '|');
+            if (!field) break;
+            ++field;
+            for (int button = 0; button < 8 && field[button] && field[button] != '|'; ++button) {
+                frame.controller[port][button] = field[button] != '.' && field[button] != ' ';
+            }
+        }
+        frames.push_back(frame);
+    }
+
+    bool error = ferror(file) != 0;
+    fclose(file);
+    return error;
+}
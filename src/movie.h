@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+#include <bitset>
+#include <string>
+#include <vector>
+
+
+// Controller input recorded per frame, read from FCEUX .fm2 files. Only the input log is used,
+// the header is skipped and a movie always starts from power-on.
+class Movie {
+public:
+    struct Frame {
+        std::bitset<8> controller[2]{};  // Same bit order as Memory::controller
+        bool reset = false;
+        bool power = false;
+    };
+
+    bool Load(const std::string& location);
+    inline size_t GetFrameCount() const { return frames.size(); }
+    inline const Frame& GetFrame(size_t index) const { return frames[index]; }
+
+private:
+    std::vector<Frame> frames{};
+};
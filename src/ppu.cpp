@@ -1,3 +1,8 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "hash.h"
+#include "image_file.h"
 #include "ppu.h"
 
 Ppu::Ppu() {
@@ -18,6 +23,14 @@ Ppu::Ppu() {
     palette[0x3c] = 0x92E4EBFF; palette[0x3d] = 0xA7A7A7FF; palette[0x3e] = 0x000000FF; palette[0x3f] = 0x000000FF;
 }
 
+Ppu::~Ppu() {
+    delete image_data;
+    delete pattern_table_data;
+    delete palette_data;
+    delete nametable_data;
+    delete indexed_data;
+}
+
 void Ppu::Run() {
     if (memory->rom_path == "") return;  // Do not start until the game has launched
 
@@ -43,11 +56,11 @@ void Ppu::Run() {
                 bg_shift_attrib_hi &= 0xFF00; bg_shift_attrib_hi |= ((bg_next_tile_attr & 2) ? 0xFF : 0x00);
                 bg_shift_attrib_lo &= 0xFF00; bg_shift_attrib_lo |= ((bg_next_tile_attr & 1) ? 0xFF : 0x00);
 
-                bg_next_tile_id = memory->PpuRead(0x2000 | (vram_addr.raw & 0xFFF));
+                bg_next_tile_id = memory->NametableRead(vram_addr.raw);
                 break;
             case 2:
                 temp = (vram_addr.nametable_y << 11) | (vram_addr.nametable_x << 10) | ((vram_addr.coarse_y >> 2) << 3) | (vram_addr.coarse_x >> 2);
-                bg_next_tile_attr = memory->PpuRead(0x2000 | 0x3C0 | temp);
+                bg_next_tile_attr = memory->NametableRead(0x3C0 | temp);
                 if (vram_addr.coarse_y & 2) bg_next_tile_attr >>= 4;
                 if (vram_addr.coarse_x & 2) bg_next_tile_attr >>= 2;
                 bg_next_tile_attr &= 3;
@@ -97,7 +110,7 @@ void Ppu::Run() {
             }
         }
         else if (cycle == 338 || cycle == 340) {
-            bg_next_tile_id = memory->PpuRead(0x2000 | (vram_addr.raw & 0xFFF));
+            bg_next_tile_id = memory->NametableRead(vram_addr.raw);
         }
         if (scanline == -1 && cycle >= 280 && cycle < 305) {
             if (PPUMASK.show_backgrnd || PPUMASK.show_sprite) {
@@ -125,19 +138,49 @@ void Ppu::Run() {
         bg_palette = (pal_hi << 1) | pal_lo;
     }
 
-    if(scanline >= 0 && scanline <= 239 && cycle > 0 && cycle <= 255) (*image_data)[scanline][cycle - 1LL] = GetColorFromPalette(bg_palette, bg_pixel);
+    if(scanline >= 0 && scanline <= 239 && cycle > 0 && cycle <= 255) {
+        const uint8_t index = GetPaletteIndex(bg_palette, bg_pixel);
+        if (indexed_output) {
+            (*indexed_data)[scanline][cycle - 1LL] = index;
+            if (cycle == 1) line_emphasis[scanline] = PPUMASK.raw >> 5;
+        }
+        if (rgba_output) (*image_data)[scanline][cycle - 1LL] = palette[index];
+        if (observation_scale && !((scanline | (cycle - 1)) & observation_mask)) WriteObservation(cycle - 1, scanline, palette[index]);
+    }
 
     ++cycle;
     if (cycle >= 341) {
+        if (line_hashing && scanline >= 0 && scanline <= 239) HashLine(scanline);
         ++scanline;
         cycle = 0;
         if (scanline >= 261) {
             scanline = -1;
             frame_done = true;
+            ++frame_count;
         }
     }
 }
 
+// Events are the ticks after which the CPU could observe a change: vblank being set or cleared, or the frame ending.
+// Positions are counted from dot 0 of the pre-render line and always point at the next tick to run.
+constexpr int32_t vblank_clear = 1, vblank_set = 242 * 341 + 1, frame_end = 262 * 341;
+
+uint32_t Ppu::TicksUntilEvent() const {
+    const int32_t position = (scanline + 1) * 341 + cycle;
+
+    if (position <= vblank_clear) return vblank_clear - position;
+    if (position <= vblank_set) return vblank_set - position;
+    return frame_end - position;
+}
+
+uint32_t Ppu::TicksSinceEvent() const {
+    const int32_t position = (scanline + 1) * 341 + cycle;
+
+    if (position > vblank_set) return position - vblank_set - 1;
+    if (position > vblank_clear) return position - vblank_clear - 1;
+    return position;
+}
+
 void Ppu::Reset() {
     scanline = 0; cycle = 0;
     addr_latch = 0; ppu_addr_buff = 0;
@@ -146,38 +189,157 @@ void Ppu::Reset() {
     bg_shift_pattern_lo = 0; bg_shift_pattern_hi = 0; bg_shift_attrib_lo = 0; bg_shift_attrib_hi = 0;
 }
 
-inline uint32_t Ppu::GetColorFromPalette(uint8_t palette_id, uint8_t pixel) {
-    // return palette[memory->PpuRead(0x3F00 + (palette_id << 2) + pixel)];
+void Ppu::SaveState(StateWriter& state) const {
+    state.Write(ppu_memory.data(), ppu_memory.size());
+    state.Write(nmi); state.Write(frame_done); state.Write(frame_count);
+    state.Write(scanline); state.Write(cycle);
+    state.Write(addr_latch); state.Write(ppu_addr_buff);
+    state.Write(io_latch); state.Write(io_latch_refresh_frame);
+    state.Write(fine_x);
+    state.Write(bg_next_tile_id); state.Write(bg_next_tile_attr); state.Write(bg_next_tile_lsb); state.Write(bg_next_tile_msb);
+    state.Write(bg_shift_pattern_lo); state.Write(bg_shift_pattern_hi); state.Write(bg_shift_attrib_lo); state.Write(bg_shift_attrib_hi);
+    state.Write(bitmask);
+    state.Write(bg_pixel); state.Write(bg_palette); state.Write(pix_hi); state.Write(pix_lo); state.Write(pal_hi); state.Write(pal_lo);
+    state.Write(vram_addr.raw); state.Write(temp_vram_addr.raw);
+    state.Write(PPUCTRL.raw); state.Write(PPUMASK.raw); state.Write(PPUSTATUS.raw);
+    state.Write(OAM_ptr, sizeof(OAM));
+    state.Write(OAM_addr);
+}
+
+bool Ppu::LoadState(StateReader& state) {
+    state.Read(ppu_memory.data(), ppu_memory.size());
+    state.Read(nmi); state.Read(frame_done); state.Read(frame_count);
+    state.Read(scanline); state.Read(cycle);
+    state.Read(addr_latch); state.Read(ppu_addr_buff);
+    state.Read(io_latch); state.Read(io_latch_refresh_frame);
+    state.Read(fine_x);
+    state.Read(bg_next_tile_id); state.Read(bg_next_tile_attr); state.Read(bg_next_tile_lsb); state.Read(bg_next_tile_msb);
+    state.Read(bg_shift_pattern_lo); state.Read(bg_shift_pattern_hi); state.Read(bg_shift_attrib_lo); state.Read(bg_shift_attrib_hi);
+    state.Read(bitmask);
+    state.Read(bg_pixel); state.Read(bg_palette); state.Read(pix_hi); state.Read(pix_lo); state.Read(pal_hi); state.Read(pal_lo);
+    state.Read(vram_addr.raw); state.Read(temp_vram_addr.raw);
+    state.Read(PPUCTRL.raw); state.Read(PPUMASK.raw); state.Read(PPUSTATUS.raw);
+    state.Read(OAM_ptr, sizeof(OAM));
+    state.Read(OAM_addr);
+    InvalidateViewers();
+    return state.HasError();
+}
+
+bool Ppu::CheckState(StateReader& state) const {
+    uint8_t flags[2]{};  // nmi and frame_done, anything but 0 and 1 is not a bool
+    int16_t position[2]{};  // scanline and cycle
+    state.Skip(ppu_memory.size());
+    state.Read(flags);
+    state.Skip(sizeof(frame_count));
+    state.Read(position);
+    state.Skip(sizeof(addr_latch) + sizeof(ppu_addr_buff) + sizeof(io_latch) + sizeof(io_latch_refresh_frame) + sizeof(fine_x) +
+               sizeof(bg_next_tile_id) + sizeof(bg_next_tile_attr) + sizeof(bg_next_tile_lsb) + sizeof(bg_next_tile_msb) +
+               sizeof(bg_shift_pattern_lo) + sizeof(bg_shift_pattern_hi) + sizeof(bg_shift_attrib_lo) + sizeof(bg_shift_attrib_hi) +
+               sizeof(bitmask) + sizeof(bg_pixel) + sizeof(bg_palette) + sizeof(pix_hi) + sizeof(pix_lo) + sizeof(pal_hi) + sizeof(pal_lo) +
+               sizeof(vram_addr.raw) + sizeof(temp_vram_addr.raw) + sizeof(PPUCTRL.raw) + sizeof(PPUMASK.raw) + sizeof(PPUSTATUS.raw) +
+               sizeof(OAM) + sizeof(OAM_addr));
+    return state.HasError() || flags[0] > 1 || flags[1] > 1 || position[0] < -1 || position[0] > 260 || position[1] < 0 || position[1] > 340;
+}
+
+bool Ppu::SetObservation(uint32_t scale, bool greyscale) {
+    if (scale > 8 || (scale & (scale - 1))) return true;  // Powers of two keep the skip test a mask
+    observation_scale = scale;
+    observation_mask = scale ? scale - 1 : 0;
+    observation_greyscale = greyscale;
+    observation.assign(GetObservationWidth() * GetObservationHeight() * GetObservationChannels(), 0);
+    return false;
+}
+
+void Ppu::HashLine(int line) {
+    const uint64_t hash = indexed_output ? Hash64(&(*indexed_data)[line][0], 256, line_emphasis[line])
+                                         : Hash64(reinterpret_cast<const uint8_t*>(&(*image_data)[line][0]), 256 * sizeof(uint32_t));
+    dirty_lines[line] = hash != line_hashes[line];
+    line_hashes[line] = hash;
+    if (line == 239) frame_hash = Hash64(reinterpret_cast<const uint8_t*>(&line_hashes[0]), sizeof(line_hashes));
+}
+
+void Ppu::WriteObservation(uint32_t x, uint32_t y, uint32_t color) {
+    const uint8_t r = color >> 24, g = (color >> 16) & 0xFF, b = (color >> 8) & 0xFF;
+    const uint32_t index = (y / observation_scale) * GetObservationWidth() + x / observation_scale;
+    if (observation_greyscale) observation[index] = static_cast<uint8_t>((r * 77 + g * 150 + b * 29) >> 8);  // BT.601 luma
+    else {
+        uint8_t* pixel = &observation[index * 3];
+        pixel[0] = r; pixel[1] = g; pixel[2] = b;
+    }
+}
+
+inline uint8_t Ppu::GetPaletteIndex(uint8_t palette_id, uint8_t pixel) {
+    // return memory->PpuRead(0x3F00 + (palette_id << 2) + pixel);
     uint8_t temp = (palette_id << 2) + pixel;
     if (temp == 0x10) temp = 0x00;
     else if (temp == 0x14) temp = 0x04;
     else if (temp == 0x18) temp = 0x08;
     else if (temp == 0x1C) temp = 0x0C;
 
-    return palette[ppu_memory[0x3F00LL + temp] & (GetGreyscale() ? 0x30 : 0x3F)];
+    return ppu_memory[0x3F00LL + temp] & (GetGreyscale() ? 0x30 : 0x3F);
+}
+
+inline uint32_t Ppu::GetColorFromPalette(uint8_t palette_id, uint8_t pixel) {
+    return palette[GetPaletteIndex(palette_id, pixel)];
+}
+
+void Ppu::MarkViewerWrite(uint32_t phys) {
+    if (phys < 0x2000) {
+        pattern_viewer_tiles[phys >> 4] = true;
+        nametable_viewer_tiles[phys >> 4] = true;
+    }
+    else if (phys < 0x3000) nametable_viewer_cells[phys - 0x2000] = true;
+}
+
+void Ppu::InvalidateViewers() {
+    pattern_viewer_tiles.set();
+    nametable_viewer_tiles.set();
+    nametable_viewer_cells.set();
+}
+
+void Ppu::DrawViewerTile(uint32_t* dest, size_t pitch, uint16_t pattern_addr, const uint32_t* colors) {
+    for (uint8_t row = 0; row < 8; ++row) {
+        uint8_t lsb = memory->PeekChr(pattern_addr + row);  // Not through PpuRead, that would count them
+        uint8_t msb = memory->PeekChr(pattern_addr + row + 8);
+        for (uint8_t col = 0; col < 8; ++col) {
+            uint8_t pixel = ((msb & 1) << 1) | (lsb & 1);
+            lsb >>= 1; msb >>= 1;
+
+            dest[row * pitch + (7 - col)] = colors[pixel];
+        }
+    }
 }
 
 void Ppu::SetPatternTables(uint8_t palette_id) {
+    EZNES_TIME(memory->counters, Counters::viewer_time);
+    if (!pattern_table_data) {
+        pattern_table_data = new std::array<std::array<std::array<uint32_t, 128>, 128>, 2>;
+        pattern_viewer_tiles.set();
+    }
+    uint32_t colors[4];
+    for (uint8_t pixel = 0; pixel < 4; ++pixel) colors[pixel] = GetColorFromPalette(palette_id, pixel);
+    if (memcmp(&colors[0], &pattern_viewer_colors[0], sizeof(colors))) {
+        memcpy(&pattern_viewer_colors[0], &colors[0], sizeof(colors));
+        pattern_viewer_tiles.set();
+    }
+
     for (uint8_t ptable = 0; ptable < 2; ++ptable) {
+        pattern_table_lines[ptable].reset();
+        if (pattern_viewer_tiles.none()) continue;
         for (uint8_t Y = 0; Y < 16; ++Y) {
             for (uint8_t X = 0; X < 16; ++X) {
-                uint16_t offset = (256 * Y) + (16 * X);
-                for (uint8_t row = 0; row < 8; ++row) {
-                    uint8_t lsb = memory->PpuRead(ptable * 0x1000 + offset + row);
-                    uint8_t msb = memory->PpuRead(ptable * 0x1000 + offset + row + 8);
-                    for (uint8_t col = 0; col < 8; ++col) {
-                        uint8_t pixel = ((msb & 1) << 1) | (lsb & 1);
-                        lsb >>= 1; msb >>= 1;
-
-                        (*pattern_table_data)[ptable][Y * 8LL + row][X * 8LL + (7LL - col)] = GetColorFromPalette(palette_id, pixel);
-                    }
-                }
+                const uint16_t pattern_addr = ptable * 0x1000 + (256 * Y) + (16 * X);
+                if (!pattern_viewer_tiles[memory->GetPpuPhysicalAddress(pattern_addr) >> 4]) continue;
+                DrawViewerTile(&(*pattern_table_data)[ptable][Y * 8LL][X * 8LL], 128, pattern_addr, &colors[0]);
+                for (uint8_t row = 0; row < 8; ++row) pattern_table_lines[ptable][Y * 8 + row] = true;
             }
         }
     }
+    pattern_viewer_tiles.reset();
 }
 
 void Ppu::SetPaletteImage() {
+    if (!palette_data) palette_data = new std::array<std::array<uint32_t, 16>, 2>;
     for (uint8_t Y = 0; Y < 2; ++Y) {
         for (uint8_t X = 0; X < 16; ++X) {
             (*palette_data)[Y][X] = GetColorFromPalette((X / 4) + (4 * Y), X % 4);
@@ -185,30 +347,62 @@ void Ppu::SetPaletteImage() {
     }
 }
 
-void Ppu::SetNametables() {  // TODO: optimize this with mirroring detection
+void Ppu::SetNametables() {
+    EZNES_TIME(memory->counters, Counters::viewer_time);
+    if (!nametable_data) {
+        nametable_data = new std::array<std::array<std::array<uint32_t, 256>, 240>, 4>;
+        nametable_viewer_cells.set();
+    }
+    uint32_t colors[16];
+    uint16_t layout[4];
+    for (uint8_t i = 0; i < 16; ++i) colors[i] = GetColorFromPalette(i / 4, i % 4);
+    for (uint8_t i = 0; i < 4; ++i) layout[i] = memory->GetNametableAddress(i);
+    const uint16_t pattern_base = PPUCTRL.backgrnd_addr * 0x1000;
+    if (memcmp(&colors[0], &nametable_viewer_colors[0], sizeof(colors)) || memcmp(&layout[0], &nametable_viewer_layout[0], sizeof(layout)) ||
+        pattern_base != nametable_viewer_pattern_base) {
+        memcpy(&nametable_viewer_colors[0], &colors[0], sizeof(colors));
+        memcpy(&nametable_viewer_layout[0], &layout[0], sizeof(layout));
+        nametable_viewer_pattern_base = pattern_base;
+        nametable_viewer_cells.set();
+    }
+
+    for (uint8_t ntable = 0; ntable < 4; ++ntable) nametable_lines[ntable].reset();
+    if (nametable_viewer_cells.none() && nametable_viewer_tiles.none()) return;
+
     for (uint8_t ntable = 0; ntable < 4; ++ntable) {
+        bool mirror = false;  // Drawn along with an earlier one sharing the same memory
+        for (uint8_t other = 0; other < ntable; ++other) mirror |= layout[other] == layout[ntable];
+        if (mirror) continue;
+
+        const uint32_t base = layout[ntable] - 0x2000;
         for (uint8_t Y = 0; Y < 30; ++Y) {
             for (uint8_t X = 0; X < 32; ++X) {
-                //uint16_t offset = (960 * Y) + (32 * X);
-                uint8_t tile_id = memory->PpuRead(0x2000 + ntable * 0x400 + Y * 32 + X);
-                uint8_t palette_byte = memory->PpuRead(0x23C0 + ntable * 0x400 + (Y / 4) * 8 + X / 4);
-                uint8_t palette_id = (palette_byte >> 2 * ((((Y % 4) / 2) << 1) + ((X % 4) / 2))) & 0b11;
-                for (uint8_t row = 0; row < 8; ++row) {
-                    uint8_t lsb = memory->PpuRead(PPUCTRL.backgrnd_addr * 0x1000 + (tile_id << 4) + row);
-                    uint8_t msb = memory->PpuRead(PPUCTRL.backgrnd_addr * 0x1000 + (tile_id << 4) + row + 8);
-                    for (uint8_t col = 0; col < 8; ++col) {
-                        uint8_t pixel = ((msb & 1) << 1) | (lsb & 1);
-                        lsb >>= 1; msb >>= 1;
-
-                        (*nametable_data)[ntable][Y * 8LL + row][X * 8LL + (7LL - col)] = GetColorFromPalette(palette_id, pixel);
-                    }
+                const uint32_t cell = base + Y * 32 + X;
+                const uint32_t attribute = base + 0x3C0 + (Y / 4) * 8 + X / 4;
+                const uint8_t tile_id = ppu_memory[0x2000 + cell];
+                const uint16_t pattern_addr = pattern_base + (tile_id << 4);
+                if (!nametable_viewer_cells[cell] && !nametable_viewer_cells[attribute] &&
+                    !nametable_viewer_tiles[memory->GetPpuPhysicalAddress(pattern_addr) >> 4]) continue;
+
+                const uint8_t palette_byte = ppu_memory[0x2000 + attribute];
+                const uint8_t palette_id = (palette_byte >> 2 * ((((Y % 4) / 2) << 1) + ((X % 4) / 2))) & 0b11;
+                for (uint8_t target = ntable; target < 4; ++target) {
+                    if (layout[target] != layout[ntable]) continue;
+                    DrawViewerTile(&(*nametable_data)[target][Y * 8LL][X * 8LL], 256, pattern_addr, &colors[palette_id * 4]);
+                    for (uint8_t row = 0; row < 8; ++row) nametable_lines[target][Y * 8 + row] = true;
                 }
             }
         }
     }
+    nametable_viewer_cells.reset();
+    nametable_viewer_tiles.reset();
 }
 
 void Ppu::WritePpuReg(uint8_t id, uint8_t byte) {
+    EZNES_COUNT(memory->counters, Counters::register_write + (id & 0x7));
+    io_latch = byte;
+    io_latch_refresh_frame = frame_count;
+
     switch (id) {
     case 0:  // PPUCTRL
         PPUCTRL.raw = byte;
@@ -257,37 +451,43 @@ void Ppu::WritePpuReg(uint8_t id, uint8_t byte) {
 }
 
 uint8_t Ppu::ReadPpuReg(uint8_t id) {
-    uint8_t data{};
+    // The latch decays after roughly 600 ms without being refreshed, this does all bits at once
+    if (frame_count - io_latch_refresh_frame > 36) io_latch = 0;
+
+    uint8_t data = io_latch;
     switch (id) {
     case 0:  // PPUCTRL
-        break;
+        return data;
     case 1:  // PPUMASK
-        break;
+        return data;
     case 2:  // PPUSTATUS
-        data = (PPUSTATUS.raw & 0xE0) | (ppu_addr_buff & 0x1F);
+        data = (PPUSTATUS.raw & 0xE0) | (io_latch & 0x1F);
         PPUSTATUS.vblank = 0;
         addr_latch = 0;
         break;
     case 3:  // OAMADDR
-        break;
+        return data;
     case 4:  // OAMDATA
         data = OAM_ptr[OAM_addr];
         break;
     case 5:  // PPUSCROLL
-        break;
+        return data;
     case 6:  // PPUADDR
-        break;
+        return data;
     case 7:  // PPUDATA
         data = ppu_addr_buff;
         ppu_addr_buff = memory->PpuRead(vram_addr.raw);
 
-        if (vram_addr.raw >= 0x3F00) data = ppu_addr_buff;
+        if (vram_addr.raw >= 0x3F00) data = (ppu_addr_buff & 0x3F) | (io_latch & 0xC0);  // Palette entries are only 6 bits
         vram_addr.raw += (PPUCTRL.vram_incr ? 32 : 1);
         break;
     }
+
+    io_latch = data;  // Readable registers drive the bus and refresh the latch
+    io_latch_refresh_frame = frame_count;
     return data;
 }
 
-inline bool Ppu::GetGreyscale() {
-    return PPUMASK.greyscale;
+bool Ppu::WriteScreenshot(const std::string& location) const {
+    return WriteImage(location, &(*image_data)[0][0], 256, 240);
 }
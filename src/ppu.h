@@ -1,7 +1,9 @@
 #pragma once
 
 #include <array>
+#include <bitset>
 #include "memory.h"
+#include "state.h"
 
 class Ppu {
 public:
@@ -11,28 +13,81 @@ public:
 
     bool nmi = false;
     bool frame_done = false;
+    uint64_t frame_count{};
     // TODO: Why can't I use auto here?
-    std::array<std::array<uint32_t, 256>, 240>* image_data = new std::array<std::array<uint32_t, 256>, 240>;
-    std::array<std::array<std::array<uint32_t, 128>, 128>, 2>* pattern_table_data = new std::array<std::array<std::array<uint32_t, 128>, 128>, 2>;
-    std::array<std::array<uint32_t, 16>, 2>* palette_data = new std::array<std::array<uint32_t, 16>, 2>;
-    std::array<std::array<std::array<uint32_t, 256>, 240>, 4>* nametable_data = new std::array<std::array<std::array<uint32_t, 256>, 240>, 4>;
+    std::array<std::array<uint32_t, 256>, 240>* image_data = new std::array<std::array<uint32_t, 256>, 240>();  // Zeroed so frames that were never drawn hash the same
+    // The viewer images are allocated by the first call to the Set function filling them, null until then
+    std::array<std::array<std::array<uint32_t, 128>, 128>, 2>* pattern_table_data = nullptr;
+    std::array<std::array<uint32_t, 16>, 2>* palette_data = nullptr;
+    std::array<std::array<std::array<uint32_t, 256>, 240>, 4>* nametable_data = nullptr;
+
+    // Palette indices for consumers that do the colour conversion themselves, a quarter of the RGBA bandwidth.
+    // Each pixel is the 6 bit NES colour with greyscale applied, the emphasis bits are kept once per line.
+    bool rgba_output = true;  // image_data stops updating when this is off
+    bool indexed_output = false;
+    std::array<std::array<uint8_t, 256>, 240>* indexed_data = new std::array<std::array<uint8_t, 256>, 240>();
+    uint8_t line_emphasis[240]{};  // PPUMASK bits 5-7 as they were at the start of each line
+
+    // Every line is hashed as it is finished, so consumers can skip unchanged lines and tests can compare frames
+    // without keeping them. The indexed output is hashed when it is on, otherwise image_data.
+    bool line_hashing = false;
+    std::bitset<240> dirty_lines{};  // Lines that changed since the previous frame, complete once frame_done is set
 
     Ppu();
+    ~Ppu();
+    Ppu(const Ppu&) = delete;
+    Ppu& operator=(const Ppu&) = delete;
     void Run();
     void Reset();
+    void SaveState(StateWriter& state) const;  // The framebuffer is not included, it is redrawn by the next frame
+    bool LoadState(StateReader& state);
+    bool CheckState(StateReader& state) const;  // True when LoadState would load values the PPU can not run with
+    // The viewers only redraw the tiles whose pattern, nametable entry or colours changed since their last call,
+    // and each physical nametable once however it is mirrored. The lines they redrew are left in the bitsets below.
     void SetPatternTables(uint8_t palette_id);
     void SetPaletteImage();
     void SetNametables();
+    void MarkViewerWrite(uint32_t phys);  // Every write to ppu_memory outside the palette has to come through here
+    void InvalidateViewers();  // After bulk changes, e.g. loading CHR or a save state
+    std::bitset<240> pattern_table_lines[2]{};  // Only the first 128 are used
+    std::bitset<240> nametable_lines[4]{};
     void WritePpuReg(uint8_t id, uint8_t byte);
     uint8_t ReadPpuReg(uint8_t id);
+    bool WriteScreenshot(const std::string& location) const;  // PNG of the last frame, or PPM for .ppm
+
+    // Smaller copy of the frame for agents, written by the pixel output next to image_data. Every scale-th pixel
+    // of every scale-th line, as one luma byte or RGB bytes. Scale 0 turns it off.
+    bool SetObservation(uint32_t scale, bool greyscale);
+    inline const uint8_t* GetObservation() const { return observation.data(); }
+    inline uint32_t GetObservationWidth() const { return observation_scale ? 256 / observation_scale : 0; }
+    inline uint32_t GetObservationHeight() const { return observation_scale ? 240 / observation_scale : 0; }
+    inline uint32_t GetObservationChannels() const { return observation_greyscale ? 1 : 3; }
+
+    inline uint64_t GetLineHash(int line) const { return line_hashes[line]; }
+    inline uint64_t GetFrameHash() const { return frame_hash; }  // Of all line hashes, set when line 239 is finished
+    inline uint32_t GetPaletteColor(uint8_t index) const { return palette[index & 0x3F]; }  // RGBA for an indexed pixel
+    inline bool GetGreyscale() { return PPUMASK.greyscale; }
+    inline int16_t GetScanline() const { return scanline; }
+    inline int16_t GetCycle() const { return cycle; }
+    uint32_t TicksUntilEvent() const;
+    uint32_t TicksSinceEvent() const;
 
-    inline bool GetGreyscale();
+    struct Registers {  // Internal state that is not in memory, for comparing two PPUs
+        uint16_t v, t;
+        uint8_t x, w, ctrl, mask, status, oam_addr, read_buffer, io_latch;
+    };
+    inline Registers GetRegisters() const {
+        return {vram_addr.raw, temp_vram_addr.raw, fine_x, addr_latch, PPUCTRL.raw, PPUMASK.raw, PPUSTATUS.raw, OAM_addr, ppu_addr_buff, io_latch};
+    }
+    inline const uint8_t* GetOam() const { return OAM_ptr; }  // 256 bytes
 
 private:
     std::array<uint32_t, 0x40> palette;
 
     int16_t scanline{}, cycle{};
     uint8_t addr_latch{}, ppu_addr_buff{};
+    uint8_t io_latch{};  // Value left on the PPU data bus, returned by write-only registers
+    uint64_t io_latch_refresh_frame{};
     uint8_t fine_x{};
     uint8_t bg_next_tile_id{}, bg_next_tile_attr{}, bg_next_tile_lsb{}, bg_next_tile_msb{};
     uint16_t bg_shift_pattern_lo{}, bg_shift_pattern_hi{}, bg_shift_attrib_lo{}, bg_shift_attrib_hi{};
@@ -98,5 +153,23 @@ private:
     uint8_t* OAM_ptr = reinterpret_cast<uint8_t*>(&OAM[0]);
     uint8_t OAM_addr{};
 
+    inline uint8_t GetPaletteIndex(uint8_t palette_id, uint8_t pixel);
     inline uint32_t GetColorFromPalette(uint8_t palette_id, uint8_t pixel);
+    void WriteObservation(uint32_t x, uint32_t y, uint32_t color);
+    void HashLine(int line);
+    void DrawViewerTile(uint32_t* dest, size_t pitch, uint16_t pattern_addr, const uint32_t* colors);
+
+    std::bitset<0x200> pattern_viewer_tiles{}, nametable_viewer_tiles{};  // Written 16 byte tiles of CHR, by physical address
+    std::bitset<0x1000> nametable_viewer_cells{};  // Written bytes of $2000-$2FFF, by physical address
+    uint32_t pattern_viewer_colors[4]{}, nametable_viewer_colors[16]{};
+    uint16_t nametable_viewer_layout[4]{};
+    uint16_t nametable_viewer_pattern_base{};
+
+    uint64_t line_hashes[240]{};
+    uint64_t frame_hash{};
+
+    std::vector<uint8_t> observation{};
+    uint32_t observation_scale{};
+    uint32_t observation_mask{};  // scale - 1, pixels with any of these bits set in x or y are skipped
+    bool observation_greyscale = false;
 };
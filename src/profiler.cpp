@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <algorithm>
+
+#include "profiler.h"
+#include "trace.h"
+
+
+Profiler::Profiler() : instructions(PHYS_SIZE), cycles(PHYS_SIZE), cpu_addr(PHYS_SIZE), calls(PHYS_SIZE), routine_cycles(PHYS_SIZE) {}
+
+void Profiler::Reset() {
+    std::fill(instructions.begin(), instructions.end(), 0);
+    std::fill(cycles.begin(), cycles.end(), 0);
+    std::fill(calls.begin(), calls.end(), 0);
+    std::fill(routine_cycles.begin(), routine_cycles.end(), 0);
+    total_cycles = 0;
+    call_depth = 0;
+    pending_call = false;
+}
+
+std::vector<Profiler::Hotspot> Profiler::GetHotspots(size_t count) const {
+    std::vector<Hotspot> hotspots;
+    for (uint32_t phys = 0; phys < PHYS_SIZE; ++phys) {
+        if (instructions[phys]) hotspots.push_back({phys, cpu_addr[phys], instructions[phys], cycles[phys]});
+    }
+
+    count = std::min(count, hotspots.size());
+    std::partial_sort(hotspots.begin(), hotspots.begin() + count, hotspots.end(),
+                      [](const Hotspot& a, const Hotspot& b) { return a.cycles > b.cycles; });
+    hotspots.resize(count);
+    return hotspots;
+}
+
+std::vector<Profiler::Hotspot> Profiler::GetRoutines(size_t count) const {
+    std::vector<Hotspot> routines;
+    for (uint32_t phys = 0; phys < PHYS_SIZE; ++phys) {
+        if (calls[phys]) routines.push_back({phys, cpu_addr[phys], calls[phys], routine_cycles[phys]});
+    }
+
+    count = std::min(count, routines.size());
+    std::partial_sort(routines.begin(), routines.begin() + count, routines.end(),
+                      [](const Hotspot& a, const Hotspot& b) { return a.cycles > b.cycles; });
+    routines.resize(count);
+    return routines;
+}
+
+// Finds backwards branches and jumps that were executed and sums up the cycles spent in their body.
+// The code is read back from memory, so entries whose bank is no longer mapped in are skipped.
+std::vector<Profiler::Loop> Profiler::GetLoops(const Memory& memory, size_t count) const {
+    std::vector<Loop> loops;
+    for (uint32_t phys = 0; phys < PHYS_SIZE; ++phys) {
+        if (!instructions[phys]) continue;
+        uint16_t addr = cpu_addr[phys];
+        if (memory.GetPhysicalAddress(addr) != phys) continue;
+
+        uint8_t opcode = memory.Peek(addr);
+        uint16_t target;
+        if (Disassembler::IsBranch(opcode)) target = addr + 2 + static_cast<int8_t>(memory.Peek(addr + 1));
+        else if (opcode == 0x4C) target = (memory.Peek(addr + 2) << 8) | memory.Peek(addr + 1);  // JMP abs
+        else continue;
+        if (target > addr || addr - target >= 0x100) continue;
+
+        Loop loop;
+        loop.phys = memory.GetPhysicalAddress(target);
+        loop.start = target;
+        loop.end = addr;
+        loop.iterations = instructions[phys];
+
+        bool writes = false, polls_status = false;
+        for (uint16_t curr = target; curr <= addr;) {
+            uint8_t curr_opcode = memory.Peek(curr);
+            uint8_t length = Disassembler::GetLength(curr_opcode);
+            uint32_t curr_phys = memory.GetPhysicalAddress(curr);
+            if (curr_phys < PHYS_SIZE) loop.cycles += cycles[curr_phys];
+            writes |= Disassembler::WritesMemory(curr_opcode);
+            if (length == 3 && ((memory.Peek(curr + 2) << 8) | memory.Peek(curr + 1)) == 0x2002) polls_status = true;
+            curr += length;
+        }
+        if (polls_status) loop.kind = LoopKind::vblank_wait;
+        else if (!writes) loop.kind = LoopKind::idle;
+        else loop.kind = LoopKind::loop;
+        loops.push_back(loop);
+    }
+
+    count = std::min(count, loops.size());
+    std::partial_sort(loops.begin(), loops.begin() + count, loops.end(),
+                      [](const Loop& a, const Loop& b) { return a.cycles > b.cycles; });
+    loops.resize(count);
+    return loops;
+}
+
+const char* Profiler::GetLoopKindName(LoopKind kind) {
+    switch (kind) {
+    case LoopKind::idle: return "idle";
+    case LoopKind::vblank_wait: return "vblank wait";
+    default: return "loop";
+    }
+}
+
+bool Profiler::WriteReport(const std::string& location, const Memory& memory) const {
+    FILE* file = nullptr;
+    if (fopen_s(&file, location.c_str(), "w")) return true;
+
+    const double total = total_cycles ? static_cast<double>(total_cycles) : 1.0;
+    fprintf(file, "Total cycles: %llu\n", static_cast<unsigned long long>(total_cycles));
+
+    fprintf(file, "\nHottest instructions\n   phys   addr  instr      instructions        cycles      %%\n");
+    for (const Hotspot& spot : GetHotspots(50)) {
+        fprintf(file, "  %05X  $%04X  %-5s  %16llu  %12llu  %5.1f\n", spot.phys, spot.addr, Disassembler::GetMnemonic(memory.Peek(spot.addr)),
+                static_cast<unsigned long long>(spot.count), static_cast<unsigned long long>(spot.cycles), 100.0 * spot.cycles / total);
+    }
+
+    fprintf(file, "\nHottest routines (inclusive)\n   phys   addr         calls        cycles      %%\n");
+    for (const Hotspot& routine : GetRoutines(30)) {
+        fprintf(file, "  %05X  $%04X  %12llu  %12llu  %5.1f\n", routine.phys, routine.addr, static_cast<unsigned long long>(routine.count),
+                static_cast<unsigned long long>(routine.cycles), 100.0 * routine.cycles / total);
+    }
+
+    fprintf(file, "\nLoops\n   phys  range          kind         iterations        cycles      %%\n");
+    for (const Loop& loop : GetLoops(memory, 30)) {
+        fprintf(file, "  %05X  $%04X-$%04X  %-11s  %12llu  %12llu  %5.1f\n", loop.phys, loop.start, loop.end, GetLoopKindName(loop.kind),
+                static_cast<unsigned long long>(loop.iterations), static_cast<unsigned long long>(loop.cycles), 100.0 * loop.cycles / total);
+    }
+
+    bool error = ferror(file) != 0;
+    fclose(file);
+    return error;
+}
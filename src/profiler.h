@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "memory.h"
+
+
+// Counts executed instructions and cycles per physical address, so bank switched code is told apart
+// and RAM mirrors are merged. Recording is a few array increments, the analysis only runs for reports.
+class Profiler {
+public:
+    static constexpr uint32_t PHYS_SIZE = 0x10000;
+
+    enum class LoopKind {
+        loop = 0,
+        idle,         // Polls memory without writing anything, usually waiting for the NMI handler
+        vblank_wait   // Polls PPUSTATUS
+    };
+
+    struct Hotspot {
+        uint32_t phys{};
+        uint16_t addr{};  // CPU address it was last executed from
+        uint64_t count{}, cycles{};  // Instructions executed, or calls for routines
+    };
+
+    struct Loop {
+        uint32_t phys{};
+        uint16_t start{}, end{};  // Branch target and the backwards branch itself
+        uint64_t iterations{}, cycles{};
+        LoopKind kind{};
+    };
+
+    Profiler();
+    inline void Record(uint16_t addr, uint32_t phys, uint8_t opcode, uint32_t instr_cycles);
+    void Reset();
+
+    uint64_t GetTotalCycles() const { return total_cycles; }
+    std::vector<Hotspot> GetHotspots(size_t count) const;
+    std::vector<Hotspot> GetRoutines(size_t count) const;  // Sorted by inclusive cycles
+    std::vector<Loop> GetLoops(const Memory& memory, size_t count) const;
+    static const char* GetLoopKindName(LoopKind kind);
+    bool WriteReport(const std::string& location, const Memory& memory) const;
+
+private:
+    static constexpr uint32_t CALL_STACK_SIZE = 64;
+
+    struct Call {
+        uint32_t phys{};
+        uint64_t start_cycles{};
+    };
+
+    std::vector<uint64_t> instructions{};
+    std::vector<uint64_t> cycles{};
+    std::vector<uint16_t> cpu_addr{};
+    std::vector<uint32_t> calls{};
+    std::vector<uint64_t> routine_cycles{};
+    uint64_t total_cycles{};
+
+    Call call_stack[CALL_STACK_SIZE]{};
+    uint32_t call_depth{};
+    bool pending_call = false;
+};
+
+inline void Profiler::Record(uint16_t addr, uint32_t phys, uint8_t opcode, uint32_t instr_cycles) {
+    if (pending_call) {  // First instruction of a subroutine
+        pending_call = false;
+        ++calls[phys];
+        if (call_depth < CALL_STACK_SIZE) call_stack[call_depth] = {phys, total_cycles};
+        ++call_depth;
+    }
+
+    ++instructions[phys];
+    cycles[phys] += instr_cycles;
+    cpu_addr[phys] = addr;
+    total_cycles += instr_cycles;
+
+    if (opcode == 0x20) pending_call = true;  // JSR
+    else if (opcode == 0x60 && call_depth > 0) {  // RTS, returns without a matching JSR are ignored
+        --call_depth;
+        if (call_depth < CALL_STACK_SIZE) {
+            routine_cycles[call_stack[call_depth].phys] += total_cycles - call_stack[call_depth].start_cycles;
+        }
+    }
+}
@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <chrono>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "log.h"
+#include "save_ram.h"
+
+
+constexpr auto FLUSH_POLL_INTERVAL = std::chrono::milliseconds(100);
+constexpr auto FLUSH_SETTLE_TIME = std::chrono::milliseconds(1000);  // Games write to the save in bursts
+
+SaveRam::~SaveRam() {
+    Close();
+}
+
+bool SaveRam::Open(const std::string& location, uint32_t ram_size) {
+    Close();
+    path = location;
+    size = ram_size;
+
+    if (!Map()) mapped = true;
+    else {  // Fall back to a plain buffer that is written out in one piece
+        log_helper.AddLog("Could not map " + path + ", falling back to buffered saves\n", LogCategory::io, LogLevel::warning);
+        buffer.assign(size, 0);
+        FILE* file = nullptr;
+        if (!fopen_s(&file, path.c_str(), "rb")) {
+            fread(&buffer[0], 1, size, file);
+            fclose(file);
+        }
+        data = &buffer[0];
+    }
+
+    flushed_count = write_count.load(std::memory_order_relaxed);
+    stop = false;
+    snapshot_wanted.store(false);
+    snapshot_ready = false;
+    flusher = std::thread(&SaveRam::FlushThread, this);
+    log_helper.AddLog("Battery save: " + path + '\n', LogCategory::io, LogLevel::info);
+    return false;
+}
+
+void SaveRam::Close() {
+    if (!data) return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    wake.notify_one();
+    if (flusher.joinable()) flusher.join();
+
+    snapshot_wanted.store(false);
+    if (write_count.load(std::memory_order_relaxed) != flushed_count) Flush(data);  // The flusher is gone, nothing else touches data
+    if (mapped) Unmap();
+    buffer.clear();
+    data = nullptr;
+    mapped = false;
+}
+
+#ifdef _WIN32
+bool SaveRam::Map() {
+    file_handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        file_handle = nullptr;
+        return true;
+    }
+
+    mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READWRITE, 0, size, nullptr);  // Grows the file to size
+    if (!mapping_handle) {
+        CloseHandle(file_handle);
+        file_handle = nullptr;
+        return true;
+    }
+
+    data = static_cast<uint8_t*>(MapViewOfFile(mapping_handle, FILE_MAP_ALL_ACCESS, 0, 0, size));
+    if (!data) {
+        CloseHandle(mapping_handle);
+        CloseHandle(file_handle);
+        mapping_handle = file_handle = nullptr;
+        return true;
+    }
+    return false;
+}
+
+void SaveRam::Unmap() {
+    UnmapViewOfFile(data);
+    CloseHandle(mapping_handle);
+    CloseHandle(file_handle);
+    mapping_handle = file_handle = nullptr;
+}
+#else
+bool SaveRam::Map() {
+    file_descriptor = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (file_descriptor < 0) return true;
+
+    struct stat info;
+    if (fstat(file_descriptor, &info) != 0 || (info.st_size < size && ftruncate(file_descriptor, size) != 0)) {
+        close(file_descriptor);
+        file_descriptor = -1;
+        return true;
+    }
+
+    void* view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor, 0);
+    if (view == MAP_FAILED) {
+        close(file_descriptor);
+        file_descriptor = -1;
+        return true;
+    }
+    data = static_cast<uint8_t*>(view);
+    return false;
+}
+
+void SaveRam::Unmap() {
+    munmap(data, size);
+    close(file_descriptor);
+    file_descriptor = -1;
+}
+#endif
+
+// Mapped saves are written back by the OS, source is only used for buffered ones
+bool SaveRam::Flush(const uint8_t* source) {
+    if (mapped) {
+#ifdef _WIN32
+        return !FlushViewOfFile(data, size);
+#else
+        return msync(data, size, MS_SYNC) != 0;
+#endif
+    }
+
+    FILE* file = nullptr;
+    if (fopen_s(&file, path.c_str(), "wb")) return true;
+    bool error = fwrite(source, 1, size, file) != size;
+    fclose(file);
+    return error;
+}
+
+void SaveRam::TakeSnapshot() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        snapshot.assign(data, data + size);
+        snapshot_count = write_count.load(std::memory_order_relaxed);
+        snapshot_ready = true;
+        snapshot_wanted.store(false, std::memory_order_relaxed);
+    }
+    wake.notify_one();
+}
+
+void SaveRam::FlushThread() {
+    uint32_t seen = write_count.load(std::memory_order_relaxed);
+    auto last_change = std::chrono::steady_clock::now();
+    std::vector<uint8_t> copy{};
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait_for(lock, FLUSH_POLL_INTERVAL, [this] { return stop || snapshot_ready; });
+        if (stop) break;
+
+        if (snapshot_ready) {  // Written outside the lock so the emulation thread never waits on the disk
+            snapshot_ready = false;
+            copy.swap(snapshot);
+            const uint32_t count = snapshot_count;
+            lock.unlock();
+            const bool error = Flush(&copy[0]);
+            lock.lock();
+            if (error) log_helper.AddLog("Error while writing " + path + '\n', LogCategory::io, LogLevel::error);
+            flushed_count = count;
+            continue;
+        }
+
+        uint32_t current = write_count.load(std::memory_order_relaxed);
+        auto now = std::chrono::steady_clock::now();
+        if (current != seen) {
+            seen = current;
+            last_change = now;
+        }
+        else if (current != flushed_count && now - last_change >= FLUSH_SETTLE_TIME && !snapshot_wanted.load(std::memory_order_relaxed)) {
+            if (!mapped) snapshot_wanted.store(true, std::memory_order_release);
+            else {
+                if (Flush(data)) log_helper.AddLog("Error while writing " + path + '\n', LogCategory::io, LogLevel::error);
+                flushed_count = current;
+            }
+        }
+    }
+}
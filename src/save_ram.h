@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// Battery-backed PRG-RAM. The .sav file is memory-mapped when possible so loading is instant,
+// and a background thread flushes it to disk once the game stops writing to it for a while.
+// Without a mapping the flusher never reads the RAM itself, it asks the emulation thread for a copy.
+class SaveRam {
+public:
+    ~SaveRam();
+    bool Open(const std::string& location, uint32_t ram_size);
+    void Close();
+
+    // Called from the emulation thread on every write, so it must stay a plain store
+    inline void Touch() { write_count.store(write_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+    uint8_t* GetData() { return data; }
+    // Called from the emulation thread between frames, copies the RAM when the flusher is waiting for it
+    inline void Update() { if (snapshot_wanted.load(std::memory_order_acquire)) TakeSnapshot(); }
+
+private:
+    bool Map();
+    void Unmap();
+    bool Flush(const uint8_t* source);
+    void FlushThread();
+    void TakeSnapshot();
+
+    std::string path = "";
+    uint32_t size{};
+    uint8_t* data = nullptr;
+    std::vector<uint8_t> buffer{};  // Used when the file can not be mapped
+    bool mapped = false;
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+#else
+    int file_descriptor = -1;
+#endif
+
+    std::thread flusher{};
+    std::mutex mutex{};
+    std::condition_variable wake{};
+    bool stop = false;
+    std::atomic<uint32_t> write_count{0};
+    uint32_t flushed_count{};
+    std::atomic<bool> snapshot_wanted{false};
+    bool snapshot_ready = false;
+    std::vector<uint8_t> snapshot{};
+    uint32_t snapshot_count{};  // write_count when the snapshot was taken
+};
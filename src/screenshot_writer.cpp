@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <memory>
+#include <vector>
+
+#include "image_file.h"
+#include "log.h"
+#include "screenshot_writer.h"
+
+
+ScreenshotWriter::ScreenshotWriter(uint32_t threads, bool wait_when_full) : pool(threads), wait_when_full(wait_when_full) {}
+
+ScreenshotWriter::~ScreenshotWriter() {
+    Wait();
+}
+
+void ScreenshotWriter::Save(const Ppu& ppu, const std::string& location) {
+    // Checks and reserves the slot in one step, so callers on several threads can not go past MAX_PENDING
+    uint32_t count = pending.load();
+    do {
+        while (count >= MAX_PENDING) {
+            if (!wait_when_full) {
+                ++dropped;
+                return;
+            }
+            std::this_thread::yield();
+            count = pending.load();
+        }
+    } while (!pending.compare_exchange_weak(count, count + 1));
+
+    std::shared_ptr<std::vector<uint32_t>> pixels(new std::vector<uint32_t>(&(*ppu.image_data)[0][0], &(*ppu.image_data)[0][0] + 256 * 240));
+    pool.Submit([this, pixels, location]() {
+        if (WriteImage(location, pixels->data(), 256, 240)) {
+            ++errors;
+            log_helper.AddLog("Could not write " + location + '\n', LogCategory::ppu, LogLevel::error);
+        }
+        else ++written;
+        --pending;
+    });
+}
+
+void ScreenshotWriter::StartDump(const std::string& location, uint32_t interval) {
+    dump_location = location;
+    dump_interval = interval;
+    dump_frame = 0;
+}
+
+void ScreenshotWriter::StopDump() {
+    dump_interval = 0;
+}
+
+void ScreenshotWriter::Push(const Ppu& ppu) {
+    if (!dump_interval) return;
+    if (dump_frame % dump_interval == 0) Save(ppu, GetDumpName(dump_location, dump_frame));
+    ++dump_frame;
+}
+
+void ScreenshotWriter::Wait() {
+    pool.Wait();
+}
+
+std::string ScreenshotWriter::GetDumpName(const std::string& location, uint64_t frame) {
+    char number[24];
+    snprintf(&number[0], sizeof(number), "_%06llu", static_cast<unsigned long long>(frame));
+    const size_t dot = location.find_last_of('.');
+    const size_t slash = location.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return location + &number[0] + ".png";
+    return location.substr(0, dot) + &number[0] + location.substr(dot);
+}
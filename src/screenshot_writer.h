@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+#include "ppu.h"
+#include "work_pool.h"
+
+
+// Saves frames without encoding them on the emulation thread. The frame is copied and compressed on the
+// pool, so a screenshot only costs the copy. Dumping writes every interval-th frame as name_<frame>.png.
+// When MAX_PENDING frames are still waiting, further ones are dropped and counted, or waited for if asked.
+class ScreenshotWriter {
+public:
+    static constexpr uint32_t MAX_PENDING = 8;
+
+    ScreenshotWriter(uint32_t threads, bool wait_when_full);  // Waiting instead of dropping is for offline runs
+    ~ScreenshotWriter();  // Finishes every pending file
+    void Save(const Ppu& ppu, const std::string& location);  // PNG, or PPM for .ppm
+    void StartDump(const std::string& location, uint32_t interval);
+    void StopDump();
+    void Push(const Ppu& ppu);  // After every finished frame, saves it when a dump is running and it is due
+    void Wait();
+    inline bool IsDumping() const { return dump_interval != 0; }
+    inline uint64_t GetWrittenCount() const { return written; }
+    inline uint64_t GetDroppedCount() const { return dropped; }
+    inline uint64_t GetErrorCount() const { return errors; }
+    static std::string GetDumpName(const std::string& location, uint64_t frame);  // Frame number before the extension
+
+private:
+    WorkPool pool;
+    bool wait_when_full = false;
+    std::atomic<uint32_t> pending{0};
+    std::atomic<uint64_t> written{0}, dropped{0}, errors{0};
+    std::string dump_location = "";
+    uint32_t dump_interval{};
+    uint64_t dump_frame{};
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+
+// Save states are the components' fields appended one after another in a fixed order. There is no
+// per-field tagging, the version number in the header changes whenever the layout does.
+class StateWriter {
+public:
+    explicit StateWriter(std::vector<uint8_t>& data) : data(&data) {}
+    StateWriter(uint8_t* buffer, size_t size) : pos(buffer), end(buffer + size) {}  // Fixed buffer, what does not fit is dropped
+    inline void Write(const void* bytes, size_t size) {
+        const uint8_t* begin = static_cast<const uint8_t*>(bytes);
+        if (data) data->insert(data->end(), begin, begin + size);
+        else if (size <= static_cast<size_t>(end - pos)) {
+            memcpy(pos, begin, size);
+            pos += size;
+        }
+        else pos = end;
+    }
+    template <typename T> inline void Write(const T& value) { Write(&value, sizeof(T)); }
+
+private:
+    std::vector<uint8_t>* data = nullptr;
+    uint8_t* pos = nullptr;
+    uint8_t* end = nullptr;
+};
+
+class StateReader {
+public:
+    StateReader(const uint8_t* data, size_t size) : pos(data), end(data + size) {}
+    inline bool Read(void* bytes, size_t size) {
+        if (size > static_cast<size_t>(end - pos)) {
+            error = true;
+            return true;
+        }
+        memcpy(bytes, pos, size);
+        pos += size;
+        return false;
+    }
+    template <typename T> inline bool Read(T& value) { return Read(&value, sizeof(T)); }
+    inline bool Skip(size_t size) {
+        if (size > static_cast<size_t>(end - pos)) {
+            error = true;
+            return true;
+        }
+        pos += size;
+        return false;
+    }
+    inline bool HasError() const { return error; }  // Set once anything was read past the end
+    inline bool AtEnd() const { return pos == end; }
+
+private:
+    const uint8_t* pos = nullptr;
+    const uint8_t* end = nullptr;
+    bool error = false;
+};
@@ -0,0 +1,36 @@
+#include <stdio.h>
+
+#include "table.h"
+
+
+bool ReadTable(const std::string& location, std::vector<std::vector<std::string>>& rows) {
+    FILE* file = nullptr;
+    if (fopen_s(&file, location.c_str(), "r")) return true;
+
+    char buffer[1024];
+    while (fgets(&buffer[0], sizeof(buffer), file)) {
+        std::string line = &buffer[0];
+        while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+
+        std::vector<std::string> fields;
+        size_t start = 0, tab;
+        while ((tab = line.find('\t', start)) != std::string::npos) {
+            fields.push_back(line.substr(start, tab - start));
+            start = tab + 1;
+        }
+        fields.push_back(line.substr(start));
+        if (!fields[0].empty()) rows.push_back(fields);
+    }
+
+    bool error = ferror(file) != 0;
+    fclose(file);
+    return error;
+}
+
+std::string ResolvePath(const std::string& table_location, const std::string& path) {
+    bool absolute = path.empty() || path[0] == '/' || path[0] == '\\' || (path.size() > 1 && path[1] == ':');
+    if (absolute) return path;
+    const size_t slash = table_location.find_last_of("/\\");
+    return slash == std::string::npos ? path : table_location.substr(0, slash + 1) + path;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+// Tab separated text files used by the headless runners. Empty lines and lines starting with # are skipped.
+bool ReadTable(const std::string& location, std::vector<std::vector<std::string>>& rows);
+std::string ResolvePath(const std::string& table_location, const std::string& path);  // Relative paths are relative to the table
@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <memory>
+
+#include "archive.h"
+#include "console.h"
+#include "table.h"
+#include "test_runner.h"
+#include "work_pool.h"
+
+
+bool TestRunner::AddManifest(const std::string& location) {
+    std::vector<std::vector<std::string>> rows;
+    if (ReadTable(location, rows)) return true;
+
+    for (const std::vector<std::string>& fields : rows) {
+        TestCase test;
+        test.path = ResolvePath(location, fields[0]);
+        if (fields.size() > 1 && !fields[1].empty()) test.frames = strtoul(fields[1].c_str(), nullptr, 10);
+        if (fields.size() > 2 && !fields[2].empty()) {
+            test.expected_crc = strtoul(fields[2].c_str(), nullptr, 16);
+            test.has_expected_crc = true;
+        }
+        tests.push_back(test);
+    }
+    return false;
+}
+
+void TestRunner::AddRom(const std::string& path, uint32_t frames) {
+    TestCase test;
+    test.path = path;
+    test.frames = frames;
+    tests.push_back(test);
+}
+
+void TestRunner::Run(uint32_t threads) {
+    results.assign(tests.size(), Result());
+    WorkPool pool(threads);
+    for (size_t i = 0; i < tests.size(); ++i) pool.Submit([this, i]() { results[i] = RunTest(tests[i]); });
+    pool.Wait();
+}
+
+// $6001-$6003 hold DE B0 61 once the ROM uses the protocol, $6000 is then 0x80 while running, 0x81 when
+// it wants the reset button pressed and the result code after that. $6004 has a zero terminated message.
+TestRunner::Result TestRunner::RunTest(const TestCase& test) const {
+    Result result;
+    const auto start = std::chrono::steady_clock::now();
+
+    std::unique_ptr<Console> console(new Console);
+    console->memory.use_save_file = false;
+    if (console->LoadROM(test.path, nullptr)) {
+        result.message = "Could not be loaded";
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+    console->cpu.block_cache_enabled = fast_paths;
+    console->cpu.dynarec_enabled = fast_paths;
+    console->cpu.idle_skip_enabled = fast_paths;
+
+    const Memory& memory = console->memory;
+    bool protocol = false, finished = false;
+    uint32_t reset_frame = 0;
+    while (result.frames < test.frames && !finished) {
+        console->RunFrame();
+        ++result.frames;
+
+        protocol = memory.Peek(0x6001) == 0xDE && memory.Peek(0x6002) == 0xB0 && memory.Peek(0x6003) == 0x61;
+        if (!protocol) continue;
+        const uint8_t status = memory.Peek(0x6000);
+        if (status == 0x80) continue;
+        if (status == 0x81) {
+            if (!reset_frame) reset_frame = result.frames + RESET_DELAY_FRAMES;
+            else if (result.frames >= reset_frame) {
+                console->Reset();
+                reset_frame = 0;
+            }
+            continue;
+        }
+        result.code = status;
+        finished = true;
+    }
+
+    result.crc = Crc32(0, reinterpret_cast<const uint8_t*>(console->ppu.image_data->data()), sizeof(*console->ppu.image_data));
+    if (protocol) {
+        for (uint16_t addr = 0x6004; addr < 0x7000 && memory.Peek(addr); ++addr) {
+            char c = static_cast<char>(memory.Peek(addr));
+            result.message += (c == '\n' || c == '\t' || c == '\r') ? ' ' : c;
+        }
+        result.status = !finished ? Status::timeout : (result.code == 0 ? Status::pass : Status::fail);
+    }
+    else if (test.has_expected_crc) result.status = result.crc == test.expected_crc ? Status::pass : Status::fail;
+    else result.status = Status::unknown;
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+bool TestRunner::WriteResults(FILE* file) const {
+    fprintf(file, "rom\tstatus\tcode\tframes\tcrc\tseconds\tmessage\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& result = results[i];
+        fprintf(file, "%s\t%s\t%u\t%u\t%08X\t%.2f\t%s\n", tests[i].path.c_str(), GetStatusName(result.status), result.code, result.frames,
+                result.crc, result.seconds, result.message.c_str());
+    }
+    return ferror(file) != 0;
+}
+
+uint32_t TestRunner::GetFailureCount() const {
+    uint32_t failures = 0;
+    for (const Result& result : results) {
+        if (result.status != Status::pass && result.status != Status::unknown) ++failures;
+    }
+    return failures;
+}
+
+const char* TestRunner::GetStatusName(Status status) {
+    switch (status) {
+    case Status::pass: return "pass";
+    case Status::fail: return "fail";
+    case Status::timeout: return "timeout";
+    case Status::unknown: return "unknown";
+    default: return "error";
+    }
+}
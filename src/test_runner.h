@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+// Runs test ROMs headless and decides pass or fail. ROMs using the $6000 status protocol report
+// their own result, all others are judged by the CRC of the framebuffer after a fixed number of frames.
+class TestRunner {
+public:
+    static constexpr uint32_t DEFAULT_FRAMES = 1800;  // 30 seconds, the longest CPU tests take about that long
+    static constexpr uint32_t RESET_DELAY_FRAMES = 10;  // The protocol wants the reset at least 100 ms after asking
+
+    enum class Status {
+        pass = 0,
+        fail,
+        timeout,  // Still running when the frame limit was hit
+        unknown,  // No protocol and no expected CRC, only the CRC is reported
+        error     // Could not be loaded
+    };
+
+    struct TestCase {
+        std::string path = "";
+        uint32_t frames = DEFAULT_FRAMES;
+        uint32_t expected_crc{};
+        bool has_expected_crc = false;
+    };
+
+    struct Result {
+        Status status = Status::error;
+        uint8_t code{};  // Value left at $6000
+        uint32_t frames{};
+        uint32_t crc{};  // Of the final framebuffer
+        double seconds{};
+        std::string message = "";  // Text the ROM left at $6004
+    };
+
+    bool fast_paths = false;  // Run with the block cache, the recompiler and idle loop skipping
+
+    bool AddManifest(const std::string& location);  // Tab separated: path, frames, expected CRC, the last two optional
+    void AddRom(const std::string& path, uint32_t frames);
+    void Run(uint32_t threads);  // 0 uses every core
+    bool WriteResults(FILE* file) const;  // Tab separated table
+    uint32_t GetFailureCount() const;
+    static const char* GetStatusName(Status status);
+
+private:
+    Result RunTest(const TestCase& test) const;
+
+    std::vector<TestCase> tests{};
+    std::vector<Result> results{};
+};
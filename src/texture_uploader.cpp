@@ -0,0 +1,93 @@
+#include <string.h>
+
+#include "hash.h"
+#include "log.h"
+#include "texture_uploader.h"
+
+
+bool TextureUploader::Init(size_t size) {
+    if (!GLAD_GL_VERSION_4_4) {
+        log_helper.AddLog("No buffer storage, textures are uploaded directly\n", LogCategory::general, LogLevel::warning);
+        return true;
+    }
+    region_size = size;
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, region_size * REGION_COUNT, nullptr, flags);
+    mapped = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, region_size * REGION_COUNT, flags));
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (!mapped) {
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+        log_helper.AddLog("Could not map the pixel buffer, textures are uploaded directly\n", LogCategory::general, LogLevel::warning);
+        return true;
+    }
+    return false;
+}
+
+void TextureUploader::Shutdown() {
+    for (GLsync& fence : fences) {
+        if (fence) glDeleteSync(fence);
+        fence = nullptr;
+    }
+    if (buffer) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+    }
+    buffer = 0;
+    mapped = nullptr;
+    image_hashes.clear();
+}
+
+void TextureUploader::BeginFrame() {
+    offset = 0;
+    if (!fences[region]) return;
+    glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);  // Only ever waits with more than two frames queued
+    glDeleteSync(fences[region]);
+    fences[region] = nullptr;
+}
+
+void TextureUploader::EndFrame() {
+    if (!mapped) return;
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    region = (region + 1) % REGION_COUNT;
+}
+
+void TextureUploader::Upload(GLuint texture, int width, int first_row, int rows, const uint32_t* pixels) {
+    const size_t size = static_cast<size_t>(width) * rows * sizeof(uint32_t);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    if (!mapped || offset + size > region_size) {  // Too much for this frame's region, the driver has to copy it
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first_row, width, rows, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8, pixels);
+        return;
+    }
+
+    const size_t start = region * region_size + offset;
+    memcpy(mapped + start, pixels, size);
+    offset += size;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first_row, width, rows, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8, reinterpret_cast<const void*>(start));
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);  // ImGui uploads from client memory and expects nothing bound
+}
+
+void TextureUploader::UploadLines(GLuint texture, int width, int height, const uint32_t* pixels, const std::bitset<240>& dirty) {
+    for (int line = 0; line < height;) {
+        if (!dirty[line]) {
+            ++line;
+            continue;
+        }
+        const int first = line;
+        while (line < height && dirty[line]) ++line;
+        Upload(texture, width, first, line - first, pixels + static_cast<size_t>(first) * width);
+    }
+}
+
+void TextureUploader::UploadIfChanged(GLuint texture, int width, int height, const uint32_t* pixels) {
+    const uint64_t hash = Hash64(reinterpret_cast<const uint8_t*>(pixels), static_cast<size_t>(width) * height * sizeof(uint32_t));
+    auto known = image_hashes.find(texture);
+    if (known != image_hashes.end() && known->second == hash) return;
+    image_hashes[texture] = hash;
+    Upload(texture, width, 0, height, pixels);
+}
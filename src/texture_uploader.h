@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <bitset>
+#include <map>
+
+#include "glad/glad.h"
+
+
+// Texture uploads through a persistently mapped pixel buffer, so glTexSubImage2D returns without the driver
+// copying or waiting on the GPU. The buffer is split into one region per frame in flight, each guarded by a
+// fence, so a region is only written again once the GPU is done reading it. Without buffer storage (GL 4.4)
+// uploads go straight from client memory like before.
+class TextureUploader {
+public:
+    static constexpr uint32_t REGION_COUNT = 3;
+
+    bool Init(size_t region_size);  // Needs a current context
+    void Shutdown();  // Before the context goes away
+    void BeginFrame();  // Before the first upload of a host frame
+    void EndFrame();  // After the last GL command reading this frame's uploads
+    // Rows first_row to first_row + rows of a texture as wide as the data, the pixels point at the first of them
+    void Upload(GLuint texture, int width, int first_row, int rows, const uint32_t* pixels);
+    void UploadLines(GLuint texture, int width, int height, const uint32_t* pixels, const std::bitset<240>& dirty);  // Runs of dirty lines only
+    void UploadIfChanged(GLuint texture, int width, int height, const uint32_t* pixels);  // Skipped while the image hash stays the same
+
+private:
+    GLuint buffer{};
+    uint8_t* mapped = nullptr;
+    size_t region_size{};
+    uint32_t region{};
+    size_t offset{};  // Into the current region
+    GLsync fences[REGION_COUNT]{};
+    std::map<GLuint, uint64_t> image_hashes{};
+};
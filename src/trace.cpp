@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "trace.h"
+
+
+namespace {
+typedef Disassembler::Mode Mode;
+
+struct Opcode {
+    const char* mnemonic;
+    Mode mode;
+};
+
+// Unofficial opcodes are marked with a '*' like in the nestest log
+const Opcode opcodes[256] = {
+    {"BRK", Mode::implied}, {"ORA", Mode::indexed_indirect}, {"*JAM", Mode::implied}, {"*SLO", Mode::indexed_indirect},
+    {"*NOP", Mode::zero_page}, {"ORA", Mode::zero_page}, {"ASL", Mode::zero_page}, {"*SLO", Mode::zero_page},
+    {"PHP", Mode::implied}, {"ORA", Mode::immediate}, {"ASL", Mode::accumulator}, {"*ANC", Mode::immediate},
+    {"*NOP", Mode::absolute}, {"ORA", Mode::absolute}, {"ASL", Mode::absolute}, {"*SLO", Mode::absolute},
+    {"BPL", Mode::relative}, {"ORA", Mode::indirect_indexed}, {"*JAM", Mode::implied}, {"*SLO", Mode::indirect_indexed},
+    {"*NOP", Mode::zero_page_x}, {"ORA", Mode::zero_page_x}, {"ASL", Mode::zero_page_x}, {"*SLO", Mode::zero_page_x},
+    {"CLC", Mode::implied}, {"ORA", Mode::absolute_y}, {"*NOP", Mode::implied}, {"*SLO", Mode::absolute_y},
+    {"*NOP", Mode::absolute_x}, {"ORA", Mode::absolute_x}, {"ASL", Mode::absolute_x}, {"*SLO", Mode::absolute_x},
+    {"JSR", Mode::absolute}, {"AND", Mode::indexed_indirect}, {"*JAM", Mode::implied}, {"*RLA", Mode::indexed_indirect},
+    {"BIT", Mode::zero_page}, {"AND", Mode::zero_page}, {"ROL", Mode::zero_page}, {"*RLA", Mode::zero_page},
+    {"PLP", Mode::implied}, {"AND", Mode::immediate}, {"ROL", Mode::accumulator}, {"*ANC", Mode::immediate},
+    {"BIT", Mode::absolute}, {"AND", Mode::absolute}, {"ROL", Mode::absolute}, {"*RLA", Mode::absolute},
+    {"BMI", Mode::relative}, {"AND", Mode::indirect_indexed}, {"*JAM", Mode::implied}, {"*RLA", Mode::indirect_indexed},
+    {"*NOP", Mode::zero_page_x}, {"AND", Mode::zero_page_x}, {"ROL", Mode::zero_page_x}, {"*RLA", Mode::zero_page_x},
+    {"SEC", Mode::implied}, {"AND", Mode::absolute_y}, {"*NOP", Mode::implied}, {"*RLA", Mode::absolute_y},
+    {"*NOP", Mode::absolute_x}, {"AND", Mode::absolute_x}, {"ROL", Mode::absolute_x}, {"*RLA", Mode::absolute_x},
+    {"RTI", Mode::implied}, {"EOR", Mode::indexed_indirect}, {"*JAM", Mode::implied}, {"*SRE", Mode::indexed_indirect},
+    {"*NOP", Mode::zero_page}, {"EOR", Mode::zero_page}, {"LSR", Mode::zero_page}, {"*SRE", Mode::zero_page},
+    {"PHA", Mode::implied}, {"EOR", Mode::immediate}, {"LSR", Mode::accumulator}, {"*ALR", Mode::immediate},
+    {"JMP", Mode::absolute}, {"EOR", Mode::absolute}, {"LSR", Mode::absolute}, {"*SRE", Mode::absolute},
+    {"BVC", Mode::relative}, {"EOR", Mode::indirect_indexed}, {"*JAM", Mode::implied}, {"*SRE", Mode::indirect_indexed},
+    {"*NOP", Mode::zero_page_x}, {"EOR", Mode::zero_page_x}, {"LSR", Mode::zero_page_x}, {"*SRE", Mode::zero_page_x},
+    {"CLI", Mode::implied}, {"EOR", Mode::absolute_y}, {"*NOP", Mode::implied}, {"*SRE", Mode::absolute_y},
+    {"*NOP", Mode::absolute_x}, {"EOR", Mode::absolute_x}, {"LSR", Mode::absolute_x}, {"*SRE", Mode::absolute_x},
+    {"RTS", Mode::implied}, {"ADC", Mode::indexed_indirect}, {"*JAM", Mode::implied}, {"*RRA", Mode::indexed_indirect},
+    {"*NOP", Mode::zero_page}, {"ADC", Mode::zero_page}, {"ROR", Mode::zero_page}, {"*RRA", Mode::zero_page},
+    {"PLA", Mode::implied}, {"ADC", Mode::immediate}, {"ROR", Mode::accumulator}, {"*ARR", Mode::immediate},
+    {"JMP", Mode::indirect}, {"ADC", Mode::absolute}, {"ROR", Mode::absolute}, {"*RRA", Mode::absolute},
+    {"BVS", Mode::relative}, {"ADC", Mode::indirect_indexed}, {"*JAM", Mode::implied}, {"*RRA", Mode::indirect_indexed},
+    {"*NOP", Mode::zero_page_x}, {"ADC", Mode::zero_page_x}, {"ROR", Mode::zero_page_x}, {"*RRA", Mode::zero_page_x},
+    {"SEI", Mode::implied}, {"ADC", Mode::absolute_y}, {"*NOP", Mode::implied}, {"*RRA", Mode::absolute_y},
+    {"*NOP", Mode::absolute_x}, {"ADC", Mode::absolute_x}, {"ROR", Mode::absolute_x}, {"*RRA", Mode::absolute_x},
+    {"*NOP", Mode::immediate}, {"STA", Mode::indexed_indirect}, {"*NOP", Mode::immediate}, {"*SAX", Mode::indexed_indirect},
+    {"STY", Mode::zero_page}, {"STA", Mode::zero_page}, {"STX", Mode::zero_page}, {"*SAX", Mode::zero_page},
+    {"DEY", Mode::implied}, {"*NOP", Mode::immediate}, {"TXA", Mode::implied}, {"*XAA", Mode::immediate},
+    {"STY", Mode::absolute}, {"STA", Mode::absolute}, {"STX", Mode::absolute}, {"*SAX", Mode::absolute},
+    {"BCC", Mode::relative}, {"STA", Mode::indirect_indexed}, {"*JAM", Mode::implied}, {"*SHA", Mode::indirect_indexed},
+    {"STY", Mode::zero_page_x}, {"STA", Mode::zero_page_x}, {"STX", Mode::zero_page_y}, {"*SAX", Mode::zero_page_y},
+    {"TYA", Mode::implied}, {"STA", Mode::absolute_y}, {"TXS", Mode::implied}, {"*TAS", Mode::absolute_y},
+    {"*SHY", Mode::absolute_x}, {"STA", Mode::absolute_x}, {"*SHX", Mode::absolute_y}, {"*SHA", Mode::absolute_y},
+    {"LDY", Mode::immediate}, {"LDA", Mode::indexed_indirect}, {"LDX", Mode::immediate}, {"*LAX", Mode::indexed_indirect},
+    {"LDY", Mode::zero_page}, {"LDA", Mode::zero_page}, {"LDX", Mode::zero_page}, {"*LAX", Mode::zero_page},
+    {"TAY", Mode::implied}, {"LDA", Mode::immediate}, {"TAX", Mode::implied}, {"*LAX", Mode::immediate},
+    {"LDY", Mode::absolute}, {"LDA", Mode::absolute}, {"LDX", Mode::absolute}, {"*LAX", Mode::absolute},
+    {"BCS", Mode::relative}, {"LDA", Mode::indirect_indexed}, {"*JAM", Mode::implied}, {"*LAX", Mode::indirect_indexed},
+    {"LDY", Mode::zero_page_x}, {"LDA", Mode::zero_page_x}, {"LDX", Mode::zero_page_y}, {"*LAX", Mode::zero_page_y},
+    {"CLV", Mode::implied}, {"LDA", Mode::absolute_y}, {"TSX", Mode::implied}, {"*LAS", Mode::absolute_y},
+    {"LDY", Mode::absolute_x}, {"LDA", Mode::absolute_x}, {"LDX", Mode::absolute_y}, {"*LAX", Mode::absolute_y},
+    {"CPY", Mode::immediate}, {"CMP", Mode::indexed_indirect}, {"*NOP", Mode::immediate}, {"*DCP", Mode::indexed_indirect},
+    {"CPY", Mode::zero_page}, {"CMP", Mode::zero_page}, {"DEC", Mode::zero_page}, {"*DCP", Mode::zero_page},
+    {"INY", Mode::implied}, {"CMP", Mode::immediate}, {"DEX", Mode::implied}, {"*AXS", Mode::immediate},
+    {"CPY", Mode::absolute}, {"CMP", Mode::absolute}, {"DEC", Mode::absolute}, {"*DCP", Mode::absolute},
+    {"BNE", Mode::relative}, {"CMP", Mode::indirect_indexed}, {"*JAM", Mode::implied}, {"*DCP", Mode::indirect_indexed},
+    {"*NOP", Mode::zero_page_x}, {"CMP", Mode::zero_page_x}, {"DEC", Mode::zero_page_x}, {"*DCP", Mode::zero_page_x},
+    {"CLD", Mode::implied}, {"CMP", Mode::absolute_y}, {"*NOP", Mode::implied}, {"*DCP", Mode::absolute_y},
+    {"*NOP", Mode::absolute_x}, {"CMP", Mode::absolute_x}, {"DEC", Mode::absolute_x}, {"*DCP", Mode::absolute_x},
+    {"CPX", Mode::immediate}, {"SBC", Mode::indexed_indirect}, {"*NOP", Mode::immediate}, {"*ISC", Mode::indexed_indirect},
+    {"CPX", Mode::zero_page}, {"SBC", Mode::zero_page}, {"INC", Mode::zero_page}, {"*ISC", Mode::zero_page},
+    {"INX", Mode::implied}, {"SBC", Mode::immediate}, {"NOP", Mode::implied}, {"*SBC", Mode::immediate},
+    {"CPX", Mode::absolute}, {"SBC", Mode::absolute}, {"INC", Mode::absolute}, {"*ISC", Mode::absolute},
+    {"BEQ", Mode::relative}, {"SBC", Mode::indirect_indexed}, {"*JAM", Mode::implied}, {"*ISC", Mode::indirect_indexed},
+    {"*NOP", Mode::zero_page_x}, {"SBC", Mode::zero_page_x}, {"INC", Mode::zero_page_x}, {"*ISC", Mode::zero_page_x},
+    {"SED", Mode::implied}, {"SBC", Mode::absolute_y}, {"*NOP", Mode::implied}, {"*ISC", Mode::absolute_y},
+    {"*NOP", Mode::absolute_x}, {"SBC", Mode::absolute_x}, {"INC", Mode::absolute_x}, {"*ISC", Mode::absolute_x},
+
+};
+}
+
+const TraceEntry& TraceBuffer::Get(uint32_t index) const {
+    uint64_t first = head < SIZE ? 0 : head - SIZE;
+    return entries[(first + index) & (SIZE - 1)];
+}
+
+bool TraceBuffer::Dump(const std::string& location) const {
+    FILE* file = nullptr;
+    if (fopen_s(&file, location.c_str(), "w")) return true;
+
+    char line[Disassembler::LINE_SIZE];
+    const uint32_t count = GetCount();
+    for (uint32_t i = 0; i < count; ++i) {
+        int length = Disassembler::Format(Get(i), &line[0], sizeof(line));
+        fwrite(&line[0], 1, length, file);
+        fputc('\n', file);
+    }
+    bool error = ferror(file) != 0;
+    fclose(file);
+    return error;
+}
+
+uint8_t Disassembler::GetLength(uint8_t opcode) {
+    switch (opcodes[opcode].mode) {
+    case Mode::implied:
+    case Mode::accumulator:
+        return 1;
+    case Mode::absolute:
+    case Mode::absolute_x:
+    case Mode::absolute_y:
+    case Mode::indirect:
+        return 3;
+    default:
+        return 2;
+    }
+}
+
+Disassembler::Mode Disassembler::GetMode(uint8_t opcode) {
+    return opcodes[opcode].mode;
+}
+
+const char* Disassembler::GetMnemonic(uint8_t opcode) {
+    return opcodes[opcode].mnemonic;
+}
+
+bool Disassembler::IsBranch(uint8_t opcode) {
+    return opcodes[opcode].mode == Mode::relative;
+}
+
+bool Disassembler::WritesMemory(uint8_t opcode) {
+    static const char* stores[] = {"STA", "STX", "STY", "*SAX", "*SHA", "*SHX", "*SHY", "*TAS", "PHA", "PHP", "JSR", "BRK"};
+    static const char* read_modify_writes[] = {"ASL", "LSR", "ROL", "ROR", "INC", "DEC", "*SLO", "*RLA", "*SRE", "*RRA", "*DCP", "*ISC"};
+
+    const Opcode& op = opcodes[opcode];
+    for (const char* name : stores) {
+        if (!strcmp(op.mnemonic, name)) return true;
+    }
+    if (op.mode == Mode::accumulator) return false;
+    for (const char* name : read_modify_writes) {
+        if (!strcmp(op.mnemonic, name)) return true;
+    }
+    return false;
+}
+
+std::string Disassembler::Format(const TraceEntry& entry) {
+    char line[Disassembler::LINE_SIZE];
+    int length = Format(entry, &line[0], sizeof(line));
+    return std::string(&line[0], length);
+}
+
+int Disassembler::Format(const TraceEntry& entry, char* out, size_t size) {
+    const Opcode& op = opcodes[entry.opcode];
+    const uint16_t abs = (entry.operand_hi << 8) | entry.operand_lo;
+
+    char bytes[9];
+    switch (GetLength(entry.opcode)) {
+    case 1: sprintf_s(&bytes[0], sizeof(bytes), "%02X", entry.opcode); break;
+    case 2: sprintf_s(&bytes[0], sizeof(bytes), "%02X %02X", entry.opcode, entry.operand_lo); break;
+    default: sprintf_s(&bytes[0], sizeof(bytes), "%02X %02X %02X", entry.opcode, entry.operand_lo, entry.operand_hi); break;
+    }
+
+    char operand[12] = "";
+    switch (op.mode) {
+    case Mode::implied: break;
+    case Mode::accumulator: sprintf_s(&operand[0], sizeof(operand), "A"); break;
+    case Mode::immediate: sprintf_s(&operand[0], sizeof(operand), "#$%02X", entry.operand_lo); break;
+    case Mode::zero_page: sprintf_s(&operand[0], sizeof(operand), "$%02X", entry.operand_lo); break;
+    case Mode::zero_page_x: sprintf_s(&operand[0], sizeof(operand), "$%02X,X", entry.operand_lo); break;
+    case Mode::zero_page_y: sprintf_s(&operand[0], sizeof(operand), "$%02X,Y", entry.operand_lo); break;
+    case Mode::absolute: sprintf_s(&operand[0], sizeof(operand), "$%04X", abs); break;
+    case Mode::absolute_x: sprintf_s(&operand[0], sizeof(operand), "$%04X,X", abs); break;
+    case Mode::absolute_y: sprintf_s(&operand[0], sizeof(operand), "$%04X,Y", abs); break;
+    case Mode::indirect: sprintf_s(&operand[0], sizeof(operand), "($%04X)", abs); break;
+    case Mode::indexed_indirect: sprintf_s(&operand[0], sizeof(operand), "($%02X,X)", entry.operand_lo); break;
+    case Mode::indirect_indexed: sprintf_s(&operand[0], sizeof(operand), "($%02X),Y", entry.operand_lo); break;
+    case Mode::relative:
+        sprintf_s(&operand[0], sizeof(operand), "$%04X", static_cast<uint16_t>(entry.pc + 2 + static_cast<int8_t>(entry.operand_lo)));
+        break;
+    }
+
+    int length = sprintf_s(out, size, "%04X  %-8s  %4s %-9s  A:%02X X:%02X Y:%02X P:%02X SP:%02X PPU:%3d,%3d CYC:%llu",
+                          entry.pc, &bytes[0], op.mnemonic, &operand[0], entry.A, entry.X, entry.Y, entry.P, entry.sp,
+                          entry.scanline, entry.dot, static_cast<unsigned long long>(entry.cycle));
+    return length < 0 ? 0 : length;
+}
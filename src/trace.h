@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+// CPU state right before an instruction executes. Kept small and flat so recording is a handful of stores
+struct TraceEntry {
+    uint64_t cycle{};
+    uint16_t pc{};
+    uint8_t opcode{}, operand_lo{}, operand_hi{};
+    uint8_t A{}, X{}, Y{}, P{}, sp{};
+    int16_t scanline{}, dot{};
+};
+
+// Fixed-size ring of the most recent instructions, nothing is formatted until an entry is looked at.
+// The ring is only allocated by the first traced instruction, consoles that never trace don't pay for it.
+class TraceBuffer {
+public:
+    static constexpr uint32_t SIZE = 0x20000;  // Must be a power of two
+
+    inline TraceEntry& Next() {
+        if (entries.empty()) entries.resize(SIZE);
+        return entries[head++ & (SIZE - 1)];
+    }
+    uint32_t GetCount() const { return head < SIZE ? static_cast<uint32_t>(head) : SIZE; }
+    const TraceEntry& Get(uint32_t index) const;  // 0 is the oldest entry still in the ring
+    void Clear() { head = 0; }
+    bool Dump(const std::string& location) const;
+
+private:
+    std::vector<TraceEntry> entries{};
+    uint64_t head{};
+};
+
+class Disassembler {
+public:
+    static constexpr size_t LINE_SIZE = 128;  // Enough for any formatted entry
+
+    enum class Mode : uint8_t {
+        implied, accumulator, immediate, zero_page, zero_page_x, zero_page_y,
+        absolute, absolute_x, absolute_y, indirect, indexed_indirect, indirect_indexed, relative
+    };
+
+    static uint8_t GetLength(uint8_t opcode);
+    static Mode GetMode(uint8_t opcode);
+    static const char* GetMnemonic(uint8_t opcode);
+    static bool IsBranch(uint8_t opcode);
+    static bool WritesMemory(uint8_t opcode);  // Stores, memory read-modify-writes, pushes and JSR/BRK
+    static std::string Format(const TraceEntry& entry);
+    static int Format(const TraceEntry& entry, char* out, size_t size);  // Returns the length of the line, size must be at least LINE_SIZE
+};
@@ -0,0 +1,145 @@
+#include <string.h>
+#include <chrono>
+
+#include "log.h"
+#include "video_capture.h"
+
+
+VideoCapture::~VideoCapture() {
+    Stop();
+}
+
+bool VideoCapture::Start(const std::string& location, Ppu& ppu, bool wait) {
+    Stop();
+    if (fopen_s(&file, location.c_str(), "wb")) {
+        file = nullptr;
+        log_helper.AddLog("Could not open " + location + " for recording\n", LogCategory::general, LogLevel::error);
+        return true;
+    }
+    const size_t dot = location.find_last_of('.');
+    y4m = dot != std::string::npos && location.substr(dot) == ".y4m";
+    wait_when_full = wait;
+
+    for (uint8_t i = 0; i < 0x40; ++i) {
+        palette[i] = ppu.GetPaletteColor(i);
+        const int r = palette[i] >> 24, g = (palette[i] >> 16) & 0xFF, b = (palette[i] >> 8) & 0xFF;
+        yuv[i][0] = static_cast<uint8_t>(16 + ((66 * r + 129 * g + 25 * b + 128) >> 8));
+        yuv[i][1] = static_cast<uint8_t>(128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8));
+        yuv[i][2] = static_cast<uint8_t>(128 + ((112 * r - 94 * g - 18 * b + 128) >> 8));
+    }
+    if (WriteHeader()) {
+        fclose(file);
+        file = nullptr;
+        log_helper.AddLog("Could not write to " + location + "\n", LogCategory::general, LogLevel::error);
+        return true;
+    }
+
+    source = &ppu;
+    source_indexed = ppu.indexed_output;
+    ppu.indexed_output = true;
+    ring.resize(QUEUE_SIZE);
+    write_pos = read_pos = 0;
+    written = 0;
+    dropped = 0;
+    write_error = false;
+    stop = false;
+    writer = std::thread(&VideoCapture::WriterThread, this);
+    log_helper.AddLog("\nRecording to " + location + '\n', LogCategory::general, LogLevel::info);
+    return false;
+}
+
+bool VideoCapture::Stop() {
+    if (!file) return false;
+    stop = true;
+    wake.notify_one();
+    writer.join();
+
+    bool error = write_error || fclose(file) != 0;
+    file = nullptr;
+    source->indexed_output = source_indexed;
+    source = nullptr;
+    char summary[96];
+    snprintf(&summary[0], sizeof(summary), "Recording stopped, %llu frames written and %llu dropped\n", static_cast<unsigned long long>(written.load()),
+             static_cast<unsigned long long>(dropped));
+    log_helper.AddLog(&summary[0], LogCategory::general, error ? LogLevel::error : LogLevel::info);
+    return error;
+}
+
+void VideoCapture::Push(const Ppu& ppu) {
+    if (!file) return;
+    const uint64_t pos = write_pos.load(std::memory_order_relaxed);
+    while (pos - read_pos.load(std::memory_order_acquire) >= QUEUE_SIZE) {
+        if (!wait_when_full) {
+            ++dropped;
+            return;
+        }
+        std::this_thread::yield();
+    }
+
+    Frame& frame = ring[pos % QUEUE_SIZE];
+    memcpy(frame.pixels.data(), &(*ppu.indexed_data)[0][0], frame.pixels.size());
+    memcpy(&frame.emphasis[0], &ppu.line_emphasis[0], sizeof(frame.emphasis));
+    write_pos.store(pos + 1, std::memory_order_release);
+    wake.notify_one();
+}
+
+// The producer never takes the mutex, so a wakeup can be missed. The timeout bounds how late that makes the writer.
+void VideoCapture::WriterThread() {
+    while (true) {
+        const uint64_t pos = read_pos.load(std::memory_order_relaxed);
+        if (pos == write_pos.load(std::memory_order_acquire)) {
+            if (stop) break;
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait_for(lock, std::chrono::milliseconds(5));
+            continue;
+        }
+        if (!write_error) write_error = WriteFrame(ring[pos % QUEUE_SIZE]);
+        read_pos.store(pos + 1, std::memory_order_release);
+        ++written;
+    }
+}
+
+static void PutLE32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+}
+
+bool VideoCapture::WriteHeader() {
+    if (y4m) {
+        // The NTSC frame rate is 39375000 / 655171, about 60.0988
+        const char header[] = "YUV4MPEG2 W256 H240 F39375000:655171 Ip A1:1 C444\n";
+        return fwrite(&header[0], 1, sizeof(header) - 1, file) != sizeof(header) - 1;
+    }
+    std::vector<uint8_t> header = {'E', 'Z', 'R', 'L'};
+    PutLE32(header, 1);
+    PutLE32(header, 256);
+    PutLE32(header, 240);
+    for (uint32_t color : palette) PutLE32(header, color);
+    return fwrite(header.data(), 1, header.size(), file) != header.size();
+}
+
+bool VideoCapture::WriteFrame(const Frame& frame) {
+    buffer.clear();
+    if (y4m) {
+        const char tag[] = "FRAME\n";
+        buffer.insert(buffer.end(), &tag[0], &tag[sizeof(tag) - 1]);
+        for (int plane = 0; plane < 3; ++plane) {
+            for (uint8_t index : frame.pixels) buffer.push_back(yuv[index & 0x3F][plane]);
+        }
+    }
+    else {
+        buffer.insert(buffer.end(), &frame.emphasis[0], &frame.emphasis[240]);
+        const size_t size_pos = buffer.size();
+        PutLE32(buffer, 0);
+        for (size_t pos = 0; pos < frame.pixels.size();) {
+            const uint8_t color = frame.pixels[pos];
+            size_t length = 1;
+            while (length < 256 && pos + length < frame.pixels.size() && frame.pixels[pos + length] == color) ++length;
+            buffer.push_back(static_cast<uint8_t>(length - 1));
+            buffer.push_back(color);
+            pos += length;
+        }
+        const uint32_t runs_size = static_cast<uint32_t>(buffer.size() - size_pos - 4);
+        for (int i = 0; i < 4; ++i) buffer[size_pos + i] = static_cast<uint8_t>(runs_size >> (i * 8));
+    }
+    return fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size();
+}
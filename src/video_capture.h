@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ppu.h"
+
+
+// Records the game to a file without holding up the emulation. Finished frames are copied from the indexed
+// output into a fixed ring and a background thread converts and writes them. When the writer falls behind
+// and the ring is full, frames are dropped and counted. There is no APU yet, so there is no audio track.
+//
+// Files ending in .y4m are YUV4MPEG2 with full resolution chroma, which video tools read directly. Everything
+// else gets the run-length format: "EZRL", version, width and height as 32 bit little endian values, the 64
+// colour RGBA palette, then per frame the 240 emphasis bytes, the byte size of the runs and the runs
+// themselves as (length - 1, colour) pairs going through the frame row by row.
+class VideoCapture {
+public:
+    static constexpr uint32_t QUEUE_SIZE = 16;  // Frames, about a quarter of a second
+
+    ~VideoCapture();
+    bool Start(const std::string& location, Ppu& ppu, bool wait_when_full);  // Waiting instead of dropping is for offline runs
+    bool Stop();  // True if anything could not be written
+    void Push(const Ppu& ppu);  // After every finished frame
+    inline bool IsRunning() const { return file != nullptr; }
+    inline uint64_t GetFrameCount() const { return written; }
+    inline uint64_t GetDroppedCount() const { return dropped; }
+
+private:
+    struct Frame {
+        std::array<uint8_t, 256 * 240> pixels{};
+        uint8_t emphasis[240]{};
+    };
+
+    void WriterThread();
+    bool WriteHeader();
+    bool WriteFrame(const Frame& frame);
+
+    FILE* file = nullptr;
+    bool y4m = false;
+    bool wait_when_full = false;
+    Ppu* source = nullptr;
+    bool source_indexed = false;  // What the PPU had before, restored on Stop
+    uint32_t palette[0x40]{};
+    uint8_t yuv[0x40][3]{};  // BT.601 studio range for each palette entry
+    std::vector<uint8_t> buffer{};  // Encoded frame, only touched by the writer
+
+    std::vector<Frame> ring{};
+    std::atomic<uint64_t> write_pos{0}, read_pos{0};  // Single producer, single consumer
+    std::thread writer{};
+    std::mutex mutex{};
+    std::condition_variable wake{};
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> written{0};
+    uint64_t dropped{};
+    bool write_error = false;  // Only touched by the writer until it has been joined
+};
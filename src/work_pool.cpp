@@ -0,0 +1,80 @@
+#include <algorithm>
+
+#include "work_pool.h"
+
+
+WorkPool::WorkPool(uint32_t thread_count) {
+    if (thread_count == 0) thread_count = std::max(1u, std::thread::hardware_concurrency());
+    for (uint32_t i = 0; i < thread_count; ++i) queues.emplace_back(new Queue);
+    for (uint32_t i = 0; i < thread_count; ++i) threads.emplace_back(&WorkPool::WorkerThread, this, i);
+}
+
+WorkPool::~WorkPool() {
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        stop = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads) thread.join();
+}
+
+void WorkPool::Submit(Task task) {
+    Queue& queue = *queues[next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size()];
+    pending.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        ++queued;
+    }
+    wake.notify_one();
+}
+
+void WorkPool::Wait() {
+    std::unique_lock<std::mutex> lock(state_mutex);
+    finished.wait(lock, [this]() { return pending.load() == 0; });
+}
+
+bool WorkPool::Take(const uint32_t index, Task& task) {
+    {
+        Queue& own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues.size(); ++i) {
+        Queue& victim = *queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkPool::WorkerThread(const uint32_t index) {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(state_mutex);
+            wake.wait(lock, [this]() { return stop || queued > 0; });
+            if (queued == 0) return;  // Stopping and nothing left
+            --queued;  // Claims one task, which is in some queue by now
+        }
+
+        Task task;
+        while (!Take(index, task)) std::this_thread::yield();  // Only spins while another thread is mid-steal
+        task();
+
+        if (pending.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            finished.notify_all();
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Fixed set of threads with a queue each. A thread runs its own tasks newest first and steals the oldest
+// task of another one when it runs dry, so uneven jobs spread out without everyone fighting over one queue.
+class WorkPool {
+public:
+    typedef std::function<void()> Task;
+
+    explicit WorkPool(uint32_t thread_count);  // 0 uses every core
+    ~WorkPool();
+    WorkPool(const WorkPool&) = delete;
+    WorkPool& operator=(const WorkPool&) = delete;
+
+    void Submit(Task task);  // Spread round-robin over the queues, tasks may submit more tasks
+    void Wait();  // Until every submitted task has finished
+    inline uint32_t GetThreadCount() const { return static_cast<uint32_t>(threads.size()); }
+
+private:
+    struct Queue {
+        std::mutex mutex{};
+        std::deque<Task> tasks{};
+    };
+
+    void WorkerThread(uint32_t index);
+    bool Take(uint32_t index, Task& task);
+
+    std::vector<std::unique_ptr<Queue>> queues{};
+    std::vector<std::thread> threads{};
+    std::mutex state_mutex{};
+    std::condition_variable wake{}, finished{};
+    uint64_t queued{};  // Guarded by state_mutex
+    std::atomic<uint64_t> pending{0};  // Submitted and not finished yet
+    std::atomic<uint32_t> next_queue{0};
+    bool stop = false;
+};
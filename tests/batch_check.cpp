@@ -0,0 +1,71 @@
+// Runs the smoke ROMs through the batch runner with 1, 2, 4 and 8 threads, with and without the fast paths.
+// Every run has to give the same state hashes and frame CRCs, and the 600 frame hashes have to be the ones
+// the ROMs expect. Built with everything in src/ except main.cpp and texture_uploader.cpp, plus Dear ImGui.
+// Usage: batch_check [directory for the generated ROMs]
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "batch_runner.h"
+#include "log.h"
+#include "smoke_roms.h"
+
+
+int main(int argc, char* argv[]) {
+    log_helper.Start();
+    const std::string directory = argc > 1 ? argv[1] : ".";
+    const uint32_t frame_counts[] = {1, 60, 600};
+    const uint32_t thread_counts[] = {1, 2, 4, 8};
+
+    std::vector<BatchRunner::Job> jobs;
+    for (const SmokeRom& rom : SMOKE_ROMS) {
+        const std::string location = directory + "/" + rom.name;
+        if (WriteSmokeRom(rom, location)) {
+            printf("Could not write %s\n", location.c_str());
+            return 2;
+        }
+        for (uint32_t frames : frame_counts) {
+            BatchRunner::Job job;
+            job.rom = location;
+            job.frames = frames;
+            jobs.push_back(job);
+        }
+    }
+
+    uint32_t failures = 0;
+    std::vector<BatchRunner::Result> reference;
+    for (int fast = 0; fast < 2; ++fast) {
+        for (uint32_t threads : thread_counts) {
+            BatchRunner runner;
+            runner.fast_paths = fast != 0;
+            for (const BatchRunner::Job& job : jobs) runner.AddJob(job);
+            runner.Run(threads);
+
+            const std::vector<BatchRunner::Result>& results = runner.GetResults();
+            if (reference.empty()) reference = results;
+            uint32_t mismatches = 0;
+            for (size_t i = 0; i < jobs.size(); ++i) {
+                if (results[i].error || results[i].state_hash != reference[i].state_hash || results[i].frame_crc != reference[i].frame_crc) {
+                    printf("  %s, %u frames: state %08X frame %08X, expected %08X %08X\n", jobs[i].rom.c_str(), jobs[i].frames,
+                           results[i].state_hash, results[i].frame_crc, reference[i].state_hash, reference[i].frame_crc);
+                    ++mismatches;
+                }
+            }
+            printf("%u threads%s: %s\n", threads, fast ? ", fast paths" : "", mismatches ? "MISMATCH" : "ok");
+            failures += mismatches;
+        }
+    }
+
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        const SmokeRom& rom = SMOKE_ROMS[i / (sizeof(frame_counts) / sizeof(frame_counts[0]))];
+        if (jobs[i].frames == 600 && reference[i].state_hash != rom.state_hash) {
+            printf("%s: state hash %08X after 600 frames, expected %08X\n", rom.name, reference[i].state_hash, rom.state_hash);
+            ++failures;
+        }
+    }
+
+    printf("%u failures\n", failures);
+    log_helper.Stop();
+    return failures ? 1 : 0;
+}
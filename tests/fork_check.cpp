@@ -0,0 +1,75 @@
+// Forks the smoke ROMs through the C interface and restores them, into the same environment and into a second
+// one, with and without the fast paths. A restored fork has to give the state hash the environment had when it
+// was forked, and running on from it has to reach the same hash as the first time. Built like batch_check.
+// Usage: fork_check [directory for the generated ROMs]
+
+#include <stdio.h>
+#include <string>
+
+#include "eznes.h"
+#include "smoke_roms.h"
+
+
+static uint32_t failures = 0;
+
+static void Expect(const char* what, const std::string& rom, uint32_t hash, uint32_t expected) {
+    if (hash == expected) return;
+    printf("  %s, %s: state hash %08X, expected %08X\n", rom.c_str(), what, hash, expected);
+    ++failures;
+}
+
+static void Run(eznes* env, uint32_t frames) {
+    for (uint32_t i = 0; i < frames; ++i) eznes_step(env, static_cast<uint8_t>(i * 37));
+}
+
+int main(int argc, char* argv[]) {
+    const std::string directory = argc > 1 ? argv[1] : ".";
+    for (const SmokeRom& rom : SMOKE_ROMS) {
+        const std::string location = directory + "/" + rom.name;
+        if (WriteSmokeRom(rom, location)) {
+            printf("Could not write %s\n", location.c_str());
+            return 2;
+        }
+        const uint32_t failures_before = failures;
+        for (uint32_t flags : {0u, static_cast<uint32_t>(EZNES_FAST_PATHS)}) {
+            eznes* env = eznes_create(location.c_str(), flags);
+            eznes* other = eznes_create(location.c_str(), flags);
+            if (!env || !other) {
+                printf("Could not load %s\n", location.c_str());
+                return 2;
+            }
+
+            Run(env, 30);
+            eznes_forked_state* root = eznes_fork(env, nullptr);
+            const uint32_t root_hash = eznes_get_state_hash(env);
+            Run(env, 60);
+            eznes_forked_state* child = eznes_fork(env, root);
+            const uint32_t child_hash = eznes_get_state_hash(env);
+            Run(env, 60);
+            const uint32_t end_hash = eznes_get_state_hash(env);
+            if (eznes_fork_own_size(child) >= eznes_fork_own_size(root)) {
+                printf("  %s: the child shares nothing with its parent\n", location.c_str());
+                ++failures;
+            }
+
+            if (eznes_restore_fork(env, root)) ++failures;
+            Expect("root", location, eznes_get_state_hash(env), root_hash);
+            Run(env, 60);
+            Expect("root run on", location, eznes_get_state_hash(env), child_hash);
+
+            eznes_free_fork(root);  // The child keeps the pages it shares
+            if (eznes_restore_fork(other, child)) ++failures;
+            Expect("child in another environment", location, eznes_get_state_hash(other), child_hash);
+            Run(other, 60);
+            Expect("child run on", location, eznes_get_state_hash(other), end_hash);
+
+            eznes_free_fork(child);
+            eznes_destroy(other);
+            eznes_destroy(env);
+        }
+        printf("%s: %s\n", rom.name, failures != failures_before ? "MISMATCH" : "ok");
+    }
+
+    printf("%u failures\n", failures);
+    return failures ? 1 : 0;
+}
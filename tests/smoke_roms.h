@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+
+// Tiny generated NROM images, so the checks run without any ROM files. The program is placed at $8000,
+// every vector points there and the rest of PRG is NOPs. CHR is blank ROM, or RAM when asked for.
+struct SmokeRom {
+    const char* name;
+    const char* program;  // Hex
+    uint32_t state_hash;  // Console::GetStateHash after 600 frames, the same with and without the fast paths
+};
+
+static const SmokeRom SMOKE_ROMS[] = {
+    {"loop.nes", "e8c869018510a511290faa4c0080", 0xAFA49F6F},  // Counts in a tight loop forever
+    {"unofficial.nes", "a9338500a9058502a9818503a9108504a700a20f8701a905c70208688505a9000703a503850638a920e704850702",
+     0xA35E8AC1},  // LAX, SAX, DCP, SLO and ISC on zero page, then JAM
+};
+
+inline bool WriteSmokeRom(const SmokeRom& rom, const std::string& location, bool chr_ram = false) {
+    std::vector<uint8_t> image(0x10 + 0x4000 + (chr_ram ? 0 : 0x2000), 0);
+    const uint8_t header[] = {'N', 'E', 'S', 0x1A, 1, static_cast<uint8_t>(chr_ram ? 0 : 1)};
+    for (size_t i = 0; i < sizeof(header); ++i) image[i] = header[i];
+
+    uint8_t* prg = &image[0x10];
+    for (size_t i = 0; i < 0x4000; ++i) prg[i] = 0xEA;
+    for (size_t i = 0; rom.program[i * 2] && rom.program[i * 2 + 1]; ++i) {
+        const char digits[3] = {rom.program[i * 2], rom.program[i * 2 + 1], 0};
+        prg[i] = static_cast<uint8_t>(strtoul(&digits[0], nullptr, 16));
+    }
+    for (size_t vector = 0x3FFA; vector < 0x4000; vector += 2) {
+        prg[vector] = 0x00;
+        prg[vector + 1] = 0x80;
+    }
+
+    FILE* file = nullptr;
+    if (fopen_s(&file, location.c_str(), "wb")) return true;
+    const bool error = fwrite(&image[0], 1, image.size(), file) != image.size();
+    fclose(file);
+    return error;
+}
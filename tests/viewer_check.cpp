@@ -0,0 +1,75 @@
+// Checks the incremental pattern table and nametable viewers against a full redraw. Every round makes random
+// CHR, nametable and palette writes, switches the mirroring now and then, redraws the viewers incrementally
+// and then from scratch, and compares the two. Built like batch_check.
+// Usage: viewer_check [rounds] [seed]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "console.h"
+#include "log.h"
+#include "smoke_roms.h"
+
+
+int main(int argc, char* argv[]) {
+    log_helper.Start();
+    const int rounds = argc > 1 ? atoi(argv[1]) : 300;
+    const unsigned seed = argc > 2 ? static_cast<unsigned>(strtoul(argv[2], nullptr, 10)) : 1;
+    const std::string location = "viewer_check.nes";
+    if (WriteSmokeRom(SMOKE_ROMS[0], location, true)) {  // CHR-RAM, so the pattern tables can be written
+        printf("Could not write %s\n", location.c_str());
+        return 2;
+    }
+
+    Console console;
+    console.memory.use_save_file = false;
+    if (console.LoadROM(location, nullptr)) return 2;
+    Memory& memory = console.memory;
+    Ppu& ppu = console.ppu;
+    srand(seed);
+
+    int failures = 0;
+    size_t redrawn_lines = 0;
+    std::vector<uint8_t> nametables, pattern_tables;
+    for (int round = 0; round < rounds; ++round) {
+        const int writes = rand() % 40;
+        for (int i = 0; i < writes; ++i) {
+            const int target = rand() % 10;
+            uint16_t addr;
+            if (target < 3) addr = rand() % 0x2000;
+            else if (target < 9) addr = 0x2000 + rand() % 0x1000;
+            else addr = 0x3F00 + rand() % 0x20;
+            memory.PpuWrite(addr, static_cast<uint8_t>(rand()));
+        }
+        if (round % 50 == 25) memory.SetMirroring(static_cast<Memory::Mirroring>(rand() % 5));
+
+        const uint8_t palette = static_cast<uint8_t>(round % 8);
+        ppu.SetNametables();
+        ppu.SetPatternTables(palette);
+        for (int table = 0; table < 4; ++table) redrawn_lines += ppu.nametable_lines[table].count();
+        const uint8_t* nametable_bytes = reinterpret_cast<const uint8_t*>(ppu.nametable_data);
+        const uint8_t* pattern_bytes = reinterpret_cast<const uint8_t*>(ppu.pattern_table_data);
+        nametables.assign(nametable_bytes, nametable_bytes + sizeof(*ppu.nametable_data));
+        pattern_tables.assign(pattern_bytes, pattern_bytes + sizeof(*ppu.pattern_table_data));
+
+        ppu.InvalidateViewers();
+        ppu.SetNametables();
+        ppu.SetPatternTables(palette);
+        if (memcmp(&nametables[0], ppu.nametable_data, nametables.size())) {
+            printf("Nametable viewer differs from a full redraw in round %d\n", round);
+            ++failures;
+        }
+        if (memcmp(&pattern_tables[0], ppu.pattern_table_data, pattern_tables.size())) {
+            printf("Pattern table viewer differs from a full redraw in round %d\n", round);
+            ++failures;
+        }
+    }
+
+    printf("%d failures in %d rounds, %zu of 960 nametable lines redrawn per round on average\n", failures, rounds,
+           rounds ? redrawn_lines / rounds : 0);
+    log_helper.Stop();
+    return failures ? 1 : 0;
+}